@@ -30,8 +30,12 @@
 
 #include <Quartz/Utilities/Singleton.hpp>
 
+#include <deque>
+#include <istream>
+#include <ostream>
 #include <string>
-#include <vector>
+#include <string_view>
+#include <unordered_map>
 
 namespace phoenix
 {
@@ -65,9 +69,21 @@ namespace phoenix
 		class BlockRegistry : public qz::utils::Singleton<BlockRegistry>
 		{
 		private:
-			std::vector<RegisteredBlock> m_blocks;
+			/**
+			 * @brief Blocks indexed by ID. A deque keeps the unique names at
+			 * stable addresses, so the lookup table can key on views of them.
+			 */
+			std::deque<RegisteredBlock> m_blocks;
+
+			std::unordered_map<std::string_view, BlockID> m_lookup;
+
+			BlockID addBlock(BlockID blockId, const std::string& uniqueName,
+			                 const std::string& displayName);
 
 		public:
+			/// @brief Returned by lookups when a block does not exist.
+			static constexpr BlockID INVALID_BLOCK = static_cast<BlockID>(-1);
+
 			BlockRegistry();
 
 			/** 
@@ -76,9 +92,32 @@ namespace phoenix
 			 * @param uniqueName The blocks unique name, this is unique to the block and used on saves and loading lua
 			 * @param displayName The human friendly name for the block seen ingame
 			 * @return On success, returns the blocks ID in the registry, on failure a -1
+			 *
+			 * Fails if the unique name is empty or contains whitespace, as
+			 * it could not be read back from a saved ID map.
 			 */
 			BlockID registerBlock(const std::string& uniqueName,
 			                      const std::string& displayName);
+			/**
+			 * @brief Registers every block listed in a Lua mod manifest.
+			 *
+			 * The manifest is a Lua file returning a table such as:
+			 * @code
+			 * return {
+			 *     blocks = {
+			 *         { uniqueName = "core:dirt", displayName = "Dirt" },
+			 *         { uniqueName = "core:stone", displayName = "Stone" },
+			 *     }
+			 * }
+			 * @endcode
+			 *
+			 * @param path The path to the manifest file
+			 * @param error Receives a description of the problem on failure
+			 * @return Returns false if the manifest could not be loaded, no
+			 * blocks are registered in that case
+			 */
+			bool registerBlocksFromManifest(const std::string& path,
+			                                std::string*       error = nullptr);
 			/** 
 			 * @brief Get the Display name for a block in the registry
 			 * 
@@ -92,7 +131,28 @@ namespace phoenix
 			 * @param uniqueName The blocks unique name used during saves and lua loading
 			 * @return Returns ID number as an int
 			 */
-			BlockID getBlockId(const std::string& uniqueName);
+			BlockID getBlockId(std::string_view uniqueName) const;
+			/// @brief Gets the number of IDs in use, including reserved ones.
+			std::size_t getBlockCount() const { return m_blocks.size(); }
+
+			/**
+			 * @brief Writes the name to ID mapping, so a save or a network
+			 * peer can reproduce the same IDs later.
+			 */
+			void saveIdMap(std::ostream& stream) const;
+			/**
+			 * @brief Reserves the IDs from a mapping written by saveIdMap.
+			 *
+			 * Must be called before any block is registered. Blocks
+			 * registered afterwards keep their saved ID, new blocks get IDs
+			 * after the saved ones, and saved blocks that never get
+			 * registered keep their ID reserved, displaying their unique
+			 * name.
+			 *
+			 * @return Returns false if the registry is not empty or the
+			 * mapping is malformed, the registry is left empty in that case
+			 */
+			bool loadIdMap(std::istream& stream);
 		};
 	} // namespace voxels
 
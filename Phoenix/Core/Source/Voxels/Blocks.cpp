@@ -28,8 +28,61 @@
 
 #include <Core/Voxels/Blocks.hpp>
 
+extern "C"
+{
+#include <lauxlib.h>
+#include <lua.h>
+#include <lualib.h>
+}
+
+#include <memory>
+#include <utility>
+#include <vector>
+
 using namespace phoenix::voxels;
 
+namespace
+{
+	const char* const ID_MAP_MAGIC   = "PhoenixBlockMap";
+	const int         ID_MAP_VERSION = 1;
+
+	bool fail(std::string* error, const std::string& message)
+	{
+		if (error != nullptr)
+			*error = message;
+
+		return false;
+	}
+
+	/**
+	 * @brief Unique names are written unquoted in ID maps, so they must be
+	 * a single non-empty word.
+	 */
+	bool isValidUniqueName(const std::string& uniqueName)
+	{
+		return !uniqueName.empty() &&
+		       uniqueName.find_first_of(" \t\r\n\v\f") == std::string::npos;
+	}
+
+	/// @brief Reads a string field from the table on top of the stack.
+	bool readStringField(lua_State* state, const char* field,
+	                     std::string& out)
+	{
+		lua_getfield(state, -1, field);
+		const bool isString = lua_type(state, -1) == LUA_TSTRING;
+
+		if (isString)
+		{
+			std::size_t length = 0;
+			const char* value  = lua_tolstring(state, -1, &length);
+			out.assign(value, length);
+		}
+
+		lua_pop(state, 1);
+		return isString;
+	}
+} // namespace
+
 RegisteredBlock::RegisteredBlock(const std::string& unique, BlockID id,
                                  const std::string& display)
     : uniqueName(unique), blockId(id), displayName(display) {};
@@ -38,21 +91,101 @@ RegisteredBlock::~RegisteredBlock() = default;
 
 BlockRegistry::BlockRegistry(){};
 
+BlockID BlockRegistry::addBlock(BlockID blockId, const std::string& uniqueName,
+                                const std::string& displayName)
+{
+	m_blocks.emplace_back(uniqueName, blockId, displayName);
+	m_lookup.emplace(m_blocks.back().uniqueName, blockId);
+
+	return blockId;
+}
+
 BlockID BlockRegistry::registerBlock(const std::string& uniqueName,
                                  const std::string& displayName)
 {	
+	if (!isValidUniqueName(uniqueName))
+		return INVALID_BLOCK;
+
 	BlockID exists = getBlockId(uniqueName);
-	if (exists == -1){
-		m_blocks.push_back(RegisteredBlock(uniqueName, m_blocks.size(), displayName));
-		return m_blocks.size() - 1;
+	if (exists == INVALID_BLOCK){
+		return addBlock(m_blocks.size(), uniqueName, displayName);
 	} else {
+		// The unique name is left alone, the lookup table holds a view of it.
 		m_blocks[exists].displayName = displayName;
-		m_blocks[exists].uniqueName = uniqueName;
 		return exists;
 	}
 
 };
 
+bool BlockRegistry::registerBlocksFromManifest(const std::string& path,
+                                               std::string*       error)
+{
+	std::unique_ptr<lua_State, decltype(&lua_close)> state(luaL_newstate(),
+	                                                       &lua_close);
+	if (state == nullptr)
+		return fail(error, "Could not create a Lua state.");
+
+	lua_State* lua = state.get();
+
+	// Manifests are data, so they only get the libraries needed to build
+	// tables, not io or os.
+	luaL_requiref(lua, "_G", luaopen_base, 1);
+	luaL_requiref(lua, LUA_STRLIBNAME, luaopen_string, 1);
+	luaL_requiref(lua, LUA_TABLIBNAME, luaopen_table, 1);
+	luaL_requiref(lua, LUA_MATHLIBNAME, luaopen_math, 1);
+	lua_settop(lua, 0);
+
+	if (luaL_loadfile(lua, path.c_str()) != LUA_OK ||
+	    lua_pcall(lua, 0, 1, 0) != LUA_OK)
+	{
+		const char* message = lua_tostring(lua, -1);
+		return fail(error, message == nullptr ? path : message);
+	}
+
+	if (!lua_istable(lua, -1))
+		return fail(error, path + ": manifest did not return a table.");
+
+	lua_getfield(lua, -1, "blocks");
+	if (!lua_istable(lua, -1))
+		return fail(error, path + ": manifest has no blocks table.");
+
+	// Everything is validated before registering, so a broken manifest does
+	// not leave half of a mod behind.
+	const std::size_t count = lua_rawlen(lua, -1);
+
+	std::vector<std::pair<std::string, std::string>> blocks;
+	blocks.reserve(count);
+
+	for (std::size_t i = 1; i <= count; ++i)
+	{
+		lua_rawgeti(lua, -1, static_cast<lua_Integer>(i));
+
+		std::pair<std::string, std::string> block;
+		if (!lua_istable(lua, -1) ||
+		    !readStringField(lua, "uniqueName", block.first) ||
+		    !readStringField(lua, "displayName", block.second))
+		{
+			return fail(error, path + ": block " + std::to_string(i) +
+			                       " needs a uniqueName and a displayName.");
+		}
+
+		if (!isValidUniqueName(block.first))
+		{
+			return fail(error, path + ": block " + std::to_string(i) +
+			                       " has an invalid uniqueName.");
+		}
+
+		lua_pop(lua, 1);
+		blocks.push_back(std::move(block));
+	}
+
+	m_lookup.reserve(m_lookup.size() + blocks.size());
+	for (const auto& block : blocks)
+		registerBlock(block.first, block.second);
+
+	return true;
+}
+
 const std::string& BlockRegistry::getDisplayName(BlockID blockId)
 {
 	if (blockId < m_blocks.size()){
@@ -63,14 +196,52 @@ const std::string& BlockRegistry::getDisplayName(BlockID blockId)
 	}
 };
 
-BlockID BlockRegistry::getBlockId(const std::string& uniqueName)
+BlockID BlockRegistry::getBlockId(std::string_view uniqueName) const
+{
+	const auto it = m_lookup.find(uniqueName);
+	return it == m_lookup.end() ? INVALID_BLOCK : it->second;
+}
+
+void BlockRegistry::saveIdMap(std::ostream& stream) const
+{
+	stream << ID_MAP_MAGIC << ' ' << ID_MAP_VERSION << '\n';
+	stream << m_blocks.size() << '\n';
+
+	for (const RegisteredBlock& block : m_blocks)
+		stream << block.blockId << ' ' << block.uniqueName << '\n';
+}
+
+bool BlockRegistry::loadIdMap(std::istream& stream)
 {
-	for (BlockID i = 0; i < m_blocks.size(); i++)
+	if (!m_blocks.empty())
+		return false;
+
+	std::string magic;
+	int         version = 0;
+	std::size_t count   = 0;
+
+	stream >> magic >> version >> count;
+	if (!stream || magic != ID_MAP_MAGIC || version != ID_MAP_VERSION)
+		return false;
+
+	// IDs are written in order, so each line must hold the next one.
+	m_lookup.reserve(count);
+	for (BlockID i = 0; i < count; ++i)
 	{
-		if (m_blocks[i].uniqueName == uniqueName)
+		BlockID     blockId = INVALID_BLOCK;
+		std::string uniqueName;
+
+		stream >> blockId >> uniqueName;
+		if (!stream || blockId != i || getBlockId(uniqueName) != INVALID_BLOCK)
 		{
-			return i;
-		};
+			m_blocks.clear();
+			m_lookup.clear();
+			return false;
+		}
+
+		// Reserved until a mod registers it, which sets the real name.
+		addBlock(blockId, uniqueName, uniqueName);
 	}
-	return -1;
-}
\ No newline at end of file
+
+	return true;
+}
@@ -0,0 +1,99 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace qz
+{
+	namespace gfx
+	{
+		/**
+		 * @brief The formats textures can be stored in, RGBA8 is
+		 * uncompressed.
+		 *
+		 * BC1 stores colour and 1 bit alpha in 8 bytes per 4x4 block, BC3
+		 * adds 8 bytes of interpolated alpha.
+		 */
+		enum class TextureFormat
+		{
+			RGBA8,
+			BC1,
+			BC3
+		};
+
+		/**
+		 * @brief Gets the size in bytes of an image in a format. Compressed
+		 * formats round up to whole 4x4 blocks.
+		 */
+		std::size_t getImageSize(TextureFormat format, std::size_t width,
+		                         std::size_t height);
+
+		/**
+		 * @brief Compresses one 4x4 block of RGBA8 texels.
+		 *
+		 * Endpoints start at the inset bounding box of the block, along the
+		 * diagonal that follows its colours, and are refined once with a
+		 * least squares fit. Uses SSE2 where available, with the same output
+		 * either way.
+		 *
+		 * For BC1, blocks with any alpha below 128 use the 3 colour mode,
+		 * in which those texels are transparent black.
+		 *
+		 * @param texels The 16 texels of the block, row by row.
+		 * @param format Either BC1 or BC3.
+		 * @param destination Receives 8 bytes for BC1, or 16 for BC3.
+		 */
+		void compressBlock(const std::uint8_t* texels, TextureFormat format,
+		                   std::uint8_t* destination);
+
+		/**
+		 * @brief Compresses rows of 4x4 blocks of an RGBA8 image.
+		 *
+		 * Blocks past the edge of the image repeat its last row and column.
+		 * Separate ranges of rows can be compressed in parallel.
+		 *
+		 * @param source The image to compress.
+		 * @param width The width of the image.
+		 * @param height The height of the image.
+		 * @param format Either BC1 or BC3.
+		 * @param firstBlockRow The first row of blocks to compress.
+		 * @param blockRowCount The number of rows of blocks to compress.
+		 * @param destination Receives the whole compressed image, of which
+		 * only the given rows are written.
+		 */
+		void compressBlockRows(const std::uint8_t* source, std::size_t width,
+		                       std::size_t height, TextureFormat format,
+		                       std::size_t firstBlockRow,
+		                       std::size_t blockRowCount,
+		                       std::uint8_t* destination);
+	} // namespace gfx
+} // namespace qz
@@ -0,0 +1,60 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace qz
+{
+	namespace gfx
+	{
+		/**
+		 * @brief Gets the number of levels in a full mip chain, down to 1x1.
+		 */
+		std::size_t getMipLevelCount(std::size_t width, std::size_t height);
+
+		/**
+		 * @brief Halves an 8 bit sRGB RGBA image with a 2x2 box filter.
+		 *
+		 * Colour is averaged in linear space, so dark and bright texels blend
+		 * the way they would on screen, alpha is averaged as it is. Uses
+		 * SSE2 where available.
+		 *
+		 * @param source The image to downsample.
+		 * @param width The width of the source image.
+		 * @param height The height of the source image.
+		 * @param destination Receives the image, which is max(1, width / 2)
+		 * by max(1, height / 2) texels.
+		 */
+		void downsampleSRGB(const std::uint8_t* source, std::size_t width,
+		                    std::size_t height, std::uint8_t* destination);
+	} // namespace gfx
+} // namespace qz
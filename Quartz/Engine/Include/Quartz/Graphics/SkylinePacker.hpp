@@ -0,0 +1,104 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace qz
+{
+	namespace gfx
+	{
+		/**
+		 * @brief Packs rectangles into a fixed size area, keeping track of
+		 * the top edge (the skyline) of everything placed so far.
+		 *
+		 * Each rectangle goes wherever its top edge ends up lowest, ties
+		 * going to the leftmost spot.
+		 */
+		class SkylinePacker
+		{
+		public:
+			SkylinePacker(std::size_t width, std::size_t height);
+
+			/**
+			 * @brief Finds room for a rectangle.
+			 * @return False if the rectangle does not fit anywhere.
+			 */
+			bool pack(std::size_t width, std::size_t height, std::size_t& x,
+			          std::size_t& y);
+
+			/// @brief Gets the height of the tallest part of the skyline.
+			std::size_t getUsedHeight() const;
+
+		private:
+			struct Segment
+			{
+				std::size_t x, y, width;
+			};
+
+			/**
+			 * @brief Finds how high a rectangle would sit if its left edge
+			 * were placed at a segment.
+			 * @return False if it would stick out of the area.
+			 */
+			bool fit(std::size_t segment, std::size_t width,
+			         std::size_t height, std::size_t& y) const;
+
+		private:
+			std::size_t          m_width, m_height;
+			std::vector<Segment> m_skyline;
+		};
+
+		struct PackedRect
+		{
+			std::size_t width, height;
+
+			/// @brief Filled in by packRects.
+			std::size_t x = 0, y = 0;
+		};
+
+		/**
+		 * @brief Packs rectangles into the smallest power of two area found,
+		 * keeping it close to square.
+		 *
+		 * Rectangles are placed tallest first, with ties broken by their
+		 * order, so the same input always gives the same layout.
+		 *
+		 * @param rects The rectangles to place.
+		 * @param maxSize The largest width or height allowed.
+		 * @param width Receives the width of the area.
+		 * @param height Receives the height of the area.
+		 * @return False if the rectangles do not fit in maxSize x maxSize.
+		 */
+		bool packRects(std::vector<PackedRect>& rects, std::size_t maxSize,
+		               std::size_t& width, std::size_t& height);
+	} // namespace gfx
+} // namespace qz
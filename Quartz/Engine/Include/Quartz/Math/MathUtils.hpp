@@ -74,5 +74,20 @@ namespace qz
 		{
 			return std::max(lower, std::min(n, upper));
 		}
+
+		/**
+		 * @brief Divides rounding towards negative infinity, so negative
+		 * world positions map onto the correct chunk or region.
+		 * @param value The number being divided.
+		 * @param divisor The number to divide by, must not be 0.
+		 * @return The largest integer not above value / divisor.
+		 */
+		inline int floorDivide(int value, int divisor)
+		{
+			const int quotient = value / divisor;
+			return (value % divisor != 0 && (value < 0) != (divisor < 0))
+			           ? quotient - 1
+			           : quotient;
+		}
 	}; // namespace math
 } // namespace qz
@@ -268,6 +268,16 @@ namespace qz
 			TemplateVector3() : x(T()), y(T()), z(T()) {}
 			TemplateVector3(T x) : x(x), y(x), z(x) {}
 			TemplateVector3(T x, T y, T z) : x(x), y(y), z(z) {}
+
+			bool operator==(const TemplateVector3& other) const
+			{
+				return x == other.x && y == other.y && z == other.z;
+			}
+
+			bool operator!=(const TemplateVector3& other) const
+			{
+				return !(*this == other);
+			}
 		};
 	} // namespace math
 } // namespace qz
@@ -0,0 +1,398 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <Quartz/Utilities/HandleAllocator.hpp>
+#include <Quartz/Utilities/Threading/ThreadPool.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace qz
+{
+	namespace utils
+	{
+		/**
+		 * @brief Loads assets of one type on a thread pool, sharing each one
+		 * between everything that asks for the same path.
+		 *
+		 * Loading hands out a handle straight away, holding a reference, and
+		 * reads the asset on the pool. Completed loads are picked up, and
+		 * their callbacks called, by update() on the thread that owns the
+		 * manager, so nothing but the loader itself runs on the pool.
+		 *
+		 * Assets nothing references stay cached until the memory they use
+		 * goes over the budget, then the least recently used are evicted.
+		 * Handles to evicted assets stop being valid.
+		 *
+		 * Everything other than the loader must be called from one thread.
+		 *
+		 * @code
+		 * AssetManager<std::string> scripts(
+		 *     &pool, [](const std::string& path) {
+		 *         return std::make_unique<std::string>(
+		 *             FileIO::readAllFile(path));
+		 *     },
+		 *     [](const std::string& script) { return script.size(); },
+		 *     16 * 1024 * 1024);
+		 * @endcode
+		 */
+		template <typename TAsset>
+		class AssetManager
+		{
+		public:
+			using Handle = GenerationalHandle<AssetManager<TAsset>>;
+
+			/**
+			 * @brief Reads an asset from a path, returning null on failure.
+			 * Runs on the pool, so it must be thread safe.
+			 */
+			using Loader =
+			    std::function<std::unique_ptr<TAsset>(const std::string&)>;
+
+			/// @brief Gets the memory an asset uses, in bytes.
+			using Sizer = std::function<std::size_t(const TAsset&)>;
+
+			/// @brief Told about a finished load, the asset is null if it
+			/// failed.
+			using Callback = std::function<void(Handle, const TAsset*)>;
+
+			enum class State
+			{
+				INVALID,
+				LOADING,
+				LOADED,
+				FAILED
+			};
+
+			/**
+			 * @param pool The pool to load on, or nullptr to load on the
+			 * calling thread. Callbacks wait for update() either way.
+			 * @param loader Reads assets.
+			 * @param sizer Measures loaded assets against the budget.
+			 * @param budget The memory unreferenced assets may keep using,
+			 * in bytes.
+			 */
+			AssetManager(threading::ThreadPool* pool, Loader loader,
+			             Sizer sizer, std::size_t budget)
+			    : m_pool(pool), m_shared(std::make_shared<Shared>()),
+			      m_sizer(std::move(sizer)), m_budget(budget), m_usage(0),
+			      m_time(0)
+			{
+				m_shared->loader = std::move(loader);
+			}
+
+			AssetManager(const AssetManager&) = delete;
+			AssetManager& operator=(const AssetManager&) = delete;
+
+			/**
+			 * @brief Gets the asset at a path, loading it if needed, and
+			 * takes a reference to it.
+			 * @param callback Called from update() once the asset is loaded,
+			 * even if it already was.
+			 * @return A handle to release once the asset is not needed.
+			 */
+			Handle load(const std::string& path, Callback callback = nullptr)
+			{
+				const auto found = m_paths.find(path);
+				if (found != m_paths.end())
+				{
+					Record& record = m_records[found->second.getIndex()];
+					++record.references;
+					record.lastUsed = m_time;
+
+					if (callback && record.state == State::LOADING)
+						record.callbacks.push_back(std::move(callback));
+					else if (callback)
+						m_ready.push_back({found->second, std::move(callback)});
+
+					return found->second;
+				}
+
+				const Handle handle = m_handles.allocate();
+				if (handle.isNull())
+					return handle;
+
+				const std::size_t index = handle.getIndex();
+				if (index >= m_records.size())
+					m_records.resize(index + 1);
+
+				Record& record    = m_records[index];
+				record.path       = path;
+				record.state      = State::LOADING;
+				record.references = 1;
+				record.lastUsed   = m_time;
+				record.size       = 0;
+
+				if (callback)
+					record.callbacks.push_back(std::move(callback));
+
+				m_paths.emplace(path, handle);
+
+				// The job shares the loader and the completion queue rather
+				// than the manager, so the manager never waits for it.
+				std::shared_ptr<Shared> shared = m_shared;
+				auto job = [shared, handle, path]() {
+					std::unique_ptr<TAsset> asset = shared->loader(path);
+
+					std::lock_guard<std::mutex> lock(shared->mutex);
+					shared->completed.push_back({handle, std::move(asset)});
+				};
+
+				if (m_pool != nullptr)
+					m_pool->addWork(std::move(job));
+				else
+					job();
+
+				return handle;
+			}
+
+			/// @brief Takes another reference to a loaded or loading asset.
+			void acquire(Handle handle)
+			{
+				if (m_handles.isValid(handle))
+					++m_records[handle.getIndex()].references;
+			}
+
+			/**
+			 * @brief Gives back a reference. Assets without references are
+			 * kept until they have to be evicted.
+			 */
+			void release(Handle handle)
+			{
+				if (!m_handles.isValid(handle))
+					return;
+
+				Record& record = m_records[handle.getIndex()];
+				if (record.references > 0)
+					--record.references;
+			}
+
+			/// @brief Gets an asset, or null until it has loaded.
+			const TAsset* get(Handle handle)
+			{
+				if (!m_handles.isValid(handle))
+					return nullptr;
+
+				Record& record  = m_records[handle.getIndex()];
+				record.lastUsed = m_time;
+
+				return record.asset.get();
+			}
+
+			State getState(Handle handle) const
+			{
+				if (!m_handles.isValid(handle))
+					return State::INVALID;
+
+				return m_records[handle.getIndex()].state;
+			}
+
+			/**
+			 * @brief Picks up finished loads, calls their callbacks and
+			 * evicts unreferenced assets while over budget. Call once a
+			 * frame.
+			 */
+			void update()
+			{
+				++m_time;
+
+				std::vector<Completed> completed;
+				{
+					std::lock_guard<std::mutex> lock(m_shared->mutex);
+					completed.swap(m_shared->completed);
+				}
+
+				for (Completed& load : completed)
+				{
+					Record& record = m_records[load.handle.getIndex()];
+
+					if (load.asset != nullptr)
+					{
+						record.state = State::LOADED;
+						record.size  = m_sizer(*load.asset);
+						record.asset = std::move(load.asset);
+						m_usage += record.size;
+					}
+					else
+					{
+						record.state = State::FAILED;
+					}
+
+					for (Callback& callback : record.callbacks)
+						m_ready.push_back({load.handle, std::move(callback)});
+
+					record.callbacks.clear();
+				}
+
+				// Callbacks may load or release assets, which can queue more
+				// callbacks for the next update.
+				std::vector<Pending> ready;
+				ready.swap(m_ready);
+
+				for (Pending& pending : ready)
+				{
+					if (m_handles.isValid(pending.handle))
+					{
+						pending.callback(
+						    pending.handle,
+						    m_records[pending.handle.getIndex()].asset.get());
+					}
+				}
+
+				evict();
+			}
+
+			/**
+			 * @brief Sets the memory unreferenced assets may keep using, which
+			 * takes effect at the next update.
+			 */
+			void setBudget(std::size_t budget) { m_budget = budget; }
+
+			std::size_t getBudget() const { return m_budget; }
+
+			/// @brief Gets the memory every loaded asset uses together.
+			std::size_t getMemoryUsage() const { return m_usage; }
+
+			/// @brief Gets the number of assets, loaded or not.
+			std::size_t getAssetCount() const { return m_handles.size(); }
+
+		private:
+			struct Record
+			{
+				std::string             path;
+				std::unique_ptr<TAsset> asset;
+				State                   state      = State::INVALID;
+				std::size_t             references = 0;
+				std::size_t             size       = 0;
+				std::uint64_t           lastUsed   = 0;
+				std::vector<Callback>   callbacks;
+			};
+
+			struct Completed
+			{
+				Handle                  handle;
+				std::unique_ptr<TAsset> asset;
+			};
+
+			struct Pending
+			{
+				Handle   handle;
+				Callback callback;
+			};
+
+			/// @brief The parts load jobs use, which outlive the manager.
+			struct Shared
+			{
+				Loader                 loader;
+				std::mutex             mutex;
+				std::vector<Completed> completed;
+			};
+
+			void evict()
+			{
+				// Failed assets are never worth keeping, unused ones only
+				// while there is room for them. Referenced assets don't
+				// count against the budget.
+				std::vector<std::size_t> unused;
+				std::size_t              unusedSize = 0;
+				for (std::size_t i = 0; i < m_records.size(); ++i)
+				{
+					const Record& record = m_records[i];
+					if (record.references > 0 ||
+					    record.state == State::LOADING ||
+					    record.state == State::INVALID)
+					{
+						continue;
+					}
+
+					if (record.state == State::FAILED)
+					{
+						erase(i);
+					}
+					else
+					{
+						unused.push_back(i);
+						unusedSize += record.size;
+					}
+				}
+
+				if (unusedSize <= m_budget)
+					return;
+
+				std::sort(unused.begin(), unused.end(),
+				          [this](std::size_t a, std::size_t b) {
+					          return m_records[a].lastUsed <
+					                 m_records[b].lastUsed;
+				          });
+
+				for (std::size_t i = 0;
+				     i < unused.size() && unusedSize > m_budget; ++i)
+				{
+					unusedSize -= m_records[unused[i]].size;
+					erase(unused[i]);
+				}
+			}
+
+			void erase(std::size_t index)
+			{
+				Record& record = m_records[index];
+
+				const auto found = m_paths.find(record.path);
+				m_handles.free(found->second);
+				m_paths.erase(found);
+
+				m_usage -= record.size;
+				record = Record();
+			}
+
+		private:
+			threading::ThreadPool*  m_pool;
+			std::shared_ptr<Shared> m_shared;
+			Sizer                   m_sizer;
+
+			GenerationalHandleAllocator<Handle>     m_handles;
+			std::vector<Record>                     m_records;
+			std::unordered_map<std::string, Handle> m_paths;
+			std::vector<Pending>                    m_ready;
+
+			std::size_t   m_budget;
+			std::size_t   m_usage;
+			std::uint64_t m_time;
+		};
+	} // namespace utils
+} // namespace qz
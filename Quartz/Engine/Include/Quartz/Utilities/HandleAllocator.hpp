@@ -31,6 +31,9 @@
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <vector>
 
 namespace qz
 {
@@ -90,5 +93,222 @@ namespace qz
 			THandleType   m_handles[TMaxNumHandles];
 			std::uint16_t m_size;
 		};
+
+		/**
+		 * @brief A handle made of a slot index and the generation of that
+		 * slot when the handle was allocated.
+		 *
+		 * The tag only keeps handles to different things from being mixed
+		 * up. 32 bit handles default to 20 index bits, about a million live
+		 * handles, and 12 generation bits. 64 bit handles split evenly. The
+		 * zero handle is never allocated, so a default constructed handle
+		 * is always null.
+		 */
+		template <typename TTag, typename TStorage = std::uint32_t,
+		          unsigned TIndexBits = sizeof(TStorage) == 4 ? 20 : 32>
+		class GenerationalHandle
+		{
+			static_assert(std::is_unsigned<TStorage>::value,
+			              "Handles must be stored in an unsigned integer");
+
+		public:
+			using Storage = TStorage;
+
+			static constexpr unsigned STORAGE_BITS =
+			    std::numeric_limits<TStorage>::digits;
+			static constexpr unsigned INDEX_BITS = TIndexBits;
+			static constexpr unsigned GENERATION_BITS =
+			    STORAGE_BITS - INDEX_BITS;
+
+			static_assert(INDEX_BITS > 2 && INDEX_BITS < STORAGE_BITS,
+			              "Handles need both index and generation bits");
+
+			static constexpr TStorage INDEX_MASK =
+			    (TStorage(1) << INDEX_BITS) - 1;
+			static constexpr TStorage GENERATION_MASK =
+			    (TStorage(1) << GENERATION_BITS) - 1;
+
+			constexpr GenerationalHandle() : m_value(0) {}
+
+			constexpr GenerationalHandle(TStorage index, TStorage generation)
+			    : m_value(static_cast<TStorage>((generation << INDEX_BITS) |
+			                                    (index & INDEX_MASK)))
+			{
+			}
+
+			TStorage getIndex() const { return m_value & INDEX_MASK; }
+			TStorage getGeneration() const { return m_value >> INDEX_BITS; }
+
+			/// @brief Gets the index and generation packed together.
+			TStorage getValue() const { return m_value; }
+
+			bool isNull() const { return m_value == 0; }
+			explicit operator bool() const { return m_value != 0; }
+
+			bool operator==(const GenerationalHandle& other) const
+			{
+				return m_value == other.m_value;
+			}
+
+			bool operator!=(const GenerationalHandle& other) const
+			{
+				return m_value != other.m_value;
+			}
+
+		private:
+			TStorage m_value;
+		};
+
+		/**
+		 * @brief Allocates generational handles, reusing freed slots through
+		 * a free list.
+		 *
+		 * Allocating, freeing and checking a handle are all O(1). Freeing a
+		 * handle moves its slot to the next generation, so stale copies of
+		 * the handle stop being valid instead of aliasing whatever reuses
+		 * the slot. A slot whose generation would wrap is retired rather than
+		 * reused, so stale handles are never mistaken for live ones. With 64
+		 * bit handles that never happens in practice.
+		 *
+		 * Not thread safe.
+		 */
+		template <typename THandle>
+		class GenerationalHandleAllocator
+		{
+		public:
+			using Handle  = THandle;
+			using Storage = typename THandle::Storage;
+
+			/// @brief The most slots there can be, live or free. The largest
+			/// indices are kept back to mark slots.
+			static constexpr std::size_t MAX_HANDLES =
+			    static_cast<std::size_t>(THandle::INDEX_MASK) - 2;
+
+			GenerationalHandleAllocator()
+			    : m_freeHead(END), m_freeTail(END), m_size(0)
+			{
+			}
+
+			/**
+			 * @brief Allocates a handle, or returns a null handle if every
+			 * slot is in use.
+			 */
+			THandle allocate()
+			{
+				Storage index = m_freeHead;
+
+				if (index != END)
+				{
+					m_freeHead = m_slots[index].next;
+					if (m_freeHead == END)
+						m_freeTail = END;
+				}
+				else
+				{
+					if (m_slots.size() >= MAX_HANDLES)
+						return THandle();
+
+					index = static_cast<Storage>(m_slots.size());
+					m_slots.push_back({1, LIVE});
+				}
+
+				m_slots[index].next = LIVE;
+				++m_size;
+
+				return THandle(index, m_slots[index].generation);
+			}
+
+			bool isValid(THandle handle) const
+			{
+				const Storage index = handle.getIndex();
+
+				return !handle.isNull() && index < m_slots.size() &&
+				       m_slots[index].generation == handle.getGeneration() &&
+				       m_slots[index].next == LIVE;
+			}
+
+			/**
+			 * @brief Frees a handle, stale and null handles are ignored.
+			 * @return Whether the handle was live.
+			 */
+			bool free(THandle handle)
+			{
+				if (!isValid(handle))
+					return false;
+
+				release(handle.getIndex());
+				--m_size;
+
+				return true;
+			}
+
+			/// @brief Frees every live handle.
+			void reset()
+			{
+				for (std::size_t i = 0; i < m_slots.size(); ++i)
+				{
+					if (m_slots[i].next == LIVE)
+						release(static_cast<Storage>(i));
+				}
+
+				m_size = 0;
+			}
+
+			/// @brief Gets the number of live handles.
+			std::size_t size() const { return m_size; }
+
+			/**
+			 * @brief Gets the number of slots, which is one more than the
+			 * largest index handed out so far.
+			 */
+			std::size_t capacity() const { return m_slots.size(); }
+
+		private:
+			/// @brief Ends the free list.
+			static constexpr Storage END = THandle::INDEX_MASK;
+
+			/// @brief Marks a slot that is handed out.
+			static constexpr Storage LIVE = END - 1;
+
+			/// @brief Marks a slot that is neither live nor free.
+			static constexpr Storage RETIRED = END - 2;
+
+			struct Slot
+			{
+				Storage generation;
+
+				/// @brief The next free slot, END, LIVE or RETIRED.
+				Storage next;
+			};
+
+			void release(Storage index)
+			{
+				Slot& slot = m_slots[index];
+
+				if (slot.generation == THandle::GENERATION_MASK)
+				{
+					slot.next = RETIRED;
+					return;
+				}
+
+				++slot.generation;
+
+				// Appended, so a slot is reused as late as possible.
+				slot.next = END;
+				if (m_freeTail == END)
+					m_freeHead = index;
+				else
+					m_slots[m_freeTail].next = index;
+
+				m_freeTail = index;
+			}
+
+		private:
+			std::vector<Slot> m_slots;
+
+			Storage     m_freeHead;
+			Storage     m_freeTail;
+			std::size_t m_size;
+		};
 	} // namespace utils
 } // namespace qz
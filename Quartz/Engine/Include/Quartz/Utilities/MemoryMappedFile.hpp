@@ -0,0 +1,77 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <Quartz/Core.hpp>
+
+#include <cstddef>
+#include <string>
+
+namespace qz
+{
+	namespace utils
+	{
+		/**
+		 * @brief Maps a whole file into memory, read only.
+		 */
+		class MemoryMappedFile
+		{
+		public:
+			MemoryMappedFile();
+			~MemoryMappedFile();
+
+			MemoryMappedFile(const MemoryMappedFile&) = delete;
+			MemoryMappedFile& operator=(const MemoryMappedFile&) = delete;
+
+			MemoryMappedFile(MemoryMappedFile&& other) noexcept;
+			MemoryMappedFile& operator=(MemoryMappedFile&& other) noexcept;
+
+			/**
+			 * @brief Maps a file, unmapping any file mapped before.
+			 * @return False if the file could not be opened or is empty.
+			 */
+			bool open(const std::string& filepath);
+			void close();
+
+			bool                 isOpen() const { return m_data != nullptr; }
+			const unsigned char* getData() const { return m_data; }
+			std::size_t          getSize() const { return m_size; }
+
+		private:
+			const unsigned char* m_data;
+			std::size_t          m_size;
+
+#if defined(QZ_PLATFORM_WINDOWS)
+			void* m_file;
+			void* m_mapping;
+#endif
+		};
+	} // namespace utils
+} // namespace qz
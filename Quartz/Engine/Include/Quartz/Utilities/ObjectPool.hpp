@@ -0,0 +1,152 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace qz
+{
+	namespace utils
+	{
+		/**
+		 * @brief Allocates objects of one type from slabs, reusing the slots
+		 * of destroyed objects.
+		 *
+		 * Slots never move, so pointers stay valid until the object is
+		 * destroyed. The pool does not track live objects, its owner must
+		 * destroy them before the pool goes away. Not thread safe.
+		 *
+		 * @tparam T The type of object to allocate.
+		 * @tparam TSlabSize The number of objects allocated at once.
+		 */
+		template <typename T, std::size_t TSlabSize = 64>
+		class ObjectPool
+		{
+		public:
+			ObjectPool() : m_freeList(nullptr) {}
+
+			ObjectPool(const ObjectPool&) = delete;
+			ObjectPool& operator=(const ObjectPool&) = delete;
+
+			ObjectPool(ObjectPool&& other) noexcept
+			    : m_slabs(std::move(other.m_slabs)),
+			      m_freeList(other.m_freeList)
+			{
+				other.m_slabs.clear();
+				other.m_freeList = nullptr;
+			}
+
+			ObjectPool& operator=(ObjectPool&& other) noexcept
+			{
+				m_slabs          = std::move(other.m_slabs);
+				m_freeList       = other.m_freeList;
+				other.m_freeList = nullptr;
+				other.m_slabs.clear();
+
+				return *this;
+			}
+
+			template <typename... Args>
+			T* create(Args&&... args)
+			{
+				Slot* slot = acquire();
+
+				try
+				{
+					return new (slot->storage) T(std::forward<Args>(args)...);
+				}
+				catch (...)
+				{
+					release(slot);
+					throw;
+				}
+			}
+
+			void destroy(T* object)
+			{
+				assert(object != nullptr);
+
+				object->~T();
+				release(reinterpret_cast<Slot*>(object));
+			}
+
+			/// @brief Gets the number of slots allocated, used or not.
+			std::size_t getCapacity() const
+			{
+				return m_slabs.size() * TSlabSize;
+			}
+
+		private:
+			union Slot
+			{
+				Slot* next;
+				alignas(T) unsigned char storage[sizeof(T)];
+			};
+
+			Slot* acquire()
+			{
+				if (m_freeList == nullptr)
+				{
+					m_slabs.emplace_back(new Slot[TSlabSize]);
+
+					// Thread the new slots onto the free list, first slot
+					// first so objects are handed out in address order.
+					Slot* slab = m_slabs.back().get();
+					for (std::size_t i = 0; i + 1 < TSlabSize; ++i)
+						slab[i].next = &slab[i + 1];
+
+					slab[TSlabSize - 1].next = nullptr;
+
+					m_freeList = slab;
+				}
+
+				Slot* slot = m_freeList;
+				m_freeList = slot->next;
+
+				return slot;
+			}
+
+			void release(Slot* slot)
+			{
+				slot->next = m_freeList;
+				m_freeList = slot;
+			}
+
+		private:
+			std::vector<std::unique_ptr<Slot[]>> m_slabs;
+			Slot*                                m_freeList;
+		};
+	} // namespace utils
+} // namespace qz
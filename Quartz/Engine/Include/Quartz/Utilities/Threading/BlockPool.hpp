@@ -0,0 +1,239 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace qz
+{
+	namespace utils
+	{
+		namespace threading
+		{
+			/**
+			 * @brief Hands out fixed size blocks from slabs that are never
+			 * returned to the system, one pool per block size and alignment.
+			 *
+			 * Every thread keeps a small cache of free blocks and trades
+			 * batches of them with a shared list, so code that keeps roughly
+			 * the same number of blocks in use stops allocating after warming
+			 * up. Blocks may be freed on another thread than the one that
+			 * took them.
+			 */
+			template <std::size_t BlockSize, std::size_t BlockAlignment>
+			class BlockPool
+			{
+			public:
+				/// @brief Blocks allocated at once when every list is empty.
+				static constexpr std::size_t SLAB_BLOCKS = 256;
+
+				/// @brief Blocks moved between a cache and the shared list.
+				static constexpr std::size_t BATCH_BLOCKS = 128;
+
+				/// @brief Free blocks a thread keeps before handing some back.
+				static constexpr std::size_t CACHE_LIMIT = 2 * BATCH_BLOCKS;
+
+			public:
+				/// @brief Returns an uninitialised block.
+				static void* allocate()
+				{
+					Cache& cache = t_cache;
+
+					if (cache.free == nullptr)
+						cache.count = getShared().refill(cache.free);
+
+					Block* block = cache.free;
+					cache.free   = block->next;
+					--cache.count;
+
+					return block->storage;
+				}
+
+				/**
+				 * @brief Gives the calling thread's cache a fresh slab.
+				 *
+				 * Pages usually end up on the NUMA node of the thread that
+				 * first writes to them, so a thread pinned near its work can
+				 * call this to have its blocks in local memory.
+				 */
+				static void reserveLocal()
+				{
+					Cache& cache = t_cache;
+
+					Block* slab = getShared().allocateSlab();
+					slab[SLAB_BLOCKS - 1].next = cache.free;
+
+					cache.free = slab;
+					cache.count += SLAB_BLOCKS;
+				}
+
+				static void deallocate(void* memory)
+				{
+					Cache& cache = t_cache;
+
+					Block* block = static_cast<Block*>(memory);
+					block->next  = cache.free;
+					cache.free   = block;
+					++cache.count;
+
+					if (cache.count > CACHE_LIMIT)
+					{
+						Block* batch = nullptr;
+						Block* last  = nullptr;
+
+						cache.count -= takeBatch(cache.free, batch, last);
+						getShared().give(batch, last, BATCH_BLOCKS);
+					}
+				}
+
+			private:
+				union Block
+				{
+					Block* next;
+					alignas(BlockAlignment) unsigned char storage[BlockSize];
+				};
+
+				/**
+				 * @brief Unlinks up to a batch of blocks from the front of a
+				 * list.
+				 * @param last Receives the last block of the batch.
+				 * @return The number of blocks taken.
+				 */
+				static std::size_t takeBatch(Block*& list, Block*& batch,
+				                             Block*& last)
+				{
+					batch = list;
+					last  = nullptr;
+
+					std::size_t count = 0;
+					while (list != nullptr && count < BATCH_BLOCKS)
+					{
+						last = list;
+						list = list->next;
+						++count;
+					}
+
+					if (last != nullptr)
+						last->next = nullptr;
+
+					return count;
+				}
+
+				struct Shared
+				{
+					std::mutex  mutex;
+					Block*      free  = nullptr;
+					std::size_t count = 0;
+
+					std::vector<std::unique_ptr<Block[]>> slabs;
+
+					/// @brief Refills an empty cache with a batch, allocating
+					/// a slab if nothing is free.
+					std::size_t refill(Block*& cache)
+					{
+						std::unique_lock<std::mutex> lock(mutex);
+
+						if (free == nullptr)
+						{
+							lock.unlock();
+
+							cache = allocateSlab();
+							return SLAB_BLOCKS;
+						}
+
+						Block*            last  = nullptr;
+						const std::size_t taken = takeBatch(free, cache, last);
+						count -= taken;
+
+						return taken;
+					}
+
+					/// @brief Returns a new slab, linked into a list, whose
+					/// memory the calling thread has touched first.
+					Block* allocateSlab()
+					{
+						auto memory = std::make_unique<Block[]>(SLAB_BLOCKS);
+
+						Block* slab = memory.get();
+						for (std::size_t i = 0; i + 1 < SLAB_BLOCKS; ++i)
+							slab[i].next = &slab[i + 1];
+
+						slab[SLAB_BLOCKS - 1].next = nullptr;
+
+						std::lock_guard<std::mutex> lock(mutex);
+						slabs.push_back(std::move(memory));
+
+						return slab;
+					}
+
+					void give(Block* first, Block* last, std::size_t blocks)
+					{
+						std::lock_guard<std::mutex> lock(mutex);
+
+						last->next = free;
+						free       = first;
+						count += blocks;
+					}
+				};
+
+				/// @brief Never destroyed, threads may still free blocks
+				/// while static objects are torn down.
+				static Shared& getShared()
+				{
+					static Shared* shared = new Shared();
+					return *shared;
+				}
+
+				struct Cache
+				{
+					Block*      free  = nullptr;
+					std::size_t count = 0;
+
+					~Cache()
+					{
+						if (free == nullptr)
+							return;
+
+						Block* last = free;
+						while (last->next != nullptr)
+							last = last->next;
+
+						getShared().give(free, last, count);
+					}
+				};
+
+				static inline thread_local Cache t_cache;
+			};
+		} // namespace threading
+	}     // namespace utils
+} // namespace qz
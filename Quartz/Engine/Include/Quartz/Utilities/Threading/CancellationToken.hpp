@@ -0,0 +1,106 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+namespace qz
+{
+	namespace utils
+	{
+		namespace threading
+		{
+			/**
+			 * @brief Lets work check whether it has been cancelled.
+			 *
+			 * Tokens are cheap to copy and share the flag of the
+			 * CancellationSource they came from. A default constructed token
+			 * is never cancelled.
+			 */
+			class CancellationToken
+			{
+			public:
+				CancellationToken() = default;
+
+				bool isCancelled() const
+				{
+					return m_flag != nullptr &&
+					       m_flag->load(std::memory_order_acquire);
+				}
+
+				bool canBeCancelled() const { return m_flag != nullptr; }
+
+			private:
+				explicit CancellationToken(
+				    std::shared_ptr<const std::atomic<bool>> flag)
+				    : m_flag(std::move(flag))
+				{
+				}
+
+				friend class CancellationSource;
+
+			private:
+				std::shared_ptr<const std::atomic<bool>> m_flag;
+			};
+
+			/**
+			 * @brief Hands out tokens and cancels all of them at once.
+			 * Cancelling can't be undone.
+			 */
+			class CancellationSource
+			{
+			public:
+				CancellationSource()
+				    : m_flag(std::make_shared<std::atomic<bool>>(false))
+				{
+				}
+
+				void cancel()
+				{
+					m_flag->store(true, std::memory_order_release);
+				}
+
+				bool isCancelled() const
+				{
+					return m_flag->load(std::memory_order_acquire);
+				}
+
+				CancellationToken getToken() const
+				{
+					return CancellationToken(m_flag);
+				}
+
+			private:
+				std::shared_ptr<std::atomic<bool>> m_flag;
+			};
+		} // namespace threading
+	}     // namespace utils
+} // namespace qz
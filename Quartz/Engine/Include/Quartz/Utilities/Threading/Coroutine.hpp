@@ -0,0 +1,454 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <Quartz/Utilities/FileIO.hpp>
+#include <Quartz/Utilities/Threading/Future.hpp>
+#include <Quartz/Utilities/Threading/Task.hpp>
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#	if __has_include(<coroutine>)
+/// @brief Async coroutines are available, which needs C++20.
+#		define QZ_COROUTINES_SUPPORTED
+#	endif
+#endif
+
+#if defined(QZ_COROUTINES_SUPPORTED)
+#	include <coroutine>
+#	include <exception>
+#	include <memory>
+#	include <optional>
+#	include <string>
+#	include <type_traits>
+#	include <utility>
+
+namespace qz
+{
+	namespace utils
+	{
+		namespace threading
+		{
+			namespace detail
+			{
+				/**
+				 * @brief Resumes whoever awaited a finished Async directly,
+				 * without growing the stack.
+				 */
+				struct AsyncFinalAwaiter
+				{
+					bool await_ready() const noexcept { return false; }
+
+					template <typename Promise>
+					std::coroutine_handle<> await_suspend(
+					    std::coroutine_handle<Promise> handle) const noexcept
+					{
+						std::coroutine_handle<> continuation =
+						    handle.promise().m_continuation;
+
+						if (continuation)
+							return continuation;
+
+						return std::noop_coroutine();
+					}
+
+					void await_resume() const noexcept {}
+				};
+
+				class AsyncPromiseBase
+				{
+				public:
+					std::suspend_always initial_suspend() const noexcept
+					{
+						return {};
+					}
+
+					AsyncFinalAwaiter final_suspend() const noexcept
+					{
+						return {};
+					}
+
+					void unhandled_exception()
+					{
+						m_exception = std::current_exception();
+					}
+
+				protected:
+					void rethrow() const
+					{
+						if (m_exception)
+							std::rethrow_exception(m_exception);
+					}
+
+				private:
+					friend struct AsyncFinalAwaiter;
+
+					template <typename T>
+					friend class threading::Async;
+
+				private:
+					std::coroutine_handle<> m_continuation;
+					std::exception_ptr      m_exception;
+				};
+
+				template <typename T>
+				class AsyncPromise : public AsyncPromiseBase
+				{
+				public:
+					Async<T> get_return_object();
+
+					template <typename Value>
+					void return_value(Value&& value)
+					{
+						m_value.emplace(std::forward<Value>(value));
+					}
+
+					T takeResult()
+					{
+						rethrow();
+						return std::move(*m_value);
+					}
+
+				private:
+					std::optional<T> m_value;
+				};
+
+				template <>
+				class AsyncPromise<void> : public AsyncPromiseBase
+				{
+				public:
+					Async<void> get_return_object();
+
+					void return_void() const {}
+
+					void takeResult() const { rethrow(); }
+				};
+
+				/**
+				 * @brief Switches to an executor, unless already on one of
+				 * its threads.
+				 */
+				template <typename Executor>
+				class ResumeOn
+				{
+				public:
+					explicit ResumeOn(Executor& executor) : m_executor(executor)
+					{
+					}
+
+					bool await_ready() const
+					{
+						return m_executor.isWorkerThread();
+					}
+
+					void await_suspend(std::coroutine_handle<> handle) const
+					{
+						m_executor.addWork([handle]() { handle.resume(); });
+					}
+
+					void await_resume() const {}
+
+				private:
+					Executor& m_executor;
+				};
+
+				template <typename T>
+				class FutureAwaiter
+				{
+				public:
+					explicit FutureAwaiter(Future<T> future)
+					    : m_future(std::move(future))
+					{
+					}
+
+					bool await_ready() const { return m_future.isReady(); }
+
+					void await_suspend(std::coroutine_handle<> handle) const
+					{
+						m_future.onReady([handle]() { handle.resume(); });
+					}
+
+					decltype(auto) await_resume() const
+					{
+						return m_future.get();
+					}
+
+				private:
+					Future<T> m_future;
+				};
+
+				/// @brief A coroutine that starts at once and frees itself.
+				struct Detached
+				{
+					struct promise_type
+					{
+						Detached get_return_object() const { return {}; }
+
+						std::suspend_never initial_suspend() const noexcept
+						{
+							return {};
+						}
+
+						std::suspend_never final_suspend() const noexcept
+						{
+							return {};
+						}
+
+						void return_void() const {}
+
+						void unhandled_exception() const { std::terminate(); }
+					};
+				};
+
+				template <typename T>
+				Detached runDetached(Async<T>                       async,
+				                     std::shared_ptr<FutureState<T>> state);
+			} // namespace detail
+
+			/**
+			 * @brief A coroutine returning a T, which starts once awaited.
+			 *
+			 * Async coroutines run on whichever thread resumes them and hop
+			 * between executors explicitly through resumeOn(), so a flow
+			 * like load, process, integrate reads as straight line code:
+			 *
+			 *     Async<void> loadTexture(SingleWorker& io, ThreadPool& pool,
+			 *                             MainThreadExecutor& main)
+			 *     {
+			 *         std::string data = co_await readFile(io, path);
+			 *         co_await resumeOn(pool);
+			 *         Image image = decode(data);
+			 *         co_await resumeOn(main);
+			 *         upload(image);
+			 *     }
+			 *
+			 * Awaiting an Async runs it on the awaiting thread, and the
+			 * awaiting coroutine carries on wherever it finishes, so nothing
+			 * changes thread unless asked to. Exceptions propagate to the
+			 * awaiter. spawn() starts one from ordinary code.
+			 *
+			 * An executor is any type with addWork(Task) and
+			 * isWorkerThread(), such as ThreadPool, SingleWorker and
+			 * MainThreadExecutor.
+			 */
+			template <typename T = void>
+			class Async
+			{
+			public:
+				using promise_type = detail::AsyncPromise<T>;
+				using Handle       = std::coroutine_handle<promise_type>;
+
+			public:
+				Async() = default;
+
+				Async(Async&& other) noexcept
+				    : m_handle(std::exchange(other.m_handle, nullptr))
+				{
+				}
+
+				Async& operator=(Async&& other) noexcept
+				{
+					if (this != &other)
+					{
+						if (m_handle)
+							m_handle.destroy();
+
+						m_handle = std::exchange(other.m_handle, nullptr);
+					}
+
+					return *this;
+				}
+
+				~Async()
+				{
+					if (m_handle)
+						m_handle.destroy();
+				}
+
+				bool isValid() const { return static_cast<bool>(m_handle); }
+
+				auto operator co_await() noexcept
+				{
+					struct Awaiter
+					{
+						Handle handle;
+
+						bool await_ready() const noexcept
+						{
+							return handle.done();
+						}
+
+						std::coroutine_handle<> await_suspend(
+						    std::coroutine_handle<> continuation) const noexcept
+						{
+							handle.promise().m_continuation = continuation;
+							return handle;
+						}
+
+						T await_resume() const
+						{
+							return handle.promise().takeResult();
+						}
+					};
+
+					return Awaiter {m_handle};
+				}
+
+			private:
+				explicit Async(Handle handle) : m_handle(handle) {}
+
+				friend class detail::AsyncPromise<T>;
+
+			private:
+				Handle m_handle;
+			};
+
+			/**
+			 * @brief Awaits a switch to one of the executor's threads, and
+			 * completes straight away if already on one.
+			 */
+			template <typename Executor>
+			detail::ResumeOn<Executor> resumeOn(Executor& executor)
+			{
+				return detail::ResumeOn<Executor>(executor);
+			}
+
+			/**
+			 * @brief Makes futures awaitable. The awaiter carries on where
+			 * the future's continuations run, on its pool.
+			 */
+			template <typename T>
+			detail::FutureAwaiter<T> operator co_await(Future<T> future)
+			{
+				return detail::FutureAwaiter<T>(std::move(future));
+			}
+
+			/**
+			 * @brief Starts an Async on the calling thread and hands its
+			 * result to a future. The future has no pool, so waiting on it
+			 * blocks and its continuations run where the Async finishes.
+			 */
+			template <typename T>
+			Future<T> spawn(Async<T> async)
+			{
+				auto state = std::make_shared<detail::FutureState<T>>(nullptr);
+				detail::runDetached(std::move(async), state);
+
+				return Future<T>(std::move(state));
+			}
+
+			/**
+			 * @brief Calls the function on the executor, finishing there.
+			 */
+			template <typename Executor, typename Function>
+			Async<std::invoke_result_t<Function&>> runOn(Executor& executor,
+			                                             Function  function)
+			{
+				co_await resumeOn(executor);
+				co_return function();
+			}
+
+			/**
+			 * @brief Reads a whole file on the executor, typically a
+			 * SingleWorker set aside for IO, finishing there.
+			 */
+			template <typename Executor>
+			Async<std::string> readFile(Executor& executor, std::string path)
+			{
+				co_await resumeOn(executor);
+				co_return FileIO::readAllFile(path);
+			}
+
+			template <typename T>
+			Async<T> detail::AsyncPromise<T>::get_return_object()
+			{
+				return Async<T>(
+				    std::coroutine_handle<AsyncPromise<T>>::from_promise(
+				        *this));
+			}
+
+			inline Async<void> detail::AsyncPromise<void>::get_return_object()
+			{
+				return Async<void>(
+				    std::coroutine_handle<AsyncPromise<void>>::from_promise(
+				        *this));
+			}
+
+			template <typename T>
+			detail::Detached detail::runDetached(
+			    Async<T> async, std::shared_ptr<FutureState<T>> state)
+			{
+				std::exception_ptr exception;
+
+				if constexpr (std::is_void_v<T>)
+				{
+					try
+					{
+						co_await std::move(async);
+					}
+					catch (...)
+					{
+						exception = std::current_exception();
+					}
+
+					auto nothing = []() {};
+
+					if (exception)
+						state->finish(std::move(exception));
+					else
+						state->run(nothing);
+				}
+				else
+				{
+					std::optional<T> value;
+
+					try
+					{
+						value.emplace(co_await std::move(async));
+					}
+					catch (...)
+					{
+						exception = std::current_exception();
+					}
+
+					if (exception)
+					{
+						state->finish(std::move(exception));
+					}
+					else
+					{
+						auto take = [&value]() { return std::move(*value); };
+						state->run(take);
+					}
+				}
+			}
+		} // namespace threading
+	}     // namespace utils
+} // namespace qz
+#endif
@@ -0,0 +1,105 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace qz
+{
+	namespace utils
+	{
+		namespace threading
+		{
+			/// @brief A CPU as the operating system schedules threads on it.
+			struct LogicalCpu
+			{
+				/// @brief The number the OS knows the CPU by, for pinning.
+				unsigned int index;
+
+				/// @brief The physical core, unique across packages.
+				unsigned int core;
+
+				unsigned int package;
+
+				/// @brief The NUMA node whose memory is closest.
+				unsigned int node;
+			};
+
+			/**
+			 * @brief The logical CPUs of the machine and how they group
+			 * into physical cores, packages and NUMA nodes.
+			 *
+			 * Probed from /sys/devices/system/cpu on Linux. Elsewhere, or
+			 * if that can't be read, every logical CPU is taken to be its
+			 * own core on a single package and node.
+			 */
+			class CpuTopology
+			{
+			public:
+				static CpuTopology probe();
+
+				/// @brief Online CPUs, by index.
+				const std::vector<LogicalCpu>& getCpus() const
+				{
+					return m_cpus;
+				}
+
+				std::size_t getCoreCount() const { return m_coreCount; }
+				std::size_t getPackageCount() const { return m_packageCount; }
+				std::size_t getNodeCount() const { return m_nodeCount; }
+
+				/**
+				 * @brief The first logical CPU of every physical core, so
+				 * threads pinned to them don't share a core's execution
+				 * units.
+				 * @param leaveFirstCore Skips the core of the lowest CPU,
+				 * where the main or tick thread usually runs, unless it is
+				 * the only one.
+				 */
+				std::vector<LogicalCpu> getOnePerCore(
+				    bool leaveFirstCore = false) const;
+
+			private:
+				CpuTopology() = default;
+
+				/// @brief Numbers cores densely and counts every level.
+				void finish();
+
+			private:
+				std::vector<LogicalCpu> m_cpus;
+
+				std::size_t m_coreCount    = 0;
+				std::size_t m_packageCount = 0;
+				std::size_t m_nodeCount    = 0;
+			};
+		} // namespace threading
+	}     // namespace utils
+} // namespace qz
@@ -0,0 +1,183 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <Quartz/Core.hpp>
+#include <Quartz/Utilities/Threading/BlockPool.hpp>
+#include <Quartz/Utilities/Threading/Task.hpp>
+#include <Quartz/Utilities/Threading/ThreadPool.hpp>
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include <cstddef>
+
+#if defined(QZ_PLATFORM_LINUX) && defined(__x86_64__) && \
+    !defined(QZ_NO_FIBERS)
+/// @brief Jobs run on fibers, rather than blocking their thread to wait.
+#	define QZ_FIBERS_SUPPORTED
+#endif
+
+namespace qz
+{
+	namespace utils
+	{
+		namespace threading
+		{
+			namespace detail
+			{
+				struct Fiber;
+			}
+
+			/**
+			 * @brief Counts unfinished jobs of a FiberJobSystem, so that
+			 * other jobs can wait for them.
+			 */
+			class JobCounter
+			{
+			public:
+				JobCounter() = default;
+
+				JobCounter(const JobCounter&) = delete;
+				JobCounter& operator=(const JobCounter&) = delete;
+
+				/**
+				 * @brief For polling only, the counter may still be in use
+				 * when this turns true. Wait before destroying it.
+				 */
+				bool isDone() const
+				{
+					return m_value.load(std::memory_order_acquire) == 0;
+				}
+
+			private:
+				friend class FiberJobSystem;
+
+				std::atomic<std::size_t> m_value {0};
+
+				/// @brief Guards the waiters and every decrement.
+				std::mutex     m_mutex;
+				detail::Fiber* m_waiters = nullptr;
+			};
+
+			/**
+			 * @brief Runs jobs on fibers on top of a ThreadPool, so that a
+			 * job waiting for others gives its thread back in the meantime.
+			 *
+			 * Every job runs on a fiber, a small stack of its own. A job that
+			 * waits on a JobCounter switches back to the thread that ran it,
+			 * and is queued on the pool again once the counter reaches zero,
+			 * possibly to carry on on another thread. Deep chains of jobs
+			 * waiting on sub-jobs then take no more threads than the work
+			 * actually running. Fibers are reused, and only created when
+			 * every existing one is busy or waiting.
+			 *
+			 * Context switching is hand written for x86-64 Linux. Elsewhere,
+			 * or with QZ_NO_FIBERS defined, jobs run directly on the pool and
+			 * waiting runs other queued work until the counter is done.
+			 *
+			 * Jobs must not throw, and must not rely on thread local state
+			 * across a wait. Their stack is limited to the size given here.
+			 */
+			class FiberJobSystem
+			{
+			public:
+				static constexpr std::size_t DEFAULT_STACK_SIZE = 64 * 1024;
+
+			public:
+				explicit FiberJobSystem(
+				    ThreadPool& pool,
+				    std::size_t stackSize = DEFAULT_STACK_SIZE);
+
+				/// @brief Waits for every job to finish.
+				~FiberJobSystem();
+
+				FiberJobSystem(const FiberJobSystem&) = delete;
+				FiberJobSystem& operator=(const FiberJobSystem&) = delete;
+
+				/**
+				 * @brief Queues a job.
+				 * @param counter Optionally raised now and lowered once the
+				 * job has finished.
+				 */
+				void run(Task job, JobCounter* counter = nullptr);
+
+				/**
+				 * @brief Waits for the counter to reach zero. A job suspends
+				 * its fiber, other threads run queued work meanwhile.
+				 */
+				void wait(JobCounter& counter);
+
+				/// @brief The number of fibers created so far.
+				std::size_t getFiberCount() const;
+
+			private:
+				struct Job
+				{
+					Task        task;
+					JobCounter* counter;
+				};
+
+				using JobPool = BlockPool<sizeof(Job), alignof(Job)>;
+
+			private:
+				/// @brief Runs a queued job, on a fiber if supported.
+				void start(Job* job);
+
+				/// @brief Lowers the job's counter and frees the job.
+				void finish(Job* job);
+
+#if defined(QZ_FIBERS_SUPPORTED)
+				detail::Fiber* acquireFiber();
+
+				/// @brief Switches to the fiber until it waits or finishes.
+				void resume(detail::Fiber* fiber);
+
+				void schedule(detail::Fiber* fiber);
+
+				/// @brief Where every fiber starts, never returns.
+				static void runFiber(void* fiber);
+#endif
+
+			private:
+				ThreadPool&       m_pool;
+				const std::size_t m_stackSize;
+
+				/// @brief Jobs queued or running, including waiting ones.
+				std::atomic<std::size_t> m_active;
+
+				mutable std::mutex          m_fiberMutex;
+				std::vector<detail::Fiber*> m_fibers;
+				detail::Fiber*              m_freeFibers;
+			};
+		} // namespace threading
+	}     // namespace utils
+} // namespace qz
@@ -0,0 +1,89 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <Quartz/Core.hpp>
+
+#include <atomic>
+#include <cstdint>
+
+#if !defined(QZ_PLATFORM_LINUX)
+#	include <condition_variable>
+#	include <mutex>
+#endif
+
+namespace qz
+{
+	namespace utils
+	{
+		namespace threading
+		{
+			/**
+			 * @brief A 32 bit atomic word that threads can sleep on until it
+			 * changes, like std::atomic::wait in C++20.
+			 *
+			 * Uses a futex on Linux, so waking a word nobody sleeps on costs
+			 * nothing but the caller's own check. Other platforms fall back
+			 * to a mutex and condition variable.
+			 */
+			class Futex
+			{
+			public:
+				explicit Futex(std::uint32_t value = 0) : m_value(value) {}
+
+				Futex(const Futex&) = delete;
+				Futex& operator=(const Futex&) = delete;
+
+				std::atomic<std::uint32_t>&       get() { return m_value; }
+				const std::atomic<std::uint32_t>& get() const
+				{
+					return m_value;
+				}
+
+				/**
+				 * @brief Sleeps while the word holds the expected value. May
+				 * return spuriously, so callers check again in a loop.
+				 */
+				void wait(std::uint32_t expected);
+
+				void wakeOne();
+				void wakeAll();
+
+			private:
+				std::atomic<std::uint32_t> m_value;
+
+#if !defined(QZ_PLATFORM_LINUX)
+				std::mutex              m_mutex;
+				std::condition_variable m_condition;
+#endif
+			};
+		} // namespace threading
+	}     // namespace utils
+} // namespace qz
@@ -0,0 +1,346 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <Quartz/Utilities/Threading/ThreadPool.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace qz
+{
+	namespace utils
+	{
+		namespace threading
+		{
+			template <typename T>
+			class Async;
+
+			namespace detail
+			{
+				/**
+				 * @brief The part of a future's state that doesn't depend on
+				 * its value type.
+				 */
+				class FutureStateBase
+				{
+				public:
+					explicit FutureStateBase(ThreadPool* pool) : m_pool(pool)
+					{
+					}
+
+					FutureStateBase(const FutureStateBase&) = delete;
+					FutureStateBase& operator=(const FutureStateBase&) = delete;
+
+					bool isReady() const
+					{
+						return m_ready.load(std::memory_order_acquire);
+					}
+
+					/**
+					 * @brief Blocks until ready, running the pool's queued
+					 * tasks in the meantime.
+					 */
+					void wait();
+
+					/**
+					 * @brief Runs the continuation once ready, as a task on
+					 * the pool, or inline if there is no pool.
+					 */
+					void onReady(Task continuation);
+
+					/**
+					 * @brief Makes the state ready and schedules its
+					 * continuations. Called exactly once.
+					 */
+					void finish(std::exception_ptr exception);
+
+					ThreadPool* getPool() const { return m_pool; }
+
+					/// @brief Only meaningful once ready.
+					const std::exception_ptr& getException() const
+					{
+						return m_exception;
+					}
+
+				private:
+					void schedule(Task continuation);
+
+				private:
+					ThreadPool*       m_pool;
+					std::atomic<bool> m_ready {false};
+
+					std::mutex              m_mutex;
+					std::condition_variable m_condition;
+
+					std::exception_ptr m_exception;
+					std::vector<Task>  m_continuations;
+				};
+
+				template <typename T>
+				class FutureState : public FutureStateBase
+				{
+				public:
+					using FutureStateBase::FutureStateBase;
+
+					/// @brief Stores the function's result or exception.
+					template <typename Function>
+					void run(Function& function)
+					{
+						std::exception_ptr exception;
+
+						try
+						{
+							m_value.emplace(function());
+						}
+						catch (...)
+						{
+							exception = std::current_exception();
+						}
+
+						finish(std::move(exception));
+					}
+
+					/// @brief Only valid once ready without an exception.
+					const T& getValue() const { return *m_value; }
+
+				private:
+					std::optional<T> m_value;
+				};
+
+				template <>
+				class FutureState<void> : public FutureStateBase
+				{
+				public:
+					using FutureStateBase::FutureStateBase;
+
+					template <typename Function>
+					void run(Function& function)
+					{
+						std::exception_ptr exception;
+
+						try
+						{
+							function();
+						}
+						catch (...)
+						{
+							exception = std::current_exception();
+						}
+
+						finish(std::move(exception));
+					}
+
+					void getValue() const {}
+				};
+
+				/// @brief Calls a continuation with the value it follows.
+				template <typename T, typename Function>
+				decltype(auto) invokeContinuation(Function&         function,
+				                                  const FutureState<T>& state)
+				{
+					if constexpr (std::is_void_v<T>)
+						return function();
+					else
+						return function(state.getValue());
+				}
+
+				template <typename T, typename Function>
+				using ContinuationResult =
+				    std::decay_t<decltype(invokeContinuation(
+				        std::declval<Function&>(),
+				        std::declval<const FutureState<T>&>()))>;
+
+				Future<void> whenAll(
+				    std::vector<std::shared_ptr<FutureStateBase>> states);
+			} // namespace detail
+
+			/**
+			 * @brief A handle to the result of a task on a ThreadPool.
+			 *
+			 * Copies share the same result, like std::shared_future. Waiting
+			 * runs the pool's queued tasks on the waiting thread rather than
+			 * blocking it, so tasks may wait on each other without starving
+			 * the pool.
+			 *
+			 * An exception thrown by the task is rethrown by get(), and is
+			 * passed on to continuations instead of running them.
+			 */
+			template <typename T>
+			class Future
+			{
+			public:
+				using ValueType = T;
+
+				Future() = default;
+
+				bool isValid() const { return m_state != nullptr; }
+				bool isReady() const { return m_state->isReady(); }
+
+				void wait() const { m_state->wait(); }
+
+				/**
+				 * @brief Waits for the result, then returns it or rethrows
+				 * the task's exception.
+				 */
+				decltype(auto) get() const
+				{
+					m_state->wait();
+
+					if (m_state->getException())
+						std::rethrow_exception(m_state->getException());
+
+					return m_state->getValue();
+				}
+
+				/**
+				 * @brief Runs the task once this is ready, whether or not it
+				 * holds an exception. On the pool, or inline if there is
+				 * none.
+				 */
+				void onReady(Task task) const
+				{
+					m_state->onReady(std::move(task));
+				}
+
+				/**
+				 * @brief Runs the function on the pool once this is ready.
+				 *
+				 * The function takes the value by const reference, or nothing
+				 * for Future<void>.
+				 */
+				template <typename Function>
+				auto then(Function&& function) const
+				{
+					using Callable = std::decay_t<Function>;
+					using Result   = detail::ContinuationResult<T, Callable>;
+
+					auto next = std::make_shared<detail::FutureState<Result>>(
+					    m_state->getPool());
+
+					m_state->onReady(
+					    [previous = m_state, next,
+					     function = Callable(std::forward<Function>(function))](
+					    ) mutable {
+						    if (previous->getException())
+						    {
+							    next->finish(previous->getException());
+							    return;
+						    }
+
+						    auto call = [&]() -> decltype(auto) {
+							    return detail::invokeContinuation(function,
+							                                      *previous);
+						    };
+
+						    next->run(call);
+					    });
+
+					return Future<Result>(std::move(next));
+				}
+
+			private:
+				explicit Future(std::shared_ptr<detail::FutureState<T>> state)
+				    : m_state(std::move(state))
+				{
+				}
+
+				template <typename U>
+				friend class Future;
+
+				friend class ThreadPool;
+				friend class TaskGraph;
+
+				friend Future<void> detail::whenAll(
+				    std::vector<std::shared_ptr<detail::FutureStateBase>>);
+
+				template <typename U>
+				friend Future<void> whenAll(const std::vector<Future<U>>&);
+
+				template <typename... Ts>
+				friend Future<void> whenAll(const Future<Ts>&...);
+
+				template <typename U>
+				friend Future<U> spawn(Async<U> async);
+
+			private:
+				std::shared_ptr<detail::FutureState<T>> m_state;
+			};
+
+			/**
+			 * @brief Returns a future that is ready once all of the given
+			 * ones are, carrying the first exception among them if any.
+			 */
+			template <typename T>
+			Future<void> whenAll(const std::vector<Future<T>>& futures)
+			{
+				std::vector<std::shared_ptr<detail::FutureStateBase>> states;
+				states.reserve(futures.size());
+
+				for (const Future<T>& future : futures)
+					states.push_back(future.m_state);
+
+				return detail::whenAll(std::move(states));
+			}
+
+			template <typename... Ts>
+			Future<void> whenAll(const Future<Ts>&... futures)
+			{
+				return detail::whenAll({futures.m_state...});
+			}
+
+			template <typename Function>
+			Future<std::invoke_result_t<std::decay_t<Function>&>> ThreadPool::
+			    submit(Function&& function)
+			{
+				using Callable = std::decay_t<Function>;
+				using Result   = std::invoke_result_t<Callable&>;
+
+				auto state =
+				    std::make_shared<detail::FutureState<Result>>(this);
+
+				Callable callable(std::forward<Function>(function));
+				addWork([state, callable = std::move(callable)]() mutable {
+					state->run(callable);
+				});
+
+				return Future<Result>(state);
+			}
+		} // namespace threading
+	}     // namespace utils
+} // namespace qz
@@ -0,0 +1,176 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace qz
+{
+	namespace utils
+	{
+		namespace threading
+		{
+			/**
+			 * @brief A bounded multi producer, multi consumer queue.
+			 *
+			 * Dmitry Vyukov's design: every cell carries a sequence number
+			 * that says whether it is ready to be written or read, so a push
+			 * or pop is a single compare and swap on the shared position
+			 * when uncontended, and never takes a lock.
+			 */
+			template <typename T>
+			class MPMCQueue
+			{
+			public:
+				/// @brief The capacity is rounded up to a power of two.
+				explicit MPMCQueue(std::size_t capacity)
+				    : m_enqueue(0), m_dequeue(0)
+				{
+					std::size_t size = 2;
+					while (size < capacity)
+						size *= 2;
+
+					m_mask  = size - 1;
+					m_cells = std::make_unique<Cell[]>(size);
+
+					for (std::size_t i = 0; i < size; ++i)
+						m_cells[i].sequence.store(i, std::memory_order_relaxed);
+				}
+
+				MPMCQueue(const MPMCQueue&) = delete;
+				MPMCQueue& operator=(const MPMCQueue&) = delete;
+
+				/// @brief Adds an item, unless the queue is full.
+				bool tryPush(T item)
+				{
+					std::size_t position =
+					    m_enqueue.load(std::memory_order_relaxed);
+
+					Cell* cell;
+					while (true)
+					{
+						cell = &m_cells[position & m_mask];
+
+						const std::size_t sequence =
+						    cell->sequence.load(std::memory_order_acquire);
+						const std::ptrdiff_t difference =
+						    static_cast<std::ptrdiff_t>(sequence) -
+						    static_cast<std::ptrdiff_t>(position);
+
+						if (difference == 0)
+						{
+							if (m_enqueue.compare_exchange_weak(
+							        position, position + 1,
+							        std::memory_order_relaxed))
+							{
+								break;
+							}
+						}
+						else if (difference < 0)
+						{
+							return false;
+						}
+						else
+						{
+							position =
+							    m_enqueue.load(std::memory_order_relaxed);
+						}
+					}
+
+					cell->item = std::move(item);
+					cell->sequence.store(position + 1,
+					                     std::memory_order_release);
+
+					return true;
+				}
+
+				/// @brief Takes the oldest item, unless the queue is empty.
+				bool tryPop(T& item)
+				{
+					std::size_t position =
+					    m_dequeue.load(std::memory_order_relaxed);
+
+					Cell* cell;
+					while (true)
+					{
+						cell = &m_cells[position & m_mask];
+
+						const std::size_t sequence =
+						    cell->sequence.load(std::memory_order_acquire);
+						const std::ptrdiff_t difference =
+						    static_cast<std::ptrdiff_t>(sequence) -
+						    static_cast<std::ptrdiff_t>(position + 1);
+
+						if (difference == 0)
+						{
+							if (m_dequeue.compare_exchange_weak(
+							        position, position + 1,
+							        std::memory_order_relaxed))
+							{
+								break;
+							}
+						}
+						else if (difference < 0)
+						{
+							return false;
+						}
+						else
+						{
+							position =
+							    m_dequeue.load(std::memory_order_relaxed);
+						}
+					}
+
+					item = std::move(cell->item);
+					cell->sequence.store(position + m_mask + 1,
+					                     std::memory_order_release);
+
+					return true;
+				}
+
+			private:
+				struct Cell
+				{
+					std::atomic<std::size_t> sequence;
+					T                        item;
+				};
+
+				std::unique_ptr<Cell[]> m_cells;
+				std::size_t             m_mask;
+
+				alignas(64) std::atomic<std::size_t> m_enqueue;
+				alignas(64) std::atomic<std::size_t> m_dequeue;
+			};
+		} // namespace threading
+	}     // namespace utils
+} // namespace qz
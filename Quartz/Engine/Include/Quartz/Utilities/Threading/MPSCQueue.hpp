@@ -0,0 +1,131 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <atomic>
+
+namespace qz
+{
+	namespace utils
+	{
+		namespace threading
+		{
+			/**
+			 * @brief A link in an MPSCQueue, for types queued through it to
+			 * derive from.
+			 */
+			struct MPSCNode
+			{
+				std::atomic<MPSCNode*> next {nullptr};
+			};
+
+			/**
+			 * @brief An unbounded, intrusive multi producer, single consumer
+			 * queue.
+			 *
+			 * Dmitry Vyukov's design: pushing is one exchange on the back of
+			 * the queue, and popping touches only the front, so producers
+			 * never wait on each other or on the consumer. The queue doesn't
+			 * own its nodes, which must stay alive until popped.
+			 */
+			class MPSCQueue
+			{
+			public:
+				MPSCQueue() : m_back(&m_stub), m_front(&m_stub) {}
+
+				MPSCQueue(const MPSCQueue&) = delete;
+				MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+				/// @brief Safe to call from any thread.
+				void push(MPSCNode* node)
+				{
+					node->next.store(nullptr, std::memory_order_relaxed);
+
+					MPSCNode* previous =
+					    m_back.exchange(node, std::memory_order_acq_rel);
+
+					// Until this store the node is queued but unreachable,
+					// pop() reports the queue as empty in that window.
+					previous->next.store(node, std::memory_order_release);
+				}
+
+				/**
+				 * @brief Takes the oldest node. Only the consumer may call
+				 * this.
+				 * @return Null if the queue is empty, or the next node is
+				 * still being pushed.
+				 */
+				MPSCNode* pop()
+				{
+					MPSCNode* front = m_front;
+					MPSCNode* next =
+					    front->next.load(std::memory_order_acquire);
+
+					if (front == &m_stub)
+					{
+						if (next == nullptr)
+							return nullptr;
+
+						m_front = next;
+						front   = next;
+						next    = next->next.load(std::memory_order_acquire);
+					}
+
+					if (next != nullptr)
+					{
+						m_front = next;
+						return front;
+					}
+
+					if (front != m_back.load(std::memory_order_acquire))
+						return nullptr;
+
+					// The front is the last node, put the stub behind it so
+					// it can be handed out without emptying the list.
+					push(&m_stub);
+
+					next = front->next.load(std::memory_order_acquire);
+					if (next != nullptr)
+					{
+						m_front = next;
+						return front;
+					}
+
+					return nullptr;
+				}
+
+			private:
+				alignas(64) std::atomic<MPSCNode*> m_back;
+				alignas(64) MPSCNode* m_front;
+				MPSCNode m_stub;
+			};
+		} // namespace threading
+	}     // namespace utils
+} // namespace qz
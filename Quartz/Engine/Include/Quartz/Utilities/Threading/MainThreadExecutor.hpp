@@ -0,0 +1,228 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <Quartz/Utilities/Threading/BlockPool.hpp>
+#include <Quartz/Utilities/Threading/MPSCQueue.hpp>
+#include <Quartz/Utilities/Threading/Task.hpp>
+#include <Quartz/Utilities/Threading/TaskPriority.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <cstddef>
+
+namespace qz
+{
+	namespace utils
+	{
+		namespace threading
+		{
+			/**
+			 * @brief What the main thread executor has been doing, only
+			 * readable on the main thread.
+			 */
+			struct MainThreadMetrics
+			{
+				/// @brief Tasks run and time spent by the last frame.
+				std::size_t               lastRunCount = 0;
+				std::chrono::microseconds lastElapsed {0};
+
+				/// @brief Frames that went over budget, and by how much.
+				std::size_t               overrunCount = 0;
+				std::chrono::microseconds lastOverrun {0};
+				std::chrono::microseconds worstOverrun {0};
+
+				/// @brief Tasks run ahead of a more urgent lane because they
+				/// had waited long enough.
+				std::size_t agedCount = 0;
+
+				/// @brief The longest a task has waited before running.
+				std::chrono::microseconds worstWait {0};
+
+				/// @brief The deepest the queue has been at a frame's start.
+				std::size_t peakQueued = 0;
+			};
+
+			/**
+			 * @brief Queues work for the main thread, which runs it a frame
+			 * at a time within a time budget.
+			 *
+			 * Each call to runFrame() runs queued work, most urgent first,
+			 * until the frame budget is used up, leaving the rest for later
+			 * frames. Each priority counts as queued one aging interval
+			 * later than the one above it, so older work of a lower
+			 * priority eventually goes first and a steady stream of urgent
+			 * work can't starve the rest. At least one task runs per
+			 * frame. A frame stops early when the average task wouldn't fit
+			 * in what is left of its budget, but a task that takes longer
+			 * than usual still overruns it, which the metrics count.
+			 *
+			 * Only work queued before a frame starts runs in that frame.
+			 * Adding work is lock free and safe from any thread. The thread
+			 * that creates the executor is taken as the main thread. Work
+			 * still queued when the executor is destroyed is run by the
+			 * destructor, which must be called on the main thread.
+			 */
+			class MainThreadExecutor
+			{
+			public:
+				static constexpr std::chrono::microseconds
+				    DEFAULT_FRAME_BUDGET {2000};
+
+				static constexpr std::chrono::microseconds
+				    DEFAULT_AGING_INTERVAL {100000};
+
+			public:
+				explicit MainThreadExecutor(
+				    std::chrono::microseconds frameBudget =
+				        DEFAULT_FRAME_BUDGET);
+				~MainThreadExecutor();
+
+				MainThreadExecutor(const MainThreadExecutor&) = delete;
+				MainThreadExecutor& operator=(const MainThreadExecutor&) =
+				    delete;
+
+				/**
+				 * @brief Queues work. Without a priority it is NEARBY,
+				 * leaving CRITICAL for work that must not wait behind it.
+				 */
+				void addWork(Task         task,
+				             TaskPriority priority = TaskPriority::NEARBY);
+
+				/**
+				 * @brief Runs the work queued so far, within the frame
+				 * budget. Main thread only.
+				 * @return The number of tasks run.
+				 */
+				std::size_t runFrame();
+
+				/**
+				 * @brief Runs all the work queued so far, regardless of the
+				 * budget. Main thread only.
+				 * @return The number of tasks run.
+				 */
+				std::size_t runPending();
+
+				/// @brief Whether the calling thread is the main thread.
+				bool isWorkerThread() const
+				{
+					return std::this_thread::get_id() == m_thread;
+				}
+
+				/// @brief Main thread only, like the setters below.
+				const MainThreadMetrics& getMetrics() const
+				{
+					return m_metrics;
+				}
+
+				void resetMetrics() { m_metrics = MainThreadMetrics(); }
+
+				void setFrameBudget(std::chrono::microseconds budget)
+				{
+					m_frameBudget = budget;
+				}
+
+				std::chrono::microseconds getFrameBudget() const
+				{
+					return m_frameBudget;
+				}
+
+				/// @brief How much longer work waits for each step down in
+				/// priority, at most.
+				void setAgingInterval(std::chrono::microseconds interval)
+				{
+					m_agingInterval = interval;
+				}
+
+				/// @brief Tasks added and not yet started, safe from any
+				/// thread.
+				std::size_t getQueuedCount(TaskPriority priority) const;
+				std::size_t getQueuedCount() const;
+
+			private:
+				using Clock = std::chrono::steady_clock;
+
+				struct Node : MPSCNode
+				{
+					Task              task;
+					Clock::time_point queued;
+
+					/// @brief Links nodes the main thread has taken off the
+					/// queue but not run yet.
+					Node* after = nullptr;
+				};
+
+				using NodePool = BlockPool<sizeof(Node), alignof(Node)>;
+
+				/// @brief Work of one priority, in the order it was added.
+				struct Lane
+				{
+					MPSCQueue                queue;
+					std::atomic<std::size_t> size {0};
+
+					Node* first = nullptr;
+					Node* last  = nullptr;
+				};
+
+				static constexpr std::size_t LANE_COUNT =
+				    static_cast<std::size_t>(TaskPriority::COUNT);
+
+			private:
+				/// @brief Moves newly queued work into the lanes' lists.
+				/// @return The number of tasks queued.
+				std::size_t collect();
+
+				/**
+				 * @brief Takes the task to run next, from the lane whose
+				 * front is most urgent once aged.
+				 */
+				Node* takeNext();
+
+				std::size_t run(Clock::duration budget);
+
+			private:
+				const std::thread::id m_thread;
+
+				std::array<Lane, LANE_COUNT> m_lanes;
+
+				std::chrono::microseconds m_frameBudget;
+				std::chrono::microseconds m_agingInterval;
+
+				/// @brief A moving average of how long tasks take.
+				Clock::duration m_averageCost;
+
+				MainThreadMetrics m_metrics;
+			};
+		} // namespace threading
+	}     // namespace utils
+} // namespace qz
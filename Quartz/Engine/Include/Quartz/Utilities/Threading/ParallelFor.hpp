@@ -0,0 +1,426 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <Quartz/Utilities/Threading/CancellationToken.hpp>
+#include <Quartz/Utilities/Threading/ThreadPool.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+#include <cstddef>
+#include <utility>
+
+namespace qz
+{
+	namespace utils
+	{
+		namespace threading
+		{
+			namespace detail
+			{
+				/// @brief Pieces a loop starts out split into, per thread.
+				constexpr std::size_t LOOP_PIECES_PER_THREAD = 4;
+
+				/// @brief Extra halvings granted to a piece that was stolen,
+				/// since a steal means other threads are short of work.
+				constexpr unsigned STOLEN_SPLIT_DEPTH = 2;
+
+				/**
+				 * @brief State shared by the pieces of one loop. It lives on
+				 * the stack of the calling thread, which waits for every
+				 * piece before returning.
+				 */
+				class LoopControl
+				{
+				public:
+					LoopControl(ThreadPool& pool, std::size_t grain,
+					            const CancellationToken& token)
+					    : m_pool(pool), m_grain(grain), m_token(token)
+					{
+					}
+
+					LoopControl(const LoopControl&) = delete;
+					LoopControl& operator=(const LoopControl&) = delete;
+
+					/// @brief Halvings allowed before any piece is stolen.
+					unsigned getInitialDepth() const
+					{
+						// The calling thread works on the loop as well.
+						const std::size_t threads = m_pool.getThreadCount() + 1;
+						const std::size_t pieces =
+						    threads * LOOP_PIECES_PER_THREAD;
+
+						unsigned depth = 0;
+						while ((std::size_t(1) << depth) < pieces)
+							++depth;
+
+						return depth;
+					}
+
+					/**
+					 * @brief Checks whether the rest of the loop should be
+					 * skipped, and remembers that it was.
+					 */
+					bool shouldStop()
+					{
+						if (!m_stopped.load(std::memory_order_relaxed) &&
+						    !m_token.isCancelled())
+						{
+							return false;
+						}
+
+						m_incomplete.store(true, std::memory_order_relaxed);
+						return true;
+					}
+
+					/// @brief Stops the loop, keeping the first exception.
+					void fail(std::exception_ptr exception)
+					{
+						{
+							std::lock_guard<std::mutex> lock(m_mutex);
+
+							if (!m_exception)
+								m_exception = std::move(exception);
+						}
+
+						m_stopped.store(true, std::memory_order_relaxed);
+						m_incomplete.store(true, std::memory_order_relaxed);
+					}
+
+					/// @brief Only called once every piece has finished.
+					void rethrow()
+					{
+						if (m_exception)
+							std::rethrow_exception(m_exception);
+					}
+
+					bool isComplete() const
+					{
+						return !m_incomplete.load(std::memory_order_relaxed);
+					}
+
+				protected:
+					ThreadPool&              m_pool;
+					const std::size_t        m_grain;
+					const CancellationToken& m_token;
+
+				private:
+					std::atomic<bool>  m_stopped {false};
+					std::atomic<bool>  m_incomplete {false};
+					std::mutex         m_mutex;
+					std::exception_ptr m_exception;
+				};
+
+				template <typename Body>
+				class ForLoop : public LoopControl
+				{
+				public:
+					ForLoop(ThreadPool& pool, std::size_t grain,
+					        const CancellationToken& token, const Body& body)
+					    : LoopControl(pool, grain, token), m_body(body)
+					{
+					}
+
+					/**
+					 * @brief Hands out halves of the range until it is small
+					 * enough, then works through what is left in grain sized
+					 * steps.
+					 */
+					void run(std::size_t begin, std::size_t end,
+					         unsigned depth, std::thread::id spawner)
+					{
+						const auto self = std::this_thread::get_id();
+						if (self != spawner)
+							depth += STOLEN_SPLIT_DEPTH;
+
+						while (end - begin > m_grain && depth > 0)
+						{
+							const auto middle = begin + (end - begin) / 2;
+							--depth;
+
+							m_pending.fetch_add(1, std::memory_order_relaxed);
+							m_pool.addWork([this, middle, end, depth, self]() {
+								run(middle, end, depth, self);
+								m_pending.fetch_sub(1,
+								                    std::memory_order_release);
+							});
+
+							end = middle;
+						}
+
+						try
+						{
+							for (std::size_t first = begin; first < end;
+							     first += m_grain)
+							{
+								if (shouldStop())
+									return;
+
+								m_body(first, std::min(first + m_grain, end));
+							}
+						}
+						catch (...)
+						{
+							fail(std::current_exception());
+						}
+					}
+
+					bool isFinished() const
+					{
+						return m_pending.load(std::memory_order_acquire) == 0;
+					}
+
+				private:
+					const Body&              m_body;
+					std::atomic<std::size_t> m_pending {0};
+				};
+
+				template <typename T, typename Function, typename Combine>
+				class ReduceLoop : public LoopControl
+				{
+				public:
+					ReduceLoop(ThreadPool& pool, std::size_t grain,
+					           const CancellationToken& token,
+					           const T& identity, const Function& function,
+					           const Combine& combine)
+					    : LoopControl(pool, grain, token), m_identity(identity),
+					      m_function(function), m_combine(combine)
+					{
+					}
+
+					/**
+					 * @brief Splits like ForLoop, but joins each half it hands
+					 * out, so values are combined in index order.
+					 */
+					T run(std::size_t begin, std::size_t end, unsigned depth,
+					      std::thread::id spawner)
+					{
+						const auto self = std::this_thread::get_id();
+						if (self != spawner)
+							depth += STOLEN_SPLIT_DEPTH;
+
+						if (end - begin > m_grain && depth > 0)
+							return split(begin, end, depth - 1, self);
+
+						T value = m_identity;
+
+						try
+						{
+							for (std::size_t first = begin; first < end;
+							     first += m_grain)
+							{
+								if (shouldStop())
+									break;
+
+								value = m_function(
+								    first, std::min(first + m_grain, end),
+								    std::move(value));
+							}
+						}
+						catch (...)
+						{
+							fail(std::current_exception());
+						}
+
+						return value;
+					}
+
+				private:
+					T split(std::size_t begin, std::size_t end, unsigned depth,
+					        std::thread::id self)
+					{
+						struct Half
+						{
+							std::optional<T>  value;
+							std::atomic<bool> done {false};
+						};
+
+						const std::size_t middle = begin + (end - begin) / 2;
+
+						Half right;
+						m_pool.addWork([this, &right, middle, end, depth,
+						                self]() {
+							right.value.emplace(run(middle, end, depth, self));
+							right.done.store(true, std::memory_order_release);
+						});
+
+						T left = run(begin, middle, depth, self);
+
+						m_pool.runPendingTasksUntil([&right]() {
+							return right.done.load(std::memory_order_acquire);
+						});
+
+						try
+						{
+							return m_combine(std::move(left),
+							                 std::move(*right.value));
+						}
+						catch (...)
+						{
+							fail(std::current_exception());
+						}
+
+						return m_identity;
+					}
+
+				private:
+					const T&        m_identity;
+					const Function& m_function;
+					const Combine&  m_combine;
+				};
+			} // namespace detail
+
+			/**
+			 * @brief Calls the body on consecutive subranges of [begin, end)
+			 * no longer than the grain size, spread across the pool.
+			 *
+			 * The range is halved a few times per thread up front, and
+			 * pieces that get stolen are halved further, so the split adapts
+			 * to how busy the pool is. Nothing is allocated per index, only
+			 * per piece handed to the pool. The calling thread works on the
+			 * loop too and runs other queued tasks while waiting.
+			 *
+			 * Without a pool the loop runs serially. The body must be safe to
+			 * call from several threads at once. An exception thrown by it
+			 * stops the loop and is rethrown here once every piece is done.
+			 *
+			 * @param body Called as body(first, last).
+			 * @return False if cancellation skipped part of the range.
+			 */
+			template <typename Body>
+			bool parallelForRange(ThreadPool* pool, std::size_t begin,
+			                      std::size_t end, std::size_t grain,
+			                      const Body&              body,
+			                      const CancellationToken& token = {})
+			{
+				grain = std::max<std::size_t>(grain, 1);
+
+				if (begin >= end || end - begin <= grain || pool == nullptr)
+				{
+					for (std::size_t first = begin; first < end; first += grain)
+					{
+						if (token.isCancelled())
+							return false;
+
+						body(first, std::min(first + grain, end));
+					}
+
+					return true;
+				}
+
+				detail::ForLoop<Body> loop(*pool, grain, token, body);
+				loop.run(begin, end, loop.getInitialDepth(),
+				         std::this_thread::get_id());
+
+				pool->runPendingTasksUntil(
+				    [&loop]() { return loop.isFinished(); });
+
+				loop.rethrow();
+				return loop.isComplete();
+			}
+
+			/**
+			 * @brief Calls the body once per index of [begin, end), in the
+			 * same way as parallelForRange.
+			 *
+			 * @param body Called as body(index).
+			 */
+			template <typename Body>
+			bool parallelFor(ThreadPool* pool, std::size_t begin,
+			                 std::size_t end, std::size_t grain,
+			                 const Body&              body,
+			                 const CancellationToken& token = {})
+			{
+				return parallelForRange(
+				    pool, begin, end, grain,
+				    [&body](std::size_t first, std::size_t last) {
+					    for (std::size_t i = first; i < last; ++i)
+						    body(i);
+				    },
+				    token);
+			}
+
+			/**
+			 * @brief Folds [begin, end) into one value across the pool.
+			 *
+			 * Each piece starts from a copy of the identity, the function
+			 * folds subranges into it, and pieces are combined in index
+			 * order. The combine function must be associative, the identity
+			 * must leave values unchanged when combined with them.
+			 *
+			 * If the token is cancelled the skipped pieces count as the
+			 * identity, so the result covers only part of the range.
+			 *
+			 * @param function Called as function(first, last, value), returns
+			 * the value with [first, last) folded in.
+			 * @param combine Called as combine(left, right).
+			 */
+			template <typename T, typename Function, typename Combine>
+			T parallelReduce(ThreadPool* pool, std::size_t begin,
+			                 std::size_t end, std::size_t grain,
+			                 const T& identity, const Function& function,
+			                 const Combine&           combine,
+			                 const CancellationToken& token = {})
+			{
+				grain = std::max<std::size_t>(grain, 1);
+
+				if (begin >= end || end - begin <= grain || pool == nullptr)
+				{
+					T value = identity;
+
+					for (std::size_t first = begin; first < end; first += grain)
+					{
+						if (token.isCancelled())
+							break;
+
+						value = function(first, std::min(first + grain, end),
+						                 std::move(value));
+					}
+
+					return value;
+				}
+
+				detail::ReduceLoop<T, Function, Combine> loop(
+				    *pool, grain, token, identity, function, combine);
+
+				T value = loop.run(begin, end, loop.getInitialDepth(),
+				                   std::this_thread::get_id());
+
+				loop.rethrow();
+				return value;
+			}
+		} // namespace threading
+	}     // namespace utils
+} // namespace qz
@@ -0,0 +1,166 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <Quartz/Utilities/Threading/CancellationToken.hpp>
+#include <Quartz/Utilities/Threading/TaskPriority.hpp>
+#include <Quartz/Utilities/Threading/ThreadPool.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+namespace qz
+{
+	namespace utils
+	{
+		namespace threading
+		{
+			/**
+			 * @brief Queues keyed jobs in priority lanes in front of a
+			 * ThreadPool.
+			 *
+			 * Every scheduled job puts a task on the pool, which runs
+			 * whichever queued job is most urgent when a worker gets to it,
+			 * oldest first within a lane. Jobs can be moved between lanes or
+			 * cancelled by key until they start, and are handed a token that
+			 * a running job should check to stop early once cancelled.
+			 *
+			 * Meant for streaming, where queued jobs go stale as the stream
+			 * centre moves and the jobs that matter now have to go first.
+			 */
+			class PriorityScheduler
+			{
+			public:
+				using Key = std::uint64_t;
+
+				typedef std::function<void(const CancellationToken&)> Job;
+
+				/**
+				 * @brief Returns the new priority of a queued job, or nothing
+				 * to cancel it.
+				 */
+				typedef std::function<std::optional<TaskPriority>(Key)>
+				    PriorityFunction;
+
+			public:
+				explicit PriorityScheduler(ThreadPool& pool);
+
+				/// @brief Cancels every job, without waiting for running
+				/// ones to notice.
+				~PriorityScheduler();
+
+				PriorityScheduler(const PriorityScheduler&) = delete;
+				PriorityScheduler& operator=(const PriorityScheduler&) = delete;
+
+				/**
+				 * @brief Queues a job.
+				 * @return False if a job with the same key is already queued
+				 * or running.
+				 */
+				bool schedule(Key key, TaskPriority priority, Job job);
+
+				/**
+				 * @brief Moves a queued job to the back of another lane.
+				 * @return False if the job isn't queued (any more).
+				 */
+				bool reprioritize(Key key, TaskPriority priority);
+
+				/**
+				 * @brief Re-evaluates every queued job, in one pass under the
+				 * lock. Jobs keeping their priority keep their place.
+				 */
+				void reprioritizeAll(const PriorityFunction& priorityOf);
+
+				/**
+				 * @brief Drops a queued job, or cancels the token of a
+				 * running one. The key can be scheduled again right away.
+				 * @return False if the key is unknown.
+				 */
+				bool cancel(Key key);
+
+				void cancelAll();
+
+				/// @brief Whether a job is queued or running.
+				bool contains(Key key) const;
+
+				std::size_t getQueuedCount(TaskPriority priority) const;
+				std::size_t getQueuedCount() const;
+
+			private:
+				struct Entry
+				{
+					Key           key;
+					std::uint64_t serial;
+					Job           job;
+				};
+
+				struct Record
+				{
+					std::uint64_t      serial;
+					TaskPriority       priority;
+					bool               running;
+					CancellationSource source;
+
+					/// @brief Only valid while queued.
+					std::list<Entry>::iterator entry;
+				};
+
+				static constexpr std::size_t LANE_COUNT =
+				    static_cast<std::size_t>(TaskPriority::COUNT);
+
+				/// @brief Kept alive by queued pool tasks, so that they can
+				/// outlive the scheduler.
+				struct State
+				{
+					mutable std::mutex mutex;
+
+					std::array<std::list<Entry>, LANE_COUNT> lanes;
+					std::unordered_map<Key, Record>          records;
+
+					std::uint64_t nextSerial = 0;
+				};
+
+				/// @brief Runs the most urgent queued job, if any.
+				static void runNext(State& state);
+
+			private:
+				ThreadPool&            m_pool;
+				std::shared_ptr<State> m_state;
+			};
+		} // namespace threading
+	}     // namespace utils
+} // namespace qz
@@ -26,38 +26,124 @@
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
 
+
 #pragma once
 
-#include <condition_variable>
-#include <deque>
-#include <functional>
-#include <mutex>
+#include <Quartz/Utilities/Threading/BlockPool.hpp>
+#include <Quartz/Utilities/Threading/Futex.hpp>
+#include <Quartz/Utilities/Threading/MPSCQueue.hpp>
+#include <Quartz/Utilities/Threading/Task.hpp>
+
+#include <atomic>
+#include <string>
 #include <thread>
 
+#include <cstddef>
+#include <cstdint>
+
 namespace qz
 {
 	namespace utils
 	{
 		namespace threading
 		{
+			/**
+			 * @brief Runs work in order on a single dedicated thread.
+			 *
+			 * Work goes through a lock free queue, so adding it is a couple
+			 * of atomic operations and never waits on the worker. The worker
+			 * drains whatever has been queued in batches, and only parks on
+			 * a futex once it has run dry, which is also the only time
+			 * adding work makes a system call.
+			 *
+			 * With a capacity, adding work to a full queue waits for the
+			 * worker to make room, so fast producers can't pile up an
+			 * unbounded backlog. Tasks the worker adds itself are never
+			 * held back, as it would be waiting on itself. Work still queued
+			 * when the worker is destroyed is finished first.
+			 */
 			class SingleWorker
 			{
 			public:
-				SingleWorker();
+				/**
+				 * @param capacity The most tasks queued at once, 0 for no
+				 * limit.
+				 * @param name The worker thread's name, for profilers.
+				 */
+				explicit SingleWorker(std::size_t        capacity = 0,
+				                      const std::string& name = "Worker");
 				~SingleWorker();
 
-				void addWork(std::function<void()>&& function);
+				SingleWorker(const SingleWorker&) = delete;
+				SingleWorker& operator=(const SingleWorker&) = delete;
+
+				/**
+				 * @brief Adds work, waiting for room if the queue is full.
+				 * Called from the worker itself, it goes past the capacity
+				 * rather than deadlock.
+				 */
+				void addWork(Task task);
+
+				/**
+				 * @brief Adds work unless the queue is full, in which case
+				 * the task is left untouched.
+				 */
+				bool tryAddWork(Task& task);
+
+				/// @brief Tasks added and not yet finished.
+				std::size_t getQueuedCount() const
+				{
+					return m_size.load(std::memory_order_relaxed);
+				}
+
+				std::size_t getCapacity() const { return m_capacity; }
+
+				/// @brief Whether the calling thread is the worker.
+				bool isWorkerThread() const;
 
 			private:
-				bool                    m_running;
-				std::thread             m_thread;
-				std::mutex              m_mutex;
-				std::condition_variable m_condition;
+				struct Node : MPSCNode
+				{
+					Task task;
+				};
 
-				std::deque<std::function<void()>> m_queue;
+				using NodePool = BlockPool<sizeof(Node), alignof(Node)>;
 
 			private:
 				void threadHandle();
+
+				/// @brief Takes a slot in the queue, false if it is full.
+				bool reserve();
+
+				void push(Task& task);
+
+				/// @brief Runs a batch of tasks.
+				/// @return The number of tasks run.
+				std::size_t drain();
+
+				void park();
+
+			private:
+				const std::size_t m_capacity;
+
+				MPSCQueue m_queue;
+
+				/// @brief Reserved slots, counted before the node is pushed
+				/// and released after its task has run.
+				std::atomic<std::size_t> m_size;
+
+				std::atomic<bool> m_running;
+
+				/// @brief 1 while the worker is parked or about to be.
+				Futex m_sleeping;
+
+				/// @brief Bumped whenever room is made for producers waiting
+				/// on a full queue.
+				Futex                      m_space;
+				std::atomic<std::uint32_t> m_spaceWaiters;
+
+				const std::string m_name;
+				std::thread       m_thread;
 			};
 		} // namespace threading
 	}     // namespace utils
@@ -0,0 +1,233 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <Quartz/Utilities/Threading/BlockPool.hpp>
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace qz
+{
+	namespace utils
+	{
+		namespace threading
+		{
+			/**
+			 * @brief A move only callable the size of a cache line, the unit
+			 * of work of the ThreadPool.
+			 *
+			 * Callables of up to INLINE_SIZE bytes that can be moved without
+			 * throwing are stored inline, so wrapping a lambda doesn't
+			 * allocate. Bigger ones are boxed on the heap instead. Unlike
+			 * std::function, the callable doesn't need to be copyable.
+			 */
+			class Task
+			{
+			public:
+				static constexpr std::size_t SIZE = 64;
+				static constexpr std::size_t INLINE_SIZE =
+				    SIZE - sizeof(void*);
+
+				/// @brief Whether a callable is stored without allocating.
+				template <typename Function>
+				static constexpr bool isInline()
+				{
+					return sizeof(Function) <= INLINE_SIZE &&
+					       alignof(Function) <= alignof(std::max_align_t) &&
+					       std::is_nothrow_move_constructible_v<Function>;
+				}
+
+			public:
+				Task() = default;
+
+				template <typename Function,
+				          typename = std::enable_if_t<
+				              !std::is_same_v<std::decay_t<Function>, Task>>>
+				Task(Function&& function)
+				{
+					using Callable = std::decay_t<Function>;
+
+					if constexpr (isInline<Callable>())
+					{
+						new (m_storage)
+						    Callable(std::forward<Function>(function));
+						m_operations = &OPERATIONS<InlineStorage<Callable>>;
+					}
+					else
+					{
+						new (m_storage) Callable*(
+						    new Callable(std::forward<Function>(function)));
+						m_operations = &OPERATIONS<BoxedStorage<Callable>>;
+					}
+				}
+
+				Task(Task&& other) noexcept { take(other); }
+
+				Task& operator=(Task&& other) noexcept
+				{
+					if (this != &other)
+					{
+						reset();
+						take(other);
+					}
+
+					return *this;
+				}
+
+				Task(const Task&) = delete;
+				Task& operator=(const Task&) = delete;
+
+				~Task() { reset(); }
+
+				explicit operator bool() const
+				{
+					return m_operations != nullptr;
+				}
+
+				void operator()() { m_operations->invoke(m_storage); }
+
+				void reset()
+				{
+					if (m_operations != nullptr)
+					{
+						m_operations->destroy(m_storage);
+						m_operations = nullptr;
+					}
+				}
+
+			private:
+				struct Operations
+				{
+					void (*invoke)(void* storage);
+
+					/// @brief Moves the callable over and destroys the old one.
+					void (*relocate)(void* from, void* to);
+
+					void (*destroy)(void* storage);
+				};
+
+				template <typename Callable>
+				struct InlineStorage
+				{
+					static Callable* get(void* storage)
+					{
+						return std::launder(static_cast<Callable*>(storage));
+					}
+
+					static void invoke(void* storage) { (*get(storage))(); }
+
+					static void relocate(void* from, void* to)
+					{
+						new (to) Callable(std::move(*get(from)));
+						get(from)->~Callable();
+					}
+
+					static void destroy(void* storage)
+					{
+						get(storage)->~Callable();
+					}
+				};
+
+				template <typename Callable>
+				struct BoxedStorage
+				{
+					static Callable*& get(void* storage)
+					{
+						return *std::launder(static_cast<Callable**>(storage));
+					}
+
+					static void invoke(void* storage) { (*get(storage))(); }
+
+					static void relocate(void* from, void* to)
+					{
+						new (to) Callable*(get(from));
+					}
+
+					static void destroy(void* storage) { delete get(storage); }
+				};
+
+				template <typename Storage>
+				static constexpr Operations OPERATIONS = {
+				    &Storage::invoke, &Storage::relocate, &Storage::destroy};
+
+				void take(Task& other)
+				{
+					m_operations = other.m_operations;
+
+					if (m_operations != nullptr)
+					{
+						m_operations->relocate(other.m_storage, m_storage);
+						other.m_operations = nullptr;
+					}
+				}
+
+			private:
+				alignas(std::max_align_t) unsigned char m_storage[INLINE_SIZE];
+				const Operations* m_operations = nullptr;
+			};
+
+			static_assert(sizeof(Task) == Task::SIZE,
+			              "Task should fill exactly one cache line");
+
+			/**
+			 * @brief Keeps queued tasks in pooled blocks, so queueing work
+			 * stops allocating once the pool has warmed up.
+			 */
+			class TaskAllocator
+			{
+			public:
+				using Pool = BlockPool<sizeof(Task), alignof(Task)>;
+
+				/// @brief Returns memory for one Task, uninitialised.
+				static void* allocate() { return Pool::allocate(); }
+
+				static void deallocate(void* block)
+				{
+					Pool::deallocate(block);
+				}
+
+				/// @brief Moves a task into a pooled block.
+				static Task* create(Task&& task)
+				{
+					return new (allocate()) Task(std::move(task));
+				}
+
+				static void destroy(Task* task)
+				{
+					task->~Task();
+					deallocate(task);
+				}
+			};
+		} // namespace threading
+	}     // namespace utils
+} // namespace qz
@@ -0,0 +1,111 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <Quartz/Utilities/Threading/Future.hpp>
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace qz
+{
+	namespace utils
+	{
+		namespace threading
+		{
+			/**
+			 * @brief Builds a set of tasks with dependencies between them,
+			 * then runs it on a ThreadPool.
+			 *
+			 * Each task is queued as soon as every task it depends on has
+			 * finished, so independent branches run in parallel without the
+			 * caller scheduling them. If a task throws, the tasks depending
+			 * on it, directly or not, are skipped and the exception is
+			 * passed to the future returned by run().
+			 *
+			 * @code
+			 * TaskGraph graph;
+			 * auto load     = graph.addTask(loadTextures);
+			 * auto generate = graph.addTask(generateTerrain);
+			 * auto mesh     = graph.addTask(buildMeshes);
+			 * graph.addDependency(load, mesh);
+			 * graph.addDependency(generate, mesh);
+			 * graph.run(pool).wait();
+			 * @endcode
+			 */
+			class TaskGraph
+			{
+			public:
+				using TaskID = std::size_t;
+
+			public:
+				TaskID addTask(std::function<void()> task);
+
+				/// @brief Makes the second task wait for the first one.
+				void addDependency(TaskID before, TaskID after);
+
+				std::size_t getTaskCount() const { return m_nodes.size(); }
+
+				bool isAcyclic() const;
+
+				/**
+				 * @brief Starts the graph on the pool. The graph is copied,
+				 * so it may be changed, run again or destroyed right away.
+				 *
+				 * A graph with a cycle runs nothing and its future holds a
+				 * std::invalid_argument.
+				 */
+				Future<void> run(ThreadPool& pool) const;
+
+				void clear() { m_nodes.clear(); }
+
+			private:
+				struct Node
+				{
+					std::function<void()> task;
+					std::vector<TaskID>   successors;
+					std::size_t           predecessorCount = 0;
+				};
+
+				struct Execution;
+
+				using ExecutionPtr = std::shared_ptr<Execution>;
+
+				static void schedule(const ExecutionPtr& execution, TaskID id);
+				static void execute(const ExecutionPtr& execution, TaskID id);
+
+			private:
+				std::vector<Node> m_nodes;
+			};
+		} // namespace threading
+	}     // namespace utils
+} // namespace qz
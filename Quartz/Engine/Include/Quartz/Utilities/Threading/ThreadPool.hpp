@@ -26,15 +26,26 @@
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
 
+
 #pragma once
 
+#include <Quartz/Utilities/Threading/CpuTopology.hpp>
+#include <Quartz/Utilities/Threading/MPMCQueue.hpp>
+#include <Quartz/Utilities/Threading/Task.hpp>
+#include <Quartz/Utilities/Threading/WorkStealingDeque.hpp>
+
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <mutex>
 #include <thread>
 
 #include <cstddef>
-#include <deque>
-#include <functional>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <type_traits>
 #include <vector>
 
 namespace qz
@@ -43,26 +54,194 @@ namespace qz
 	{
 		namespace threading
 		{
+			template <typename T>
+			class Future;
+
+			/// @brief How a ThreadPool places its workers on CPUs.
+			enum class ThreadPinning : std::uint8_t
+			{
+				/// @brief Leaves placement to the OS.
+				NONE,
+
+				/**
+				 * @brief Pins every worker to a physical core of its own.
+				 * Workers beyond the cores go on the cores' other SMT
+				 * siblings, and any beyond those are left unpinned.
+				 */
+				ONE_PER_CORE
+			};
+
+			struct ThreadPoolOptions
+			{
+				/// @brief Workers are named this, followed by their index.
+				std::string name = "Worker";
+
+				ThreadPinning pinning = ThreadPinning::NONE;
+
+				/// @brief Keeps pinned workers off the first core, leaving
+				/// it to the main or tick thread.
+				bool leaveFirstCore = false;
+
+				/**
+				 * @brief Has every pinned worker allocate its first task
+				 * blocks itself, so they sit on its own NUMA node.
+				 */
+				bool localArenas = true;
+			};
+
+			/**
+			 * @brief Runs work on a fixed set of threads, with a work stealing
+			 * scheduler.
+			 *
+			 * Every worker has a Chase-Lev deque. Work added from a worker
+			 * goes onto its own deque, where it is popped newest first while
+			 * idle workers steal oldest first from random victims. Work added
+			 * from other threads goes through a lock free injection queue,
+			 * or a locked overflow queue once that is full.
+			 *
+			 * Idle workers spin for a while before parking, so bursts of
+			 * small jobs don't pay for a wake up each. Work still queued when
+			 * the pool is destroyed is finished first.
+			 *
+			 * Queued tasks live in blocks from the TaskAllocator, so adding
+			 * work whose captures fit in a Task doesn't allocate.
+			 */
 			class ThreadPool
 			{
 			public:
-				ThreadPool(const std::size_t threadCount);
+				ThreadPool(const std::size_t        threadCount,
+				           const ThreadPoolOptions& options = {});
 				~ThreadPool();
 
-				void addWork(std::function<void()> fun);
+				ThreadPool(const ThreadPool&) = delete;
+				ThreadPool& operator=(const ThreadPool&) = delete;
+
+				void addWork(Task task);
+
+				/**
+				 * @brief Adds work whose result, or exception, is handed to
+				 * the returned future. Defined in Future.hpp.
+				 */
+				template <typename Function>
+				Future<std::invoke_result_t<std::decay_t<Function>&>> submit(
+				    Function&& function);
+
+				/**
+				 * @brief Runs one queued task on the calling thread, so that
+				 * threads waiting on the pool can help it along.
+				 * @return False if there was nothing to run.
+				 */
+				bool runPendingTask();
+
+				/**
+				 * @brief Runs queued tasks on the calling thread until the
+				 * condition holds, sleeping briefly while there are none.
+				 */
+				template <typename Condition>
+				void runPendingTasksUntil(const Condition& condition);
+
+				/// @brief Whether the calling thread is one of the workers.
+				bool isWorkerThread() const;
+
+				/**
+				 * @brief The index of the calling worker, for picking its
+				 * slot in per worker data, or nothing on other threads.
+				 */
+				std::optional<std::size_t> getWorkerIndex() const;
+
+				/// @brief The CPU a worker was given to pin itself to, if
+				/// any. Pinning is best effort.
+				std::optional<LogicalCpu> getWorkerCpu(
+				    std::size_t index) const;
+
+				std::size_t getThreadCount() const { return m_workers.size(); }
+
+			private:
+				struct Worker
+				{
+					WorkStealingDeque<Task*> deque;
+					std::thread              thread;
+
+					std::size_t               index;
+					std::string               name;
+					std::optional<LogicalCpu> cpu;
+
+					/// @brief Picks victims to steal from.
+					std::uint64_t random;
+				};
 
 			private:
-				bool m_running;
+				void threadHandle(std::size_t index);
 
-				std::mutex              m_mutex;
-				std::condition_variable m_condition;
+				/// @brief Names and pins the calling worker.
+				void setUpWorker(Worker& self);
 
-				std::vector<std::thread>          m_threads;
-				std::deque<std::function<void()>> m_scheduledTasks;
+				/// @brief Takes a task from the injection or overflow queue.
+				Task* takeShared();
+
+				/**
+				 * @brief Takes a task from anywhere, or returns null.
+				 * @param self The calling worker, or null for other threads.
+				 */
+				Task* findWork(Worker* self);
+
+				void runTask(Task* task);
+
+				void push(Task* task);
+				void park();
 
 			private:
-				void threadHandle();
+				std::atomic<bool> m_running;
+
+				std::vector<std::unique_ptr<Worker>> m_workers;
+
+				const bool m_localArenas;
+
+				MPMCQueue<Task*> m_injection;
+
+				/// @brief A ring buffer that only grows, so it stops
+				/// allocating once it has seen the largest backlog.
+				std::mutex               m_overflowMutex;
+				std::vector<Task*>       m_overflow;
+				std::size_t              m_overflowHead;
+				std::atomic<std::size_t> m_overflowSize;
+
+				/// @brief Tasks added but not yet taken by a worker.
+				std::atomic<std::size_t> m_pending;
+
+				std::mutex               m_mutex;
+				std::condition_variable  m_condition;
+				std::atomic<std::size_t> m_sleeping;
+
+				/// @brief Bumped under the mutex to wake parked workers.
+				std::uint64_t m_wakeups;
 			};
+
+			template <typename Condition>
+			void ThreadPool::runPendingTasksUntil(const Condition& condition)
+			{
+				// Failed attempts at helping before sleeping between them.
+				constexpr int YIELD_ROUNDS = 64;
+
+				int idle = 0;
+
+				while (!condition())
+				{
+					if (runPendingTask())
+					{
+						idle = 0;
+					}
+					else if (++idle < YIELD_ROUNDS)
+					{
+						std::this_thread::yield();
+					}
+					else
+					{
+						std::this_thread::sleep_for(
+						    std::chrono::microseconds(50));
+					}
+				}
+			}
 		} // namespace threading
 	}     // namespace utils
 } // namespace qz
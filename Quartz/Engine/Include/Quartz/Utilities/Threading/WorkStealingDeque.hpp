@@ -0,0 +1,202 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace qz
+{
+	namespace utils
+	{
+		namespace threading
+		{
+			/**
+			 * @brief A Chase-Lev work stealing deque.
+			 *
+			 * The owning thread pushes and pops at the bottom, without
+			 * locking, while any other thread steals from the top. The
+			 * buffer grows when full, and old buffers are kept until the
+			 * deque is destroyed, since a thief may still be reading one.
+			 *
+			 * Follows "Correct and Efficient Work-Stealing for Weak Memory
+			 * Models" (Lê et al. 2013), with sequentially consistent
+			 * operations in place of its standalone fences.
+			 */
+			template <typename T>
+			class WorkStealingDeque
+			{
+				static_assert(std::is_trivially_copyable<T>::value,
+				              "Items are copied with atomic loads and stores");
+
+			public:
+				explicit WorkStealingDeque(std::size_t capacity = 256)
+				    : m_top(0), m_bottom(0)
+				{
+					std::size_t size = 1;
+					while (size < capacity)
+						size *= 2;
+
+					m_buffers.push_back(std::make_unique<Buffer>(size));
+					m_buffer.store(m_buffers.back().get(),
+					               std::memory_order_relaxed);
+				}
+
+				WorkStealingDeque(const WorkStealingDeque&) = delete;
+				WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+				/// @brief Adds an item at the bottom, owner only.
+				void push(T item)
+				{
+					const std::int64_t bottom =
+					    m_bottom.load(std::memory_order_relaxed);
+					const std::int64_t top =
+					    m_top.load(std::memory_order_acquire);
+
+					Buffer* buffer = m_buffer.load(std::memory_order_relaxed);
+					if (bottom - top >= buffer->getCapacity())
+						buffer = grow(buffer, top, bottom);
+
+					buffer->store(bottom, item);
+					m_bottom.store(bottom + 1, std::memory_order_release);
+				}
+
+				/// @brief Takes the newest item, owner only.
+				bool pop(T& item)
+				{
+					const std::int64_t bottom =
+					    m_bottom.load(std::memory_order_relaxed) - 1;
+					Buffer* buffer = m_buffer.load(std::memory_order_relaxed);
+
+					m_bottom.store(bottom, std::memory_order_seq_cst);
+					std::int64_t top = m_top.load(std::memory_order_seq_cst);
+
+					if (top > bottom)
+					{
+						m_bottom.store(bottom + 1, std::memory_order_relaxed);
+						return false;
+					}
+
+					item = buffer->load(bottom);
+					if (top < bottom)
+						return true;
+
+					// The last item, which a thief may be taking as well.
+					const bool won = m_top.compare_exchange_strong(
+					    top, top + 1, std::memory_order_seq_cst,
+					    std::memory_order_relaxed);
+
+					m_bottom.store(bottom + 1, std::memory_order_relaxed);
+					return won;
+				}
+
+				/// @brief Takes the oldest item, from any thread.
+				bool steal(T& item)
+				{
+					std::int64_t top = m_top.load(std::memory_order_seq_cst);
+					const std::int64_t bottom =
+					    m_bottom.load(std::memory_order_seq_cst);
+
+					if (top >= bottom)
+						return false;
+
+					Buffer* buffer = m_buffer.load(std::memory_order_acquire);
+					item           = buffer->load(top);
+
+					return m_top.compare_exchange_strong(
+					    top, top + 1, std::memory_order_seq_cst,
+					    std::memory_order_relaxed);
+				}
+
+				/// @brief Whether the deque looked empty, at some point.
+				bool empty() const
+				{
+					return m_bottom.load(std::memory_order_relaxed) <=
+					       m_top.load(std::memory_order_relaxed);
+				}
+
+			private:
+				class Buffer
+				{
+				public:
+					explicit Buffer(std::size_t capacity)
+					    : m_mask(static_cast<std::int64_t>(capacity) - 1),
+					      m_items(new std::atomic<T>[capacity])
+					{
+					}
+
+					std::int64_t getCapacity() const { return m_mask + 1; }
+
+					T load(std::int64_t index) const
+					{
+						return m_items[index & m_mask].load(
+						    std::memory_order_relaxed);
+					}
+
+					void store(std::int64_t index, T item)
+					{
+						m_items[index & m_mask].store(
+						    item, std::memory_order_relaxed);
+					}
+
+				private:
+					std::int64_t                      m_mask;
+					std::unique_ptr<std::atomic<T>[]> m_items;
+				};
+
+				Buffer* grow(Buffer* buffer, std::int64_t top,
+				             std::int64_t bottom)
+				{
+					m_buffers.push_back(
+					    std::make_unique<Buffer>(buffer->getCapacity() * 2));
+
+					Buffer* grown = m_buffers.back().get();
+					for (std::int64_t i = top; i < bottom; ++i)
+						grown->store(i, buffer->load(i));
+
+					m_buffer.store(grown, std::memory_order_release);
+					return grown;
+				}
+
+			private:
+				alignas(64) std::atomic<std::int64_t> m_top;
+				alignas(64) std::atomic<std::int64_t> m_bottom;
+				std::atomic<Buffer*> m_buffer;
+
+				/// @brief Every buffer so far, only touched by the owner.
+				std::vector<std::unique_ptr<Buffer>> m_buffers;
+			};
+		} // namespace threading
+	}     // namespace utils
+} // namespace qz
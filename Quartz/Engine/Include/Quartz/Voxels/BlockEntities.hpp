@@ -0,0 +1,188 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <Quartz/Utilities/ObjectPool.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace qz
+{
+	namespace voxels
+	{
+		class Chunk;
+
+		/**
+		 * @brief Extra data attached to a single voxel, for blocks such as
+		 * containers, signs and spawners.
+		 *
+		 * Block entities are allocated from fixed size cells, so derived
+		 * types must fit in MAX_SIZE bytes. Anything bigger should hold its
+		 * data behind a pointer.
+		 */
+		class BlockEntity
+		{
+		public:
+			static constexpr std::size_t MAX_SIZE = 128;
+
+			virtual ~BlockEntity() = default;
+
+			/**
+			 * @brief Whether the block entity wants tick to be called, read
+			 * once when it is added to a chunk.
+			 */
+			virtual bool isTickable() const { return false; }
+
+			/**
+			 * @brief Updates the block entity.
+			 * @param chunk The chunk holding the block entity.
+			 * @param index The index of the voxel within the chunk.
+			 */
+			virtual void tick(Chunk& /*chunk*/, std::uint32_t /*index*/) {}
+		};
+
+		/**
+		 * @brief Sparse storage for the block entities of a chunk.
+		 *
+		 * Entries are kept sorted by voxel index in a flat array, so lookups
+		 * are a binary search and iteration runs in index order. The block
+		 * entities themselves live in a pool owned by the storage, which
+		 * allocates nothing until the first block entity is added.
+		 */
+		class BlockEntityStorage
+		{
+		public:
+			struct Entry
+			{
+				std::uint32_t index;
+				bool          tickable;
+				BlockEntity*  entity;
+			};
+
+			typedef std::vector<Entry>::const_iterator Iterator;
+
+			BlockEntityStorage() : m_tickableCount(0) {}
+			~BlockEntityStorage() { clear(); }
+
+			BlockEntityStorage(const BlockEntityStorage&) = delete;
+			BlockEntityStorage& operator=(const BlockEntityStorage&) = delete;
+
+			BlockEntityStorage(BlockEntityStorage&& other) noexcept;
+			BlockEntityStorage& operator=(BlockEntityStorage&& other) noexcept;
+
+			/**
+			 * @brief Creates a block entity at a voxel, replacing any block
+			 * entity already there.
+			 * @param index The index of the voxel within the chunk.
+			 * @param args The arguments to construct the block entity with.
+			 */
+			template <typename T, typename... Args>
+			T* emplace(std::uint32_t index, Args&&... args);
+
+			/**
+			 * @brief Finds the block entity at a voxel.
+			 * @return The block entity, or nullptr if there is none.
+			 */
+			BlockEntity* get(std::uint32_t index) const;
+
+			/**
+			 * @brief Destroys the block entity at a voxel, if there is one.
+			 * @return True if a block entity was destroyed.
+			 */
+			bool erase(std::uint32_t index);
+
+			void clear();
+
+			/**
+			 * @brief Ticks every tickable block entity in index order. Block
+			 * entities must not add or remove block entities of the same
+			 * chunk while ticking.
+			 */
+			void tick(Chunk& chunk);
+
+			Iterator    begin() const { return m_entries.begin(); }
+			Iterator    end() const { return m_entries.end(); }
+			std::size_t size() const { return m_entries.size(); }
+			bool        empty() const { return m_entries.empty(); }
+
+			std::size_t getTickableCount() const { return m_tickableCount; }
+
+		private:
+			struct alignas(alignof(std::max_align_t)) Cell
+			{
+				unsigned char bytes[BlockEntity::MAX_SIZE];
+			};
+
+			std::vector<Entry>::iterator find(std::uint32_t index);
+
+			/// @brief Takes ownership of the entity, destroying it if it
+			/// cannot be stored.
+			void insert(std::uint32_t index, BlockEntity* entity);
+			void destroy(BlockEntity* entity);
+
+		private:
+			std::vector<Entry>          m_entries;
+			utils::ObjectPool<Cell, 16> m_pool;
+			std::size_t                 m_tickableCount;
+		};
+
+		template <typename T, typename... Args>
+		T* BlockEntityStorage::emplace(std::uint32_t index, Args&&... args)
+		{
+			static_assert(std::is_base_of<BlockEntity, T>::value,
+			              "Block entities must derive from BlockEntity");
+			static_assert(sizeof(T) <= BlockEntity::MAX_SIZE,
+			              "Block entity is too big for a pool cell");
+			static_assert(alignof(T) <= alignof(Cell),
+			              "Block entity is over aligned for a pool cell");
+
+			Cell* cell = m_pool.create();
+
+			T* entity = nullptr;
+			try
+			{
+				entity = new (cell->bytes) T(std::forward<Args>(args)...);
+			}
+			catch (...)
+			{
+				m_pool.destroy(cell);
+				throw;
+			}
+
+			insert(index, entity);
+			return entity;
+		}
+	} // namespace voxels
+} // namespace qz
@@ -0,0 +1,380 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <Quartz/Graphics/BlockCompression.hpp>
+#include <Quartz/Math/Math.hpp>
+#include <Quartz/Utilities/MemoryMappedFile.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace qz
+{
+	namespace utils
+	{
+		namespace threading
+		{
+			class ThreadPool;
+		}
+	} // namespace utils
+
+	namespace voxels
+	{
+		/**
+		 * @brief Packs block textures into one RGBA8 texture with a full set
+		 * of mip levels.
+		 *
+		 * Sprites are bin-packed into a near square power of two texture.
+		 * Texture files holding identical images share a sprite. Every
+		 * sprite starts on a multiple of 2^(mip levels - 1) texels and is
+		 * surrounded by copies of its edge texels, so neither mipmapping nor
+		 * filtering pulls in colour from a neighbouring sprite.
+		 *
+		 * The finished atlas can be cached on disk, keyed by a hash of the
+		 * texture files and atlas settings. While nothing changes, patching
+		 * maps the cache file into memory instead of decoding anything.
+		 *
+		 * Every mip level can also be block compressed, in which case the
+		 * compressed levels are cached along with the rest.
+		 *
+		 * Instead of an atlas, the sprites can be laid out as the layers of a
+		 * texture array, each with its own full mip chain. Layers never
+		 * bleed into each other, so they need no padding, and a sprite ID is
+		 * the index of its layer.
+		 */
+		class BlockTextureAtlas
+		{
+		public:
+			typedef int           SpriteID;
+			const static SpriteID INVALID_SPRITE = -1;
+
+			/// @brief How long decoding one texture file took.
+			struct DecodeTiming
+			{
+				std::string   filepath;
+				std::uint64_t microseconds;
+			};
+
+			/// @brief How the sprites are arranged in the texture.
+			enum class Layout
+			{
+				ATLAS,
+				TEXTURE_ARRAY
+			};
+
+			/// @brief The largest width or height the atlas may have.
+			static constexpr std::size_t MAX_SIZE = 8192;
+
+			/// @brief The most layers a texture array may have.
+			static constexpr std::size_t MAX_LAYERS = 2048;
+
+			BlockTextureAtlas(std::size_t spriteWidth,
+			                  std::size_t spriteHeight);
+			BlockTextureAtlas();
+			~BlockTextureAtlas();
+
+			BlockTextureAtlas(const BlockTextureAtlas&) = delete;
+			BlockTextureAtlas& operator=(const BlockTextureAtlas&) = delete;
+
+			void addTextureFile(const char* texturefilepath);
+
+			/**
+			 * @brief Loads every added texture file and builds the atlas and
+			 * its mip levels. Files that fail to load get INVALID_SPRITE.
+			 * @param pool The pool to read and decode files on, or nullptr
+			 * to do everything on the calling thread. Sprite IDs do not
+			 * depend on which is used.
+			 */
+			void patch(utils::threading::ThreadPool* pool = nullptr);
+
+			/**
+			 * @brief Sets the file the finished atlas is cached in, or an
+			 * empty path to disable caching.
+			 */
+			void setCacheFilepath(const std::string& filepath)
+			{
+				m_cacheFilepath = filepath;
+			}
+
+			/// @brief Whether the last patch was loaded from the cache.
+			bool isLoadedFromCache() const { return m_cache.isOpen(); }
+
+			/**
+			 * @brief Sets the usual sprite size, which limits the number of
+			 * mip levels so that sprites never shrink below a texel.
+			 */
+			void setSpriteWidth(std::size_t w);
+			void setSpriteHeight(std::size_t h);
+
+			/**
+			 * @brief Sets how sprites are arranged. Texture array layers are
+			 * the sprite size, or the size of the largest sprite if that is
+			 * not set, and other sprites are scaled to fit.
+			 */
+			void   setLayout(Layout layout) { m_layout = layout; }
+			Layout getLayout() const { return m_layout; }
+
+			/// @brief Sets the minimum number of edge texels around sprites.
+			void setPadding(std::size_t padding) { m_padding = padding; }
+
+			/// @brief Sets the most mip levels to generate, including the base.
+			void setMaxMipLevelCount(std::size_t count)
+			{
+				m_maxMipLevelCount = count;
+			}
+
+			/**
+			 * @brief Sets the block compressed format every mip level is
+			 * encoded in as well, RGBA8 turns compression off.
+			 */
+			void setCompressedFormat(gfx::TextureFormat format)
+			{
+				m_compressedFormat = format;
+			}
+
+			gfx::TextureFormat getCompressedFormat() const
+			{
+				return m_compressedFormat;
+			}
+
+			std::size_t getSpriteWidth() const { return m_spriteWidth; }
+			std::size_t getSpriteHeight() const { return m_spriteHeight; }
+			SpriteID    getSpriteIDFromFilepath(const char* filepath);
+
+			std::size_t getPatchedTextureWidth() const
+			{
+				return m_patchedTextureWidth;
+			}
+
+			std::size_t getPatchedTextureHeight() const
+			{
+				return m_patchedTextureHeight;
+			}
+
+			/**
+			 * @brief Gets the number of texture array layers, an atlas is a
+			 * single layer.
+			 */
+			std::size_t getLayerCount() const { return m_layerCount; }
+
+			/**
+			 * @brief Gets the texels of every layer, each with every mip
+			 * level largest first and tightly packed. This is the order bgfx
+			 * expects texture array data in.
+			 */
+			const unsigned char* getPatchedTextureData() const
+			{
+				return m_textureData;
+			}
+
+			/// @brief Gets the size in bytes of every layer together.
+			std::size_t getPatchedTextureSize() const
+			{
+				return getLayerSize() * m_layerCount;
+			}
+
+			/// @brief Gets the size in bytes of one layer and its mip levels.
+			std::size_t getLayerSize() const
+			{
+				return m_mipOffsets.empty() ? 0 : m_mipOffsets.back();
+			}
+
+			/**
+			 * @brief Gets the number of mip levels, which always run down to
+			 * 1x1 so the texture can be uploaded with a full mip chain.
+			 */
+			std::size_t getMipLevelCount() const
+			{
+				return m_mipOffsets.empty() ? 0 : m_mipOffsets.size() - 1;
+			}
+
+			/**
+			 * @brief Gets the number of mip levels in which sprites do not
+			 * blend into each other, samplers should clamp to these.
+			 */
+			std::size_t getSeparateMipLevelCount() const
+			{
+				return m_separateMipLevelCount;
+			}
+
+			const unsigned char* getMipLevelData(std::size_t level) const
+			{
+				return getLayerMipLevelData(0, level);
+			}
+
+			const unsigned char* getLayerMipLevelData(std::size_t layer,
+			                                          std::size_t level) const
+			{
+				return m_textureData + layer * getLayerSize() +
+				       m_mipOffsets[level];
+			}
+
+			std::size_t getMipLevelWidth(std::size_t level) const;
+			std::size_t getMipLevelHeight(std::size_t level) const;
+
+			/**
+			 * @brief Gets the blocks of every compressed mip level, in the
+			 * same order as the texels, or null without compression.
+			 */
+			const unsigned char* getCompressedTextureData() const
+			{
+				return m_compressedData;
+			}
+
+			std::size_t getCompressedTextureSize() const
+			{
+				return getCompressedLayerSize() * m_layerCount;
+			}
+
+			std::size_t getCompressedLayerSize() const
+			{
+				return m_compressedOffsets.empty() ? 0
+				                                   : m_compressedOffsets.back();
+			}
+
+			const unsigned char* getCompressedMipLevelData(
+			    std::size_t level) const
+			{
+				return getCompressedLayerMipLevelData(0, level);
+			}
+
+			const unsigned char* getCompressedLayerMipLevelData(
+			    std::size_t layer, std::size_t level) const
+			{
+				return m_compressedData + layer * getCompressedLayerSize() +
+				       m_compressedOffsets[level];
+			}
+
+			std::size_t getSpriteCount() const { return m_sprites.size(); }
+
+			/**
+			 * @brief Gets the decode time of every texture file decoded by
+			 * the last patch, in sprite ID order. Duplicate files are only
+			 * decoded once.
+			 */
+			const std::vector<DecodeTiming>& getDecodeTimings() const
+			{
+				return m_decodeTimings;
+			}
+
+			RectAABB getSpriteFromID(SpriteID spriteId) const;
+
+		private:
+			struct Sprite
+			{
+				std::size_t x, y, width, height;
+			};
+
+			/**
+			 * @brief Packs the sprites into an atlas, setting its size and
+			 * the position of every sprite.
+			 * @param padding Receives the padding around each sprite.
+			 * @return False if they do not fit.
+			 */
+			bool packSprites(std::size_t& padding);
+
+			/**
+			 * @brief Gives every sprite a texture array layer of its own.
+			 * @return False if there are too many sprites.
+			 */
+			bool layOutLayers();
+
+			/**
+			 * @brief Copies a sprite into the base level, filling its padding
+			 * with its edge texels.
+			 */
+			void blitSprite(const Sprite& sprite, const unsigned char* image,
+			                std::size_t padding);
+
+			/**
+			 * @brief Copies an image into the base level of a layer, scaling
+			 * it to the layer size with nearest neighbour sampling.
+			 */
+			void blitLayer(std::size_t layer, const unsigned char* image,
+			               std::size_t width, std::size_t height);
+
+			/**
+			 * @brief Block compresses every mip level, in rows of blocks
+			 * spread over the pool.
+			 */
+			void compressMipLevels(utils::threading::ThreadPool* pool);
+
+			/**
+			 * @brief Maps the cache file, if it holds an atlas built with
+			 * the same key.
+			 * @return False if the cache is missing, stale or broken, the
+			 * atlas is left empty in that case.
+			 */
+			bool loadCache(std::uint64_t key);
+			void saveCache(std::uint64_t key) const;
+
+		private:
+			std::unordered_map<std::string, SpriteID> m_textureIDMap;
+			std::vector<Sprite>                       m_sprites;
+
+			Layout      m_layout;
+			std::size_t m_layerCount;
+
+			std::size_t m_spriteWidth, m_spriteHeight;
+			std::size_t m_padding;
+			std::size_t m_maxMipLevelCount;
+			std::size_t m_separateMipLevelCount;
+
+			/// @brief The texels when they were built rather than mapped.
+			unsigned char* m_patchedTextureData;
+
+			/// @brief The texels, built or mapped.
+			const unsigned char* m_textureData;
+
+			gfx::TextureFormat         m_compressedFormat;
+			std::vector<unsigned char> m_compressedStorage;
+			const unsigned char*       m_compressedData;
+
+			/// @brief The offset of each compressed level within a layer,
+			/// then the size of a layer.
+			std::vector<std::size_t> m_compressedOffsets;
+
+			std::string             m_cacheFilepath;
+			utils::MemoryMappedFile m_cache;
+
+			std::size_t m_patchedTextureWidth, m_patchedTextureHeight;
+
+			/// @brief The offset of each mip level within a layer, then the
+			/// size of a layer.
+			std::vector<std::size_t> m_mipOffsets;
+
+			std::vector<DecodeTiming> m_decodeTimings;
+		};
+	} // namespace voxels
+} // namespace qz
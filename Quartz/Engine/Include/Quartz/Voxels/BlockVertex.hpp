@@ -0,0 +1,120 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <Quartz/Voxels/Blocks.hpp>
+
+#include <cassert>
+#include <cstdint>
+
+namespace qz
+{
+	namespace voxels
+	{
+		/**
+		 * @brief A block mesh vertex packed into 8 bytes, for meshes that
+		 * sample a texture array.
+		 *
+		 * The first word holds the position within the chunk in 6 bits per
+		 * axis, then the face in 3 bits, ambient occlusion in 2 and sky and
+		 * block light in 4 each. The second holds the texture array layer in
+		 * 16 bits and the texture coordinates, in whole blocks, in 8 bits
+		 * each, so merged faces repeat their texture. Both words can be
+		 * declared as 4 integer Uint8 attributes and unpacked in the shader.
+		 */
+		struct PackedBlockVertex
+		{
+			/// @brief The largest coordinate, so chunks may be up to 63
+			/// blocks across.
+			static constexpr std::uint32_t MAX_POSITION = 63;
+
+			static constexpr std::uint32_t MAX_TEXTURE_COORDINATE = 255;
+			static constexpr std::uint32_t MAX_LAYER              = 0xFFFF;
+
+			std::uint32_t position;
+			std::uint32_t texture;
+
+			static PackedBlockVertex pack(std::uint32_t x, std::uint32_t y,
+			                              std::uint32_t z, BlockFace face,
+			                              std::uint32_t layer, std::uint32_t u,
+			                              std::uint32_t v,
+			                              std::uint32_t occlusion  = 0,
+			                              std::uint32_t skyLight   = 15,
+			                              std::uint32_t blockLight = 0)
+			{
+				assert(x <= MAX_POSITION && y <= MAX_POSITION &&
+				       z <= MAX_POSITION);
+				assert(layer <= MAX_LAYER && u <= MAX_TEXTURE_COORDINATE &&
+				       v <= MAX_TEXTURE_COORDINATE);
+				assert(occlusion < 4 && skyLight < 16 && blockLight < 16);
+
+				PackedBlockVertex vertex;
+				vertex.position = x | y << 6 | z << 12 |
+				                  static_cast<std::uint32_t>(face) << 18 |
+				                  occlusion << 21 | skyLight << 23 |
+				                  blockLight << 27;
+				vertex.texture = layer | u << 16 | v << 24;
+
+				return vertex;
+			}
+
+			std::uint32_t getX() const { return position & 0x3F; }
+			std::uint32_t getY() const { return (position >> 6) & 0x3F; }
+			std::uint32_t getZ() const { return (position >> 12) & 0x3F; }
+
+			BlockFace getFace() const
+			{
+				return static_cast<BlockFace>((position >> 18) & 0x7);
+			}
+
+			std::uint32_t getOcclusion() const
+			{
+				return (position >> 21) & 0x3;
+			}
+
+			std::uint32_t getSkyLight() const
+			{
+				return (position >> 23) & 0xF;
+			}
+
+			std::uint32_t getBlockLight() const
+			{
+				return (position >> 27) & 0xF;
+			}
+
+			std::uint32_t getLayer() const { return texture & 0xFFFF; }
+			std::uint32_t getU() const { return (texture >> 16) & 0xFF; }
+			std::uint32_t getV() const { return texture >> 24; }
+		};
+
+		static_assert(sizeof(PackedBlockVertex) == 8,
+		              "Packed block vertices must stay 8 bytes");
+	} // namespace voxels
+} // namespace qz
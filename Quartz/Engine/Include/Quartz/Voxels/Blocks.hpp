@@ -30,58 +30,38 @@
 
 #include <Quartz/Math/Math.hpp>
 #include <Quartz/Utilities/Singleton.hpp>
+#include <Quartz/Voxels/BlockTextureAtlas.hpp>
 
+#include <atomic>
+#include <cstdint>
 #include <list>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace qz
 {
 	namespace voxels
 	{
-		class BlockTextureAtlas
-		{
-		public:
-			typedef int           SpriteID;
-			const static SpriteID INVALID_SPRITE = -1;
-
-			BlockTextureAtlas(std::size_t spriteWidth,
-			                  std::size_t spriteHeight);
-			BlockTextureAtlas();
-			~BlockTextureAtlas();
-
-			void addTextureFile(const char* texturefilepath);
-			void patch();
-			void setSpriteWidth(std::size_t w);
-			void setSpriteHeight(std::size_t h);
-
-			std::size_t getSpriteWidth() const { return m_spriteWidth; }
-			std::size_t getSpriteHeight() const { return m_spriteHeight; }
-			SpriteID    getSpriteIDFromFilepath(const char* filepath);
-
-			std::size_t getPatchedTextureWidth() const
-			{
-				return m_patchedTextureWidth;
-			}
-
-			std::size_t getPatchedTextureHeight() const
-			{
-				return m_patchedTextureHeight;
-			}
-
-			unsigned char* getPatchedTextureData() const
-			{
-				return m_patchedTextureData;
-			}
-
-			RectAABB getSpriteFromID(SpriteID spriteId) const;
+		/// @brief The dense numeric ID the registry assigns every block.
+		typedef std::uint16_t BlockID;
+		const static BlockID  INVALID_BLOCK = 0xFFFF;
 
-		private:
-			std::unordered_map<std::string, SpriteID> m_textureIDMap;
-			std::size_t    m_spriteWidth, m_spriteHeight;
-			unsigned char* m_patchedTextureData;
+		/**
+		 * @brief The dense ID of a block type combined with one value for
+		 * each of its state properties, as stored in chunks.
+		 */
+		typedef std::uint16_t     BlockStateID;
+		const static BlockStateID INVALID_STATE = 0xFFFF;
 
-			std::size_t m_patchedTextureWidth, m_patchedTextureHeight;
+		/**
+		 * @brief A property a block type can vary by, such as orientation,
+		 * growth stage or fluid level.
+		 */
+		struct BlockStateProperty
+		{
+			const char*  name;
+			std::uint8_t valueCount;
 		};
 
 		enum class BlockTypeCategory
@@ -98,6 +78,9 @@ namespace qz
 
 			BlockTypeCategory category;
 
+			/// @brief Whether solid blocks can be seen through, like glass.
+			bool transparent = false;
+
 			struct
 			{
 				BlockTextureAtlas::SpriteID top, bottom, left, right, front,
@@ -108,19 +91,293 @@ namespace qz
 					top = bottom = left = right = front = back = sprite;
 				}
 			} textures;
+
+			/// @brief The properties every placed block of this type has.
+			std::vector<BlockStateProperty> stateProperties;
+
+			/// @brief Assigned by the registry when the block is registered.
+			BlockID numericId = INVALID_BLOCK;
+
+			/**
+			 * @brief The first of the block's state IDs, with every property
+			 * at 0. Assigned by the registry when the block is registered.
+			 */
+			BlockStateID defaultState = INVALID_STATE;
+
+			/// @brief Assigned by the registry when the block is registered.
+			std::uint16_t stateCount = 0;
+		};
+
+		enum class BlockFace : std::uint8_t
+		{
+			TOP,
+			BOTTOM,
+			LEFT,
+			RIGHT,
+			FRONT,
+			BACK,
+
+			COUNT
+		};
+
+		/**
+		 * @brief Flat tables of the block properties hot loops ask about,
+		 * indexed by numeric block ID.
+		 *
+		 * Meshing, lighting and physics read these instead of chasing
+		 * BlockType pointers. Each flag is a bitset, so a cache line covers
+		 * 512 blocks, and every face of a block has its sprite and texture
+		 * coordinates stored next to each other.
+		 */
+		class BlockPropertyTable
+		{
+		public:
+			static constexpr std::size_t FACE_COUNT =
+			    static_cast<std::size_t>(BlockFace::COUNT);
+
+			/**
+			 * @brief Rebuilds the flags and sprites, texture coordinates are
+			 * cleared until bakeTextureCoordinates is called.
+			 */
+			void compile(const std::vector<BlockType*>& blocks);
+
+			/**
+			 * @brief Looks up the texture coordinates of every face, the atlas
+			 * must already be patched.
+			 */
+			void bakeTextureCoordinates(const BlockTextureAtlas& atlas);
+
+			bool isOpaque(BlockID block) const
+			{
+				return testBit(m_opaque, block);
+			}
+
+			bool isSolid(BlockID block) const
+			{
+				return testBit(m_solid, block);
+			}
+
+			bool isLiquid(BlockID block) const
+			{
+				return testBit(m_liquid, block);
+			}
+
+			BlockTextureAtlas::SpriteID getSprite(BlockID   block,
+			                                      BlockFace face) const
+			{
+				return m_sprites[getFaceIndex(block, face)];
+			}
+
+			const RectAABB& getTextureCoordinates(BlockID   block,
+			                                      BlockFace face) const
+			{
+				return m_textureCoordinates[getFaceIndex(block, face)];
+			}
+
+			std::size_t getBlockCount() const { return m_blockCount; }
+
+		private:
+			/// @brief One cache line worth of bits.
+			struct alignas(64) BitBlock
+			{
+				std::uint64_t words[8];
+			};
+
+			static bool testBit(const std::vector<BitBlock>& bits,
+			                    BlockID                      block)
+			{
+				// Unknown blocks, including INVALID_BLOCK, have no flags set.
+				if (block >= bits.size() * 512)
+					return false;
+
+				return (bits[block >> 9].words[(block >> 6) & 7] >>
+				        (block & 63)) &
+				       1;
+			}
+
+			static void setBit(std::vector<BitBlock>& bits, BlockID block)
+			{
+				bits[block >> 9].words[(block >> 6) & 7] |= std::uint64_t(1)
+				                                            << (block & 63);
+			}
+
+			static std::size_t getFaceIndex(BlockID block, BlockFace face)
+			{
+				return block * FACE_COUNT + static_cast<std::size_t>(face);
+			}
+
+		private:
+			std::size_t m_blockCount = 0;
+
+			std::vector<BitBlock> m_opaque;
+			std::vector<BitBlock> m_solid;
+			std::vector<BitBlock> m_liquid;
+
+			std::vector<BlockTextureAtlas::SpriteID> m_sprites;
+			std::vector<RectAABB>                    m_textureCoordinates;
 		};
 
+		/**
+		 * @brief Stores every block type, and maps their string and numeric
+		 * IDs onto them.
+		 *
+		 * Blocks are registered from a single thread, each getting the next
+		 * numeric ID. Once every block is registered the registry is frozen,
+		 * which builds a minimal lookup table from string IDs to numeric IDs
+		 * using a perfect hash. After that no more blocks can be registered
+		 * and every lookup is lock free and constant time, so any number of
+		 * threads may read from the registry.
+		 *
+		 * Each block also gets a contiguous range of state IDs, one for
+		 * every combination of its state property values. Property values
+		 * are read from state IDs through tables filled in at registration.
+		 */
 		class BlockRegistry : public utils::Singleton<BlockRegistry>
 		{
 		public:
+			BlockRegistry();
+
+			/**
+			 * @brief Registers a block, the registry must not be frozen.
+			 * @param blockInfo The block to register, its numeric ID is
+			 * ignored.
+			 * @return The registered block, or the already registered block
+			 * if the ID was taken.
+			 */
 			BlockType* registerBlock(BlockType blockInfo);
+
 			BlockType* getBlockFromID(const char* id);
 
+			BlockType* getBlockFromNumericID(BlockID id) const
+			{
+				return id < m_blocksByNumericID.size()
+				           ? m_blocksByNumericID[id]
+				           : nullptr;
+			}
+
+			BlockType* getBlockFromState(BlockStateID state) const
+			{
+				return state < m_stateBlocks.size()
+				           ? m_blocksByNumericID[m_stateBlocks[state]]
+				           : nullptr;
+			}
+
+			/**
+			 * @brief Finds the index of one of a block's state properties.
+			 * @return The index, or -1 if the block has no such property.
+			 */
+			int findStateProperty(BlockID block, const char* name) const;
+
+			/**
+			 * @brief Reads a property value from a state.
+			 * @param state A valid state ID.
+			 * @param property The index of the property within the block's
+			 * state properties.
+			 */
+			std::uint8_t getStateValue(BlockStateID state,
+			                           std::size_t  property) const
+			{
+				return m_stateValues[m_stateValueOffsets[state] + property];
+			}
+
+			/**
+			 * @brief Finds the state that differs from another only in one
+			 * property value.
+			 */
+			BlockStateID withStateValue(BlockStateID state,
+			                            std::size_t  property,
+			                            std::uint8_t value) const
+			{
+				const BlockID block = m_stateBlocks[state];
+				const int     delta = static_cast<int>(value) -
+				                  getStateValue(state, property);
+
+				return static_cast<BlockStateID>(
+				    state +
+				    delta * m_propertyStrides[m_propertyOffsets[block] +
+				                              property]);
+			}
+
+			std::size_t getStateCount() const { return m_stateBlocks.size(); }
+
+			/**
+			 * @brief Finds the numeric ID of a block.
+			 * @return The numeric ID, or INVALID_BLOCK if it isn't registered.
+			 */
+			BlockID getNumericID(const char* id) const;
+
+			/**
+			 * @brief Stops any further registration, builds the perfect
+			 * hash used for lookups from then on and compiles the property
+			 * tables.
+			 */
+			void freeze();
+			bool isFrozen() const
+			{
+				return m_frozen.load(std::memory_order_acquire);
+			}
+
+			std::size_t getBlockCount() const
+			{
+				return m_blocksByNumericID.size();
+			}
+
+			/**
+			 * @brief Gets the property tables, which are only filled in once
+			 * the registry is frozen.
+			 */
+			const BlockPropertyTable& getProperties() const
+			{
+				return m_properties;
+			}
+
+			/**
+			 * @brief Fills in the texture coordinates of the property tables.
+			 * Must be called after freezing, before any reader uses them.
+			 */
+			void bakeTextureCoordinates(const BlockTextureAtlas& atlas);
+
 		private:
 			// This is a std::list as we don't want to invalidate any pointers
 			// when resizing... #todo (bwilks): Maybe use HandleAllocator for
 			// this as well??
 			std::list<BlockType> m_blocks;
+
+			std::vector<BlockType*> m_blocksByNumericID;
+
+			/// @brief The block every state belongs to.
+			std::vector<BlockID> m_stateBlocks;
+
+			/**
+			 * @brief The values of every property of every state, the values
+			 * of a state start at its entry in m_stateValueOffsets.
+			 */
+			std::vector<std::uint8_t>  m_stateValues;
+			std::vector<std::uint32_t> m_stateValueOffsets;
+
+			/**
+			 * @brief How far apart the state IDs of consecutive values of a
+			 * property are, the strides of a block start at its entry in
+			 * m_propertyOffsets.
+			 */
+			std::vector<std::uint16_t> m_propertyStrides;
+			std::vector<std::uint32_t> m_propertyOffsets;
+
+			/// @brief Looks up string IDs until the registry is frozen.
+			std::unordered_map<std::string, BlockID> m_registrationLookup;
+
+			/// @brief The displacement for each bucket of the perfect hash.
+			std::vector<std::uint32_t> m_hashDisplacements;
+
+			/// @brief The numeric ID stored in each slot of the perfect hash.
+			std::vector<BlockID> m_hashSlots;
+
+			BlockPropertyTable m_properties;
+
+			std::atomic<bool> m_frozen;
+
+		private:
+			BlockID findFrozenID(const char* id) const;
 		};
 	} // namespace voxels
 } // namespace qz
@@ -0,0 +1,112 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <Quartz/Utilities/Threading/Coroutine.hpp>
+#include <Quartz/Voxels/Terrain.hpp>
+
+#if defined(QZ_COROUTINES_SUPPORTED)
+#	include <atomic>
+
+namespace qz
+{
+	namespace voxels
+	{
+		namespace detail
+		{
+			/**
+			 * @brief Waits for a chunk to complete generation, carrying on
+			 * on the thread that completes it. Gives null if the chunk is
+			 * unloaded instead.
+			 */
+			class ChunkCompletion
+			{
+			public:
+				ChunkCompletion(Terrain& terrain, const Vector3i& position)
+				    : m_terrain(terrain), m_position(position)
+				{
+				}
+
+				bool await_ready() const { return false; }
+
+				bool await_suspend(std::coroutine_handle<> handle)
+				{
+					m_handle = handle;
+
+					m_terrain.whenComplete(m_position, [this](Chunk* chunk) {
+						m_chunk = chunk;
+
+						if (m_done.exchange(true))
+							m_handle.resume();
+					});
+
+					// The callback may run before or during whenComplete,
+					// whichever side gets here second resumes.
+					return !m_done.exchange(true);
+				}
+
+				Chunk* await_resume() const { return m_chunk; }
+
+			private:
+				Terrain&                m_terrain;
+				Vector3i                m_position;
+				std::coroutine_handle<> m_handle;
+				Chunk*                  m_chunk = nullptr;
+				std::atomic<bool>       m_done {false};
+			};
+		} // namespace detail
+
+		/**
+		 * @brief Generates a chunk on the executor and finishes there once
+		 * the chunk has completed generation, so a coroutine can request a
+		 * chunk and then hop to wherever it is integrated.
+		 *
+		 * A chunk already being generated by another thread is waited for
+		 * without blocking the executor.
+		 * @return The chunk, in the COMPLETE stage, or null if it was
+		 * unloaded before the request saw it complete.
+		 */
+		template <typename Executor>
+		utils::threading::Async<Chunk*> requestChunk(Terrain&  terrain,
+		                                             Vector3i  position,
+		                                             Executor& executor)
+		{
+			co_await utils::threading::resumeOn(executor);
+			terrain.generateChunk(position);
+
+			Chunk* chunk =
+			    co_await detail::ChunkCompletion(terrain, position);
+
+			co_await utils::threading::resumeOn(executor);
+			co_return chunk;
+		}
+	} // namespace voxels
+} // namespace qz
+#endif
@@ -0,0 +1,86 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <Quartz/Voxels/Terrain.hpp>
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+
+namespace qz
+{
+	namespace voxels
+	{
+		/**
+		 * @brief Reads and writes chunks in the on-disk save format.
+		 *
+		 * A chunk is stored as a small header, a palette of the block states
+		 * it uses, and the run length encoded palette indices of its voxels.
+		 * Palette entries are a block's string ID and the offset of the
+		 * state within the block's states, version 1 files had no offsets.
+		 * All values are little endian.
+		 */
+		class ChunkSerializer
+		{
+		public:
+			/// @brief "QZCK" in little endian.
+			static constexpr std::uint32_t MAGIC   = 0x4B435A51;
+			static constexpr std::uint16_t VERSION = 2;
+
+			/**
+			 * @brief Writes a chunk to a stream.
+			 * @param stream The stream to write to, opened in binary mode.
+			 * @param chunk The chunk to write, must have been filled.
+			 * @return True if the whole chunk was written.
+			 */
+			static bool write(std::ostream& stream, const Chunk& chunk);
+
+			/**
+			 * @brief Reads a chunk from a stream.
+			 *
+			 * Blocks are resolved through the BlockRegistry, so every block
+			 * the chunk was saved with must already be registered. The chunk
+			 * is marked as completely generated.
+			 *
+			 * @param stream The stream to read from, opened in binary mode.
+			 * @param chunk The chunk to read into, its position and size are
+			 * replaced by those stored in the stream.
+			 * @return True if a valid chunk was read.
+			 */
+			static bool read(std::istream& stream, Chunk& chunk);
+
+			/**
+			 * @brief The file name used to save the chunk at a position.
+			 */
+			static std::string getFilename(const Vector3i& position);
+		};
+	} // namespace voxels
+} // namespace qz
@@ -0,0 +1,266 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace qz
+{
+	namespace utils
+	{
+		namespace threading
+		{
+			class ThreadPool;
+		}
+	} // namespace utils
+
+	namespace voxels
+	{
+		/**
+		 * @brief A rectangular grid of heights, stored row by row.
+		 */
+		class Heightmap
+		{
+		public:
+			Heightmap() : m_width(0), m_height(0) {}
+			Heightmap(std::size_t width, std::size_t height)
+			    : m_width(width), m_height(height), m_data(width * height)
+			{
+			}
+
+			float& at(std::size_t x, std::size_t y)
+			{
+				return m_data[x + y * m_width];
+			}
+
+			float at(std::size_t x, std::size_t y) const
+			{
+				return m_data[x + y * m_width];
+			}
+
+			std::size_t getWidth() const { return m_width; }
+			std::size_t getHeight() const { return m_height; }
+
+			std::vector<float>&       getData() { return m_data; }
+			const std::vector<float>& getData() const { return m_data; }
+
+		private:
+			std::size_t        m_width, m_height;
+			std::vector<float> m_data;
+		};
+
+		struct ErosionSettings
+		{
+			/// @brief Droplets simulated for every cell of the heightmap.
+			float dropletsPerCell = 0.5f;
+
+			/// @brief The maximum number of steps a droplet takes.
+			std::size_t dropletLifetime = 30;
+
+			/// @brief How much a droplet keeps its direction, from 0 to 1.
+			float inertia = 0.05f;
+
+			float sedimentCapacityFactor = 4.f;
+			float minSedimentCapacity    = 0.01f;
+			float erodeSpeed             = 0.3f;
+			float depositSpeed           = 0.3f;
+			float evaporateSpeed         = 0.01f;
+			float gravity                = 4.f;
+
+			/// @brief The radius of the brush a droplet erodes with.
+			int erosionRadius = 3;
+
+			std::size_t thermalIterations = 10;
+
+			/// @brief The height difference between neighbouring cells that
+			/// material starts sliding down at.
+			float talus = 1.2f;
+
+			/// @brief The share of the excess height moved per iteration,
+			/// must be at most 0.25 to stay stable.
+			float thermalRate = 0.2f;
+
+			/**
+			 * @brief The size of the tiles the hydraulic pass is split into.
+			 *
+			 * Droplets spawned in a tile may wander half a tile beyond it,
+			 * further movement ends the droplet.
+			 */
+			std::size_t tileSize = 64;
+		};
+
+		/**
+		 * @brief Simulates hydraulic and thermal erosion on a heightmap.
+		 *
+		 * The hydraulic pass drops water droplets that carry sediment
+		 * downhill. The map is split into tiles, each tile owning a halo of
+		 * half a tile around it that its droplets can reach. Tiles are run in
+		 * four phases in a 2x2 checkerboard, so the tiles of a phase never
+		 * share any cells and can run in parallel, and the halos are handed
+		 * over to the next phase through the shared map. Every tile seeds its
+		 * own random generator, so the result only depends on the seed and
+		 * not on the number of threads.
+		 *
+		 * The thermal pass moves material from cells steeper than the talus
+		 * onto their lower neighbours, reading the previous iteration and
+		 * writing the next one, which is just as deterministic.
+		 */
+		class ErosionSimulator
+		{
+		public:
+			explicit ErosionSimulator(const ErosionSettings& settings);
+
+			/**
+			 * @brief Runs the hydraulic pass followed by the thermal pass.
+			 * @param map The heightmap to erode, in place.
+			 * @param seed The seed for the droplet positions.
+			 * @param pool The pool to run tiles on, or nullptr to run on the
+			 * calling thread. The calling thread runs tiles as well while it
+			 * waits, so this may be called from one of the pool's workers.
+			 */
+			void erode(Heightmap& map, std::uint32_t seed,
+			           utils::threading::ThreadPool* pool = nullptr) const;
+
+			void erodeHydraulic(Heightmap& map, std::uint32_t seed,
+			                    utils::threading::ThreadPool* pool) const;
+			void erodeThermal(Heightmap&                    map,
+			                  utils::threading::ThreadPool* pool) const;
+
+			/**
+			 * @brief A hash of every setting, for keying cached results.
+			 */
+			std::uint64_t getSettingsHash() const;
+
+			const ErosionSettings& getSettings() const { return m_settings; }
+
+		private:
+			struct BrushCell
+			{
+				int   x, y;
+				float weight;
+			};
+
+			ErosionSettings        m_settings;
+			std::vector<BrushCell> m_brush;
+
+		private:
+			void erodeTile(Heightmap& map, std::size_t tileX, std::size_t tileY,
+			               std::uint32_t seed) const;
+		};
+
+		/**
+		 * @brief Provides eroded heights for an unbounded world, one region
+		 * at a time.
+		 *
+		 * Regions are generated from a height function with a border around
+		 * them (so erosion near the edges still sees the neighbouring slopes),
+		 * eroded, cropped and kept in memory. If a cache directory is set,
+		 * eroded regions are also written to disk and loaded from there, so
+		 * the erosion is only ever paid once per region.
+		 */
+		class ErodedRegionCache
+		{
+		public:
+			/// @brief Provides the uneroded height at a world position.
+			typedef std::function<float(int, int)> HeightFunction;
+
+			/**
+			 * @param heightFunction The source of the uneroded heights.
+			 * @param settings The erosion settings.
+			 * @param seed The world seed.
+			 * @param cacheDirectory An existing directory to cache regions
+			 * in, or an empty string to keep them in memory only. Changing the
+			 * height function needs a new directory, as it isn't part of the
+			 * cache key.
+			 * @param pool The pool to erode regions on, must not be a pool
+			 * whose workers call getHeight. A worker helping out while it
+			 * loads a region could pick up a task waiting on the same region,
+			 * which would never finish.
+			 */
+			ErodedRegionCache(const HeightFunction&         heightFunction,
+			                  const ErosionSettings&        settings,
+			                  std::uint32_t                 seed,
+			                  const std::string&            cacheDirectory,
+			                  utils::threading::ThreadPool* pool = nullptr);
+
+			/**
+			 * @brief Gets the eroded height at a world position, generating
+			 * its region if needed. Safe to call from many threads.
+			 */
+			float getHeight(int x, int z);
+
+			/**
+			 * @brief Gets the eroded heights of a rectangle, row by row,
+			 * looking up every region it covers only once. Prefer this over
+			 * getHeight for anything larger than a few positions, as every
+			 * lookup goes through a shared lock.
+			 * @param heights Receives width * depth heights.
+			 */
+			void getHeights(int originX, int originZ, std::size_t width,
+			                std::size_t depth, float* heights);
+
+			static constexpr std::size_t REGION_SIZE   = 512;
+			static constexpr std::size_t REGION_BORDER = 32;
+
+		private:
+			struct Region
+			{
+				std::once_flag loaded;
+				Heightmap      heights;
+			};
+
+			HeightFunction                m_heightFunction;
+			ErosionSimulator              m_simulator;
+			std::uint32_t                 m_seed;
+			std::string                   m_cacheDirectory;
+			utils::threading::ThreadPool* m_pool;
+
+			std::mutex m_mutex;
+			std::unordered_map<std::uint64_t, std::shared_ptr<Region>>
+			    m_regions;
+
+		private:
+			/// @brief Finds a region, loading it on first use. Regions
+			/// stay alive as long as the cache does.
+			const Region& acquireRegion(int regionX, int regionZ);
+
+			void        loadRegion(Region& region, int regionX, int regionZ);
+			std::string getRegionPath(int regionX, int regionZ) const;
+			bool        readRegion(const std::string& path, Heightmap& map);
+			void writeRegion(const std::string& path, const Heightmap& map);
+		};
+	} // namespace voxels
+} // namespace qz
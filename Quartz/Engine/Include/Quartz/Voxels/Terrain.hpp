@@ -29,42 +29,388 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 #include <functional>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 
 #include <Quartz/Math/Math.hpp>
+#include <Quartz/Voxels/BlockEntities.hpp>
 #include <Quartz/Voxels/Blocks.hpp>
 
 namespace qz
 {
+	namespace utils
+	{
+		namespace threading
+		{
+			class ThreadPool;
+		}
+	} // namespace utils
+
 	namespace voxels
 	{
+		/**
+		 * @brief The stages a chunk passes through while being generated.
+		 *
+		 * Stages are strictly ordered, a chunk that has reached a stage has
+		 * also completed every stage before it.
+		 */
+		enum class GenerationStage : std::uint8_t
+		{
+			EMPTY,
+			TERRAIN,
+			STRUCTURES,
+			COMPLETE
+		};
+
+		/**
+		 * @brief A block write waiting for its chunk to reach a generation
+		 * stage.
+		 */
+		struct PendingBlock
+		{
+			/// @brief The index of the voxel within the target chunk.
+			std::uint32_t index;
+
+			/// @brief The stage after which the write should be applied.
+			GenerationStage stage;
+
+			BlockStateID state;
+		};
+
+		class Chunk;
+
+		/**
+		 * @brief Holds the block writes destined for a chunk that has not yet
+		 * reached the stage they belong to.
+		 */
+		class PendingBlockQueue
+		{
+		public:
+			void push(const PendingBlock& block) { m_blocks.push_back(block); }
+
+			/**
+			 * @brief Writes every queued block belonging to a stage into the
+			 * chunk and removes them from the queue.
+			 * @param chunk The chunk the queue belongs to.
+			 * @param stage The stage the chunk has just completed.
+			 */
+			void apply(Chunk& chunk, GenerationStage stage);
+
+			/**
+			 * @brief Moves every block from another queue into this one.
+			 * @param other The queue to take the blocks from.
+			 */
+			void merge(PendingBlockQueue&& other);
+
+			bool        empty() const { return m_blocks.empty(); }
+			std::size_t size() const { return m_blocks.size(); }
+
+			const std::vector<PendingBlock>& getBlocks() const
+			{
+				return m_blocks;
+			}
+
+		private:
+			std::vector<PendingBlock> m_blocks;
+		};
+
+		/**
+		 * @brief Hashes integer chunk positions for use in unordered
+		 * containers.
+		 */
+		struct ChunkPosHash
+		{
+			std::size_t operator()(const Vector3i& pos) const
+			{
+				// Large primes from "Optimized Spatial Hashing for Collision
+				// Detection of Deformable Objects" (Teschner et al.)
+				return static_cast<std::size_t>(pos.x) * 73856093u ^
+				       static_cast<std::size_t>(pos.y) * 19349663u ^
+				       static_cast<std::size_t>(pos.z) * 83492791u;
+			}
+		};
+
 		class Chunk
 		{
 		public:
-			typedef std::function<BlockType*(std::size_t, std::size_t,
-			                                 std::size_t)>
-			    GeneratorFunction;
+			/**
+			 * @brief Generates the block at a position, given in world space
+			 * block coordinates. Returned blocks must be registered.
+			 */
+			typedef std::function<BlockType*(int, int, int)> GeneratorFunction;
 
 		private:
-			std::vector<BlockType*> m_voxelData;
+			Vector3i                  m_position;
+			std::size_t               m_chunkSize;
+			GenerationStage           m_stage;
+
+			/// @brief Unloaded while generating, so dropped once complete.
+			bool m_unloadRequested;
+
+			std::vector<BlockStateID> m_voxelData;
+			PendingBlockQueue         m_pendingBlocks;
+			BlockEntityStorage        m_blockEntities;
+
+			friend class Terrain;
+			friend class ChunkSerializer;
+
+		public:
+			/**
+			 * @brief Constructs an empty chunk.
+			 * @param position The position of the chunk, in chunks.
+			 * @param chunkSize The number of blocks along each axis.
+			 */
+			Chunk(const Vector3i& position, std::size_t chunkSize);
+
+			/**
+			 * @brief Fills every voxel of the chunk using a generator.
+			 * @param generator The function providing the block for each voxel.
+			 * @param pool Optionally fills slabs of the chunk in parallel, the
+			 * generator must then be thread safe.
+			 */
+			void fill(const Chunk::GeneratorFunction& generator,
+			          utils::threading::ThreadPool*   pool = nullptr);
+
+			BlockType* getBlockAt(std::size_t x, std::size_t y,
+			                      std::size_t z) const;
+			void setBlockAt(std::size_t x, std::size_t y, std::size_t z,
+			                BlockType* block);
+
+			BlockType* getBlockAt(std::size_t index) const
+			{
+				return BlockRegistry::get()->getBlockFromState(
+				    m_voxelData[index]);
+			}
+
+			/**
+			 * @brief Places a block in its default state.
+			 */
+			void setBlockAt(std::size_t index, BlockType* block)
+			{
+				m_voxelData[index] =
+				    block == nullptr ? INVALID_STATE : block->defaultState;
+			}
+
+			BlockStateID getStateAt(std::size_t index) const
+			{
+				return m_voxelData[index];
+			}
+
+			void setStateAt(std::size_t index, BlockStateID state)
+			{
+				m_voxelData[index] = state;
+			}
+
+			const Vector3i& getPosition() const { return m_position; }
+			std::size_t     getChunkSize() const { return m_chunkSize; }
+			GenerationStage getStage() const { return m_stage; }
 
+			const PendingBlockQueue& getPendingBlocks() const
+			{
+				return m_pendingBlocks;
+			}
+
+			/**
+			 * @brief Gets the block entities of the chunk, keyed by voxel
+			 * index. Replacing a block does not remove its block entity.
+			 */
+			BlockEntityStorage& getBlockEntities() { return m_blockEntities; }
+
+			const BlockEntityStorage& getBlockEntities() const
+			{
+				return m_blockEntities;
+			}
+		};
+
+		class Terrain;
+
+		/**
+		 * @brief Places the blocks of a structure on behalf of a chunk.
+		 *
+		 * Blocks landing inside the chunk being generated are written
+		 * directly, blocks landing in other chunks are routed through the
+		 * terrain so that they end up in that chunk's pending queue if the
+		 * chunk has not been generated yet. Structure generation never causes
+		 * another chunk to be loaded.
+		 */
+		class StructurePlacer
+		{
 		public:
-			void fill(const std::size_t               chunkSize,
-			          const Chunk::GeneratorFunction& generator);
+			StructurePlacer(Terrain& terrain, Chunk& chunk);
+
+			/**
+			 * @brief Places a block at a world space block position.
+			 */
+			void setBlock(int x, int y, int z, BlockType* block);
+
+			/**
+			 * @brief Places a block state at a world space block position.
+			 */
+			void setBlockState(int x, int y, int z, BlockStateID state);
+
+			const Chunk& getChunk() const { return m_chunk; }
+
+		private:
+			Terrain& m_terrain;
+			Chunk&   m_chunk;
+		};
+
+		/**
+		 * @brief Places structures whose origin lies within a chunk, may
+		 * write blocks beyond the chunk's borders.
+		 */
+		typedef std::function<void(const Chunk&, StructurePlacer&)>
+		    StructureGenerator;
+
+		/**
+		 * @brief How long a chunk spent in each generation stage, in
+		 * microseconds.
+		 */
+		struct GenerationTimings
+		{
+			std::uint64_t terrain;
+			std::uint64_t structures;
 		};
 
+		/**
+		 * @brief Owns the loaded chunks and drives them through generation.
+		 *
+		 * Chunks may be generated from several threads at once, every access
+		 * to the chunk map and the pending queues is guarded by the terrain's
+		 * mutex while the expensive stages run unlocked.
+		 */
 		class Terrain
 		{
 		private:
-			std::size_t              m_chunkSize;
-			Chunk::GeneratorFunction m_generatorFunction;
-			std::vector<Chunk>       m_loadedChunks;
+			typedef std::unordered_map<Vector3i, Chunk, ChunkPosHash> ChunkMap;
+			typedef std::unordered_map<Vector3i, PendingBlockQueue,
+			                           ChunkPosHash>
+			    PendingMap;
+
+		public:
+			/// @brief Receives a chunk once it has finished generating, or
+			/// null if it was unloaded first.
+			typedef std::function<void(Chunk*)> CompletionCallback;
+
+		private:
+			typedef std::unordered_map<Vector3i,
+			                           std::vector<CompletionCallback>,
+			                           ChunkPosHash>
+			    CompletionMap;
+
+			std::size_t                     m_chunkSize;
+			Chunk::GeneratorFunction        m_generatorFunction;
+			std::vector<StructureGenerator> m_structureGenerators;
+			ChunkMap                        m_loadedChunks;
+
+			/// @brief Writes destined for chunks that aren't loaded yet.
+			PendingMap m_pendingBlocks;
+
+			/// @brief Callbacks waiting for chunks to complete generation.
+			CompletionMap m_completionCallbacks;
+
+			utils::threading::ThreadPool* m_fillPool = nullptr;
+
+			mutable std::mutex m_mutex;
+
+		private:
+			/**
+			 * @brief Drops a loaded chunk, handing its queued writes back
+			 * to the terrain. Expects the mutex to be held.
+			 */
+			void eraseChunk(ChunkMap::iterator chunk);
 
 		public:
 			Terrain(std::size_t                     chunkSize,
 			        const Chunk::GeneratorFunction& generator);
 
+			void addStructureGenerator(const StructureGenerator& generator);
+
+			/**
+			 * @brief Spreads the filling of each chunk across a pool, which
+			 * needs a thread safe generator. Null fills on the generating
+			 * thread, which is the default.
+			 */
+			void setFillPool(utils::threading::ThreadPool* pool)
+			{
+				m_fillPool = pool;
+			}
+
+			/**
+			 * @brief Loads a chunk and runs it through every generation
+			 * stage, applying any blocks queued for it by its neighbours.
+			 * @param position The position of the chunk, in chunks.
+			 * @param timings Optionally receives the time spent per stage.
+			 * @return The generated chunk, or the existing one if the chunk is
+			 * already loaded (which might still be generating on another
+			 * thread). Null if the chunk was unloaded while generating.
+			 */
+			Chunk* generateChunk(const Vector3i&    position,
+			                     GenerationTimings* timings = nullptr);
+
+			Chunk* getChunk(const Vector3i& position);
+
+			/**
+			 * @brief Calls back once the chunk at a position has completed
+			 * generation.
+			 *
+			 * The callback runs straight away on the calling thread if the
+			 * chunk is already complete, otherwise on the thread that
+			 * completes it, after the terrain's mutex has been released.
+			 * This never loads a chunk, if the chunk isn't loaded the
+			 * callback is given null straight away.
+			 */
+			void whenComplete(const Vector3i&    position,
+			                  CompletionCallback callback);
+
+			/**
+			 * @brief Unloads a chunk. Writes that arrive for it afterwards are
+			 * queued as if it had never been generated.
+			 *
+			 * A chunk that is still generating is only marked, and unloaded
+			 * by its generating thread once it completes.
+			 */
+			void unloadChunk(const Vector3i& position);
+
+			/**
+			 * @brief Writes a block at a world space position once its chunk
+			 * has completed a generation stage.
+			 *
+			 * The block is written immediately if the chunk has finished
+			 * generating, otherwise it is queued on the chunk (or on the
+			 * terrain, if the chunk isn't loaded) and applied once the chunk
+			 * completes the stage. This never loads a chunk.
+			 */
+			void setBlock(int x, int y, int z, BlockType* block,
+			              GenerationStage stage);
+
+			/**
+			 * @brief Writes a block state, in the same way as setBlock.
+			 */
+			void setBlockState(int x, int y, int z, BlockStateID state,
+			                   GenerationStage stage);
+
+			/**
+			 * @brief Converts a world space block position into the position
+			 * of the chunk containing it.
+			 */
+			Vector3i worldToChunk(int x, int y, int z) const;
+
+			std::size_t getChunkSize() const { return m_chunkSize; }
+
+			/**
+			 * @brief The number of chunks that have writes waiting for them
+			 * while not being loaded.
+			 */
+			std::size_t getPendingChunkCount() const;
+
+			/**
+			 * @brief Ticks the block entities of every generated chunk. Must
+			 * not run at the same time as unloadChunk.
+			 */
 			void tick(Vector3 streamCenter);
 		};
 
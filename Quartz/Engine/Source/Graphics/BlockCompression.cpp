@@ -0,0 +1,640 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <Quartz/Graphics/BlockCompression.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+// QZ_BLOCK_COMPRESSION_NO_SIMD forces the scalar path, so tests can check
+// that both produce the same blocks.
+#if !defined(QZ_BLOCK_COMPRESSION_NO_SIMD) && \
+    (defined(__SSE2__) || defined(_M_X64) || \
+     (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#	define QZ_BLOCK_COMPRESSION_SSE2
+#	include <emmintrin.h>
+#endif
+
+using namespace qz::gfx;
+
+namespace
+{
+	constexpr int TEXEL_COUNT = 16;
+
+	/// @brief Alpha below this is transparent in BC1.
+	constexpr int ALPHA_THRESHOLD = 128;
+
+	struct Color
+	{
+		int r, g, b;
+	};
+
+	/**
+	 * @brief The endpoints of a colour block, with the palette a decoder
+	 * builds from them.
+	 */
+	struct ColorBlock
+	{
+		std::uint16_t endpoints[2];
+		Color         palette[4];
+		std::uint8_t  indices[TEXEL_COUNT];
+	};
+
+	std::uint16_t toRGB565(const Color& color)
+	{
+		return static_cast<std::uint16_t>(((color.r * 31 + 127) / 255) << 11 |
+		                                  ((color.g * 63 + 127) / 255) << 5 |
+		                                  ((color.b * 31 + 127) / 255));
+	}
+
+	Color fromRGB565(std::uint16_t value)
+	{
+		const int r = value >> 11;
+		const int g = (value >> 5) & 0x3F;
+		const int b = value & 0x1F;
+
+		return {(r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2)};
+	}
+
+	int clampChannel(std::int64_t value)
+	{
+		return static_cast<int>(std::min<std::int64_t>(
+		    255, std::max<std::int64_t>(0, value)));
+	}
+
+	/// @brief Divides, rounding to the nearest, for a positive divisor.
+	std::int64_t divideRounded(std::int64_t numerator, std::int64_t divisor)
+	{
+		return numerator >= 0 ? (numerator + divisor / 2) / divisor
+		                      : -((divisor / 2 - numerator) / divisor);
+	}
+
+	int getDistance(const Color& a, const std::uint8_t* texel)
+	{
+		const int r = a.r - texel[0];
+		const int g = a.g - texel[1];
+		const int b = a.b - texel[2];
+
+		return r * r + g * g + b * b;
+	}
+
+	/**
+	 * @brief Fills in the palette of a block from its endpoints, the way a
+	 * decoder would.
+	 */
+	void buildPalette(ColorBlock& block)
+	{
+		const Color& a = block.palette[0] = fromRGB565(block.endpoints[0]);
+		const Color& b = block.palette[1] = fromRGB565(block.endpoints[1]);
+
+		if (block.endpoints[0] > block.endpoints[1])
+		{
+			block.palette[2] = {(2 * a.r + b.r) / 3, (2 * a.g + b.g) / 3,
+			                    (2 * a.b + b.b) / 3};
+			block.palette[3] = {(a.r + 2 * b.r) / 3, (a.g + 2 * b.g) / 3,
+			                    (a.b + 2 * b.b) / 3};
+		}
+		else
+		{
+			block.palette[2] = {(a.r + b.r) / 2, (a.g + b.g) / 2,
+			                    (a.b + b.b) / 2};
+			block.palette[3] = {0, 0, 0};
+		}
+	}
+
+	/**
+	 * @brief Finds the inset bounding box of some texels, with its corners
+	 * swapped onto the diagonal the colours lie along.
+	 */
+	void findEndpoints(const std::uint8_t* texels, const bool* included,
+	                   Color& high, Color& low)
+	{
+		int minimum[3] = {255, 255, 255};
+		int maximum[3] = {0, 0, 0};
+		int count      = 0;
+
+#ifdef QZ_BLOCK_COMPRESSION_SSE2
+		if (included == nullptr)
+		{
+			__m128i lowest  = _mm_set1_epi8(-1);
+			__m128i highest = _mm_setzero_si128();
+
+			for (int row = 0; row < 4; ++row)
+			{
+				const __m128i texel = _mm_loadu_si128(
+				    reinterpret_cast<const __m128i*>(texels + row * 16));
+
+				lowest  = _mm_min_epu8(lowest, texel);
+				highest = _mm_max_epu8(highest, texel);
+			}
+
+			lowest  = _mm_min_epu8(lowest, _mm_srli_si128(lowest, 8));
+			lowest  = _mm_min_epu8(lowest, _mm_srli_si128(lowest, 4));
+			highest = _mm_max_epu8(highest, _mm_srli_si128(highest, 8));
+			highest = _mm_max_epu8(highest, _mm_srli_si128(highest, 4));
+
+			const int lowBits  = _mm_cvtsi128_si32(lowest);
+			const int highBits = _mm_cvtsi128_si32(highest);
+
+			for (int c = 0; c < 3; ++c)
+			{
+				minimum[c] = (lowBits >> (c * 8)) & 0xFF;
+				maximum[c] = (highBits >> (c * 8)) & 0xFF;
+			}
+
+			count = TEXEL_COUNT;
+		}
+		else
+#endif
+		{
+			for (int i = 0; i < TEXEL_COUNT; ++i)
+			{
+				if (included != nullptr && !included[i])
+					continue;
+
+				for (int c = 0; c < 3; ++c)
+				{
+					minimum[c] = std::min(minimum[c], int(texels[i * 4 + c]));
+					maximum[c] = std::max(maximum[c], int(texels[i * 4 + c]));
+				}
+
+				++count;
+			}
+		}
+
+		if (count == 0)
+		{
+			high = low = {0, 0, 0};
+			return;
+		}
+
+		// The widest channel decides which way the others run.
+		int reference = 0;
+		for (int c = 1; c < 3; ++c)
+		{
+			if (maximum[c] - minimum[c] >
+			    maximum[reference] - minimum[reference])
+			{
+				reference = c;
+			}
+		}
+
+		int center[3];
+		for (int c = 0; c < 3; ++c)
+			center[c] = minimum[c] + maximum[c];
+
+		int covariance[3] = {0, 0, 0};
+		for (int i = 0; i < TEXEL_COUNT; ++i)
+		{
+			if (included != nullptr && !included[i])
+				continue;
+
+			const int along = texels[i * 4 + reference] * 2 - center[reference];
+			for (int c = 0; c < 3; ++c)
+				covariance[c] += along * (texels[i * 4 + c] * 2 - center[c]);
+		}
+
+		int highest[3], lowest[3];
+		for (int c = 0; c < 3; ++c)
+		{
+			// Pulling the corners in by 1/16 of the range lowers the error of
+			// the interpolated colours, which is where most texels land.
+			const int inset = (maximum[c] - minimum[c]) / 16;
+
+			highest[c] = maximum[c] - inset;
+			lowest[c]  = minimum[c] + inset;
+
+			if (covariance[c] < 0)
+				std::swap(highest[c], lowest[c]);
+		}
+
+		high = {highest[0], highest[1], highest[2]};
+		low  = {lowest[0], lowest[1], lowest[2]};
+	}
+
+	/**
+	 * @brief Picks the nearest of 4 interpolated colours for each texel, by
+	 * projecting onto the line between the endpoints.
+	 */
+	void selectIndices(const std::uint8_t* texels, ColorBlock& block)
+	{
+		const Color* palette = block.palette;
+
+		const int direction[3] = {palette[0].r - palette[1].r,
+		                          palette[0].g - palette[1].g,
+		                          palette[0].b - palette[1].b};
+
+		int stops[4];
+		for (int i = 0; i < 4; ++i)
+		{
+			stops[i] = palette[i].r * direction[0] +
+			           palette[i].g * direction[1] +
+			           palette[i].b * direction[2];
+		}
+
+		// Halfway between neighbouring colours along the line, doubled to
+		// stay in integers. The order along the line is 1, 3, 2, 0.
+		const int toFirst  = stops[0] + stops[2];
+		const int toThird  = stops[2] + stops[3];
+		const int toFourth = stops[3] + stops[1];
+
+#ifdef QZ_BLOCK_COMPRESSION_SSE2
+		const __m128i weights = _mm_setr_epi16(
+		    static_cast<short>(direction[0]), static_cast<short>(direction[1]),
+		    static_cast<short>(direction[2]), 0,
+		    static_cast<short>(direction[0]), static_cast<short>(direction[1]),
+		    static_cast<short>(direction[2]), 0);
+
+		const __m128i zero = _mm_setzero_si128();
+
+		for (int row = 0; row < 4; ++row)
+		{
+			const __m128i texel = _mm_loadu_si128(
+			    reinterpret_cast<const __m128i*>(texels + row * 16));
+
+			// Each product pairs red and green, then blue and nothing, for
+			// two texels at a time.
+			const __m128 first = _mm_castsi128_ps(
+			    _mm_madd_epi16(_mm_unpacklo_epi8(texel, zero), weights));
+			const __m128 second = _mm_castsi128_ps(
+			    _mm_madd_epi16(_mm_unpackhi_epi8(texel, zero), weights));
+
+			const __m128i dots = _mm_add_epi32(
+			    _mm_castps_si128(
+			        _mm_shuffle_ps(first, second, _MM_SHUFFLE(2, 0, 2, 0))),
+			    _mm_castps_si128(
+			        _mm_shuffle_ps(first, second, _MM_SHUFFLE(3, 1, 3, 1))));
+
+			const __m128i doubled = _mm_slli_epi32(dots, 1);
+
+			const __m128i aboveFirst =
+			    _mm_cmpgt_epi32(doubled, _mm_set1_epi32(toFirst));
+			const __m128i aboveThird =
+			    _mm_cmpgt_epi32(doubled, _mm_set1_epi32(toThird));
+			const __m128i aboveFourth =
+			    _mm_cmpgt_epi32(doubled, _mm_set1_epi32(toFourth));
+
+			// Chosen in the same order as the scalar comparisons below.
+			__m128i index = _mm_or_si128(
+			    _mm_and_si128(aboveFourth, _mm_set1_epi32(3)),
+			    _mm_andnot_si128(aboveFourth, _mm_set1_epi32(1)));
+			index = _mm_or_si128(_mm_and_si128(aboveThird, _mm_set1_epi32(2)),
+			                     _mm_andnot_si128(aboveThird, index));
+			index = _mm_andnot_si128(aboveFirst, index);
+
+			alignas(16) std::int32_t chosen[4];
+			_mm_store_si128(reinterpret_cast<__m128i*>(chosen), index);
+
+			for (int i = 0; i < 4; ++i)
+			{
+				block.indices[row * 4 + i] =
+				    static_cast<std::uint8_t>(chosen[i]);
+			}
+		}
+#else
+		for (int i = 0; i < TEXEL_COUNT; ++i)
+		{
+			const std::uint8_t* texel = texels + i * 4;
+
+			const int doubled = (texel[0] * direction[0] +
+			                     texel[1] * direction[1] +
+			                     texel[2] * direction[2]) *
+			                    2;
+
+			block.indices[i] = doubled > toFirst
+			                       ? 0
+			                       : doubled > toThird
+			                             ? 2
+			                             : doubled > toFourth ? 3 : 1;
+		}
+#endif
+	}
+
+	/// @brief Gets the squared error of a block against its texels.
+	int getError(const std::uint8_t* texels, const ColorBlock& block)
+	{
+		int error = 0;
+		for (int i = 0; i < TEXEL_COUNT; ++i)
+		{
+			error +=
+			    getDistance(block.palette[block.indices[i]], texels + i * 4);
+		}
+
+		return error;
+	}
+
+	/**
+	 * @brief Sets the endpoints of a 4 colour block and picks its indices.
+	 */
+	void encodeOpaque(const std::uint8_t* texels, const Color& high,
+	                  const Color& low, ColorBlock& block)
+	{
+		block.endpoints[0] = toRGB565(high);
+		block.endpoints[1] = toRGB565(low);
+
+		// The first endpoint has to be larger for the 4 colour mode. Equal
+		// endpoints can't be, but then every texel is the first colour.
+		if (block.endpoints[0] < block.endpoints[1])
+			std::swap(block.endpoints[0], block.endpoints[1]);
+
+		buildPalette(block);
+
+		if (block.endpoints[0] == block.endpoints[1])
+			std::memset(block.indices, 0, sizeof(block.indices));
+		else
+			selectIndices(texels, block);
+	}
+
+	/**
+	 * @brief Fits the endpoints that best reproduce the texels for the
+	 * current indices, by least squares.
+	 * @return False if every texel uses the same endpoint.
+	 */
+	bool refitEndpoints(const std::uint8_t* texels, const ColorBlock& block,
+	                    Color& high, Color& low)
+	{
+		// Thirds of the first endpoint that each index blends in.
+		constexpr int WEIGHTS[4] = {3, 0, 2, 1};
+
+		std::int64_t highHigh = 0, lowLow = 0, highLow = 0;
+		std::int64_t highSum[3] = {0, 0, 0};
+		std::int64_t lowSum[3]  = {0, 0, 0};
+
+		for (int i = 0; i < TEXEL_COUNT; ++i)
+		{
+			const int a = WEIGHTS[block.indices[i]];
+			const int b = 3 - a;
+
+			highHigh += a * a;
+			lowLow += b * b;
+			highLow += a * b;
+
+			for (int c = 0; c < 3; ++c)
+			{
+				highSum[c] += a * texels[i * 4 + c];
+				lowSum[c] += b * texels[i * 4 + c];
+			}
+		}
+
+		const std::int64_t determinant = highHigh * lowLow - highLow * highLow;
+		if (determinant == 0)
+			return false;
+
+		int highest[3], lowest[3];
+		for (int c = 0; c < 3; ++c)
+		{
+			const std::int64_t highPart =
+			    3 * (highSum[c] * lowLow - lowSum[c] * highLow);
+			const std::int64_t lowPart =
+			    3 * (lowSum[c] * highHigh - highSum[c] * highLow);
+
+			highest[c] = clampChannel(divideRounded(highPart, determinant));
+			lowest[c]  = clampChannel(divideRounded(lowPart, determinant));
+		}
+
+		high = {highest[0], highest[1], highest[2]};
+		low  = {lowest[0], lowest[1], lowest[2]};
+
+		return true;
+	}
+
+	void writeColorBlock(const ColorBlock& block, std::uint8_t* destination)
+	{
+		std::uint32_t indices = 0;
+		for (int i = 0; i < TEXEL_COUNT; ++i)
+			indices |= static_cast<std::uint32_t>(block.indices[i]) << (i * 2);
+
+		destination[0] = static_cast<std::uint8_t>(block.endpoints[0]);
+		destination[1] = static_cast<std::uint8_t>(block.endpoints[0] >> 8);
+		destination[2] = static_cast<std::uint8_t>(block.endpoints[1]);
+		destination[3] = static_cast<std::uint8_t>(block.endpoints[1] >> 8);
+
+		for (int i = 0; i < 4; ++i)
+			destination[4 + i] = static_cast<std::uint8_t>(indices >> (i * 8));
+	}
+
+	/// @brief Compresses the colour of a block, ignoring its alpha.
+	void compressOpaque(const std::uint8_t* texels, std::uint8_t* destination)
+	{
+		Color high, low;
+		findEndpoints(texels, nullptr, high, low);
+
+		ColorBlock block;
+		encodeOpaque(texels, high, low, block);
+
+		ColorBlock refined;
+		if (refitEndpoints(texels, block, high, low))
+		{
+			encodeOpaque(texels, high, low, refined);
+			if (getError(texels, refined) < getError(texels, block))
+				block = refined;
+		}
+
+		writeColorBlock(block, destination);
+	}
+
+	/**
+	 * @brief Compresses a BC1 block in the 3 colour mode, which leaves the
+	 * fourth index for transparent texels.
+	 */
+	void compressTransparent(const std::uint8_t* texels,
+	                         std::uint8_t*       destination)
+	{
+		bool opaque[TEXEL_COUNT];
+		for (int i = 0; i < TEXEL_COUNT; ++i)
+			opaque[i] = texels[i * 4 + 3] >= ALPHA_THRESHOLD;
+
+		Color high, low;
+		findEndpoints(texels, opaque, high, low);
+
+		ColorBlock block;
+		block.endpoints[0] = toRGB565(high);
+		block.endpoints[1] = toRGB565(low);
+
+		if (block.endpoints[0] > block.endpoints[1])
+			std::swap(block.endpoints[0], block.endpoints[1]);
+
+		buildPalette(block);
+
+		for (int i = 0; i < TEXEL_COUNT; ++i)
+		{
+			if (!opaque[i])
+			{
+				block.indices[i] = 3;
+				continue;
+			}
+
+			std::uint8_t best = 0;
+			int bestDistance  = getDistance(block.palette[0], texels + i * 4);
+
+			for (std::uint8_t j = 1; j < 3; ++j)
+			{
+				const int distance =
+				    getDistance(block.palette[j], texels + i * 4);
+				if (distance < bestDistance)
+				{
+					best         = j;
+					bestDistance = distance;
+				}
+			}
+
+			block.indices[i] = best;
+		}
+
+		writeColorBlock(block, destination);
+	}
+
+	/**
+	 * @brief Compresses the alpha of a BC3 block, interpolating 8 values
+	 * between its lowest and highest alpha.
+	 */
+	void compressAlpha(const std::uint8_t* texels, std::uint8_t* destination)
+	{
+		int lowest = 255, highest = 0;
+		for (int i = 0; i < TEXEL_COUNT; ++i)
+		{
+			lowest  = std::min(lowest, int(texels[i * 4 + 3]));
+			highest = std::max(highest, int(texels[i * 4 + 3]));
+		}
+
+		destination[0] = static_cast<std::uint8_t>(highest);
+		destination[1] = static_cast<std::uint8_t>(lowest);
+
+		std::uint64_t indices = 0;
+		if (highest != lowest)
+		{
+			int palette[8] = {highest, lowest};
+			for (int i = 1; i < 7; ++i)
+				palette[i + 1] = ((7 - i) * highest + i * lowest) / 7;
+
+			for (int i = 0; i < TEXEL_COUNT; ++i)
+			{
+				const int alpha = texels[i * 4 + 3];
+
+				std::uint64_t best         = 0;
+				int           bestDistance = std::abs(palette[0] - alpha);
+				for (int j = 1; j < 8; ++j)
+				{
+					const int distance = std::abs(palette[j] - alpha);
+					if (distance < bestDistance)
+					{
+						best         = static_cast<std::uint64_t>(j);
+						bestDistance = distance;
+					}
+				}
+
+				indices |= best << (i * 3);
+			}
+		}
+
+		for (int i = 0; i < 6; ++i)
+			destination[2 + i] = static_cast<std::uint8_t>(indices >> (i * 8));
+	}
+} // namespace
+
+std::size_t qz::gfx::getImageSize(TextureFormat format, std::size_t width,
+                                  std::size_t height)
+{
+	const std::size_t blocks = ((width + 3) / 4) * ((height + 3) / 4);
+
+	switch (format)
+	{
+	case TextureFormat::BC1:
+		return blocks * 8;
+	case TextureFormat::BC3:
+		return blocks * 16;
+	default:
+		return width * height * 4;
+	}
+}
+
+void qz::gfx::compressBlock(const std::uint8_t* texels, TextureFormat format,
+                            std::uint8_t* destination)
+{
+	assert(format == TextureFormat::BC1 || format == TextureFormat::BC3);
+
+	if (format == TextureFormat::BC3)
+	{
+		compressAlpha(texels, destination);
+		compressOpaque(texels, destination + 8);
+
+		return;
+	}
+
+	for (int i = 0; i < TEXEL_COUNT; ++i)
+	{
+		if (texels[i * 4 + 3] < ALPHA_THRESHOLD)
+		{
+			compressTransparent(texels, destination);
+			return;
+		}
+	}
+
+	compressOpaque(texels, destination);
+}
+
+void qz::gfx::compressBlockRows(const std::uint8_t* source, std::size_t width,
+                                std::size_t height, TextureFormat format,
+                                std::size_t   firstBlockRow,
+                                std::size_t   blockRowCount,
+                                std::uint8_t* destination)
+{
+	const std::size_t blockSize    = format == TextureFormat::BC1 ? 8 : 16;
+	const std::size_t blocksAcross = (width + 3) / 4;
+
+	std::uint8_t texels[TEXEL_COUNT * 4];
+
+	for (std::size_t row = firstBlockRow; row < firstBlockRow + blockRowCount;
+	     ++row)
+	{
+		std::uint8_t* out = destination + row * blocksAcross * blockSize;
+
+		for (std::size_t column = 0; column < blocksAcross;
+		     ++column, out += blockSize)
+		{
+			for (std::size_t y = 0; y < 4; ++y)
+			{
+				const std::size_t sourceY = std::min(row * 4 + y, height - 1);
+
+				for (std::size_t x = 0; x < 4; ++x)
+				{
+					const std::size_t sourceX =
+					    std::min(column * 4 + x, width - 1);
+
+					std::memcpy(texels + (y * 4 + x) * 4,
+					            source + (sourceY * width + sourceX) * 4, 4);
+				}
+			}
+
+			compressBlock(texels, format, out);
+		}
+	}
+}
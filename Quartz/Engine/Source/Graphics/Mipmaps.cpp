@@ -0,0 +1,168 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <Quartz/Graphics/Mipmaps.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define QZ_MIPMAPS_SSE2
+#	include <emmintrin.h>
+#endif
+
+using namespace qz::gfx;
+
+namespace
+{
+	/// @brief The precision linear values are rounded to when encoding.
+	constexpr int ENCODE_STEPS = 4096;
+
+	struct SRGBTables
+	{
+		float        toLinear[256];
+		std::uint8_t fromLinear[ENCODE_STEPS];
+
+		SRGBTables()
+		{
+			for (int i = 0; i < 256; ++i)
+			{
+				const float c = i / 255.f;
+				toLinear[i]   = c <= 0.04045f
+				                  ? c / 12.92f
+				                  : std::pow((c + 0.055f) / 1.055f, 2.4f);
+			}
+
+			for (int i = 0; i < ENCODE_STEPS; ++i)
+			{
+				const float l = i / static_cast<float>(ENCODE_STEPS - 1);
+				const float c = l <= 0.0031308f
+				                    ? l * 12.92f
+				                    : 1.055f * std::pow(l, 1.f / 2.4f) - 0.055f;
+
+				fromLinear[i] = static_cast<std::uint8_t>(
+				    std::min(255.f, std::max(0.f, c * 255.f + 0.5f)));
+			}
+		}
+	};
+
+	const SRGBTables& getTables()
+	{
+		static const SRGBTables tables;
+		return tables;
+	}
+
+	/// @brief Scales the sum of four linear values to the encode table.
+	constexpr float ENCODE_SCALE = (ENCODE_STEPS - 1) / 4.f;
+
+	std::uint8_t encode(const SRGBTables& tables, int index)
+	{
+		return tables.fromLinear[std::min(ENCODE_STEPS - 1,
+		                                  std::max(0, index))];
+	}
+
+#ifdef QZ_MIPMAPS_SSE2
+	/// @brief Loads the linear RGB of a texel, alpha is handled separately.
+	__m128 loadLinear(const SRGBTables& tables, const std::uint8_t* texel)
+	{
+		return _mm_set_ps(0.f, tables.toLinear[texel[2]],
+		                  tables.toLinear[texel[1]],
+		                  tables.toLinear[texel[0]]);
+	}
+#endif
+} // namespace
+
+std::size_t qz::gfx::getMipLevelCount(std::size_t width, std::size_t height)
+{
+	std::size_t levels = 1;
+	for (std::size_t size = std::max(width, height); size > 1; size /= 2)
+		++levels;
+
+	return levels;
+}
+
+void qz::gfx::downsampleSRGB(const std::uint8_t* source, std::size_t width,
+                             std::size_t height, std::uint8_t* destination)
+{
+	const SRGBTables& tables = getTables();
+
+	const std::size_t outWidth  = std::max<std::size_t>(1, width / 2);
+	const std::size_t outHeight = std::max<std::size_t>(1, height / 2);
+
+	for (std::size_t y = 0; y < outHeight; ++y)
+	{
+		// Odd or single texel edges reuse the last row or column.
+		const std::uint8_t* row0 = source + (y * 2) * width * 4;
+		const std::uint8_t* row1 =
+		    source + std::min(y * 2 + 1, height - 1) * width * 4;
+
+		std::uint8_t* out = destination + y * outWidth * 4;
+
+		for (std::size_t x = 0; x < outWidth; ++x, out += 4)
+		{
+			const std::size_t x0 = x * 2 * 4;
+			const std::size_t x1 = std::min(x * 2 + 1, width - 1) * 4;
+
+			// Both paths add and round in the same order, so they give the
+			// same bytes.
+#ifdef QZ_MIPMAPS_SSE2
+			const __m128 sum = _mm_add_ps(
+			    _mm_add_ps(loadLinear(tables, row0 + x0),
+			               loadLinear(tables, row0 + x1)),
+			    _mm_add_ps(loadLinear(tables, row1 + x0),
+			               loadLinear(tables, row1 + x1)));
+
+			alignas(16) std::int32_t rounded[4];
+			_mm_store_si128(
+			    reinterpret_cast<__m128i*>(rounded),
+			    _mm_cvtps_epi32(_mm_mul_ps(sum, _mm_set1_ps(ENCODE_SCALE))));
+
+			for (int c = 0; c < 3; ++c)
+				out[c] = encode(tables, rounded[c]);
+#else
+			for (int c = 0; c < 3; ++c)
+			{
+				const float sum = (tables.toLinear[row0[x0 + c]] +
+				                   tables.toLinear[row0[x1 + c]]) +
+				                  (tables.toLinear[row1[x0 + c]] +
+				                   tables.toLinear[row1[x1 + c]]);
+
+				out[c] = encode(tables, static_cast<int>(
+				                            std::lrint(sum * ENCODE_SCALE)));
+			}
+#endif
+
+			out[3] = static_cast<std::uint8_t>(
+			    (row0[x0 + 3] + row0[x1 + 3] + row1[x0 + 3] + row1[x1 + 3] +
+			     2) /
+			    4);
+		}
+	}
+}
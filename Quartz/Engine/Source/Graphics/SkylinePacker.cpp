@@ -0,0 +1,204 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <Quartz/Graphics/SkylinePacker.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+using namespace qz::gfx;
+
+SkylinePacker::SkylinePacker(std::size_t width, std::size_t height)
+    : m_width(width), m_height(height)
+{
+	m_skyline.push_back({0, 0, width});
+}
+
+bool SkylinePacker::fit(std::size_t segment, std::size_t width,
+                        std::size_t height, std::size_t& y) const
+{
+	const std::size_t x = m_skyline[segment].x;
+	if (x + width > m_width)
+		return false;
+
+	// The rectangle rests on the highest segment it spans.
+	y = 0;
+
+	std::size_t remaining = width;
+	for (std::size_t i = segment; remaining > 0; ++i)
+	{
+		y = std::max(y, m_skyline[i].y);
+		if (y + height > m_height)
+			return false;
+
+		remaining -= std::min(remaining, m_skyline[i].width);
+	}
+
+	return true;
+}
+
+bool SkylinePacker::pack(std::size_t width, std::size_t height,
+                         std::size_t& x, std::size_t& y)
+{
+	std::size_t best    = m_skyline.size();
+	std::size_t bestTop = 0;
+
+	for (std::size_t i = 0; i < m_skyline.size(); ++i)
+	{
+		std::size_t top = 0;
+		if (!fit(i, width, height, top))
+			continue;
+
+		// Segments are ordered by x, so only a strictly lower top wins.
+		if (best == m_skyline.size() || top + height < bestTop)
+		{
+			best    = i;
+			bestTop = top + height;
+		}
+	}
+
+	if (best == m_skyline.size())
+		return false;
+
+	x = m_skyline[best].x;
+	y = bestTop - height;
+
+	m_skyline.insert(m_skyline.begin() + best, {x, bestTop, width});
+
+	// Cut the segments now hidden under the rectangle.
+	const std::size_t right = x + width;
+	for (std::size_t i = best + 1; i < m_skyline.size();)
+	{
+		Segment& segment = m_skyline[i];
+		if (segment.x >= right)
+			break;
+
+		const std::size_t end = segment.x + segment.width;
+		if (end <= right)
+		{
+			m_skyline.erase(m_skyline.begin() + i);
+			continue;
+		}
+
+		segment.width = end - right;
+		segment.x     = right;
+		break;
+	}
+
+	// Merge neighbours at the same height.
+	for (std::size_t i = 0; i + 1 < m_skyline.size();)
+	{
+		if (m_skyline[i].y == m_skyline[i + 1].y)
+		{
+			m_skyline[i].width += m_skyline[i + 1].width;
+			m_skyline.erase(m_skyline.begin() + i + 1);
+		}
+		else
+		{
+			++i;
+		}
+	}
+
+	return true;
+}
+
+std::size_t SkylinePacker::getUsedHeight() const
+{
+	std::size_t height = 0;
+	for (const Segment& segment : m_skyline)
+		height = std::max(height, segment.y);
+
+	return height;
+}
+
+static std::size_t nextPowerOfTwo(std::size_t value)
+{
+	std::size_t power = 1;
+	while (power < value)
+		power <<= 1;
+
+	return power;
+}
+
+bool qz::gfx::packRects(std::vector<PackedRect>& rects, std::size_t maxSize,
+                        std::size_t& width, std::size_t& height)
+{
+	std::vector<std::size_t> order(rects.size());
+	std::iota(order.begin(), order.end(), 0);
+
+	std::stable_sort(order.begin(), order.end(),
+	                 [&rects](std::size_t a, std::size_t b) {
+		                 if (rects[a].height != rects[b].height)
+			                 return rects[a].height > rects[b].height;
+
+		                 return rects[a].width > rects[b].width;
+	                 });
+
+	std::size_t area     = 0;
+	std::size_t minWidth = 1;
+	for (const PackedRect& rect : rects)
+	{
+		area += rect.width * rect.height;
+		minWidth = std::max(minWidth, rect.width);
+	}
+
+	// Start from the smallest square that could hold everything, and widen
+	// it until everything fits. The height is trimmed afterwards.
+	width = nextPowerOfTwo(
+	    std::max(minWidth, static_cast<std::size_t>(std::ceil(
+	                           std::sqrt(static_cast<double>(area))))));
+
+	for (; width <= maxSize; width *= 2)
+	{
+		SkylinePacker packer(width, maxSize);
+
+		bool packed = true;
+		for (std::size_t i : order)
+		{
+			if (!packer.pack(rects[i].width, rects[i].height, rects[i].x,
+			                 rects[i].y))
+			{
+				packed = false;
+				break;
+			}
+		}
+
+		// Anything much taller than it is wide would be better off wider.
+		height =
+		    nextPowerOfTwo(std::max<std::size_t>(1, packer.getUsedHeight()));
+		if (packed && height <= width * 2)
+			return true;
+
+		if (packed && width * 2 > maxSize)
+			return true;
+	}
+
+	return false;
+}
@@ -0,0 +1,165 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <Quartz/Core.hpp>
+#include <Quartz/Utilities/MemoryMappedFile.hpp>
+
+#if defined(QZ_PLATFORM_WINDOWS)
+#	include <Windows.h>
+#elif defined(QZ_PLATFORM_LINUX) || defined(QZ_PLATFORM_APPLE)
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+#include <utility>
+
+using namespace qz::utils;
+
+MemoryMappedFile::MemoryMappedFile()
+    : m_data(nullptr), m_size(0)
+#if defined(QZ_PLATFORM_WINDOWS)
+      ,
+      m_file(nullptr), m_mapping(nullptr)
+#endif
+{
+}
+
+MemoryMappedFile::~MemoryMappedFile() { close(); }
+
+MemoryMappedFile::MemoryMappedFile(MemoryMappedFile&& other) noexcept
+    : MemoryMappedFile()
+{
+	*this = std::move(other);
+}
+
+MemoryMappedFile& MemoryMappedFile::operator=(
+    MemoryMappedFile&& other) noexcept
+{
+	if (this == &other)
+		return *this;
+
+	close();
+
+	std::swap(m_data, other.m_data);
+	std::swap(m_size, other.m_size);
+#if defined(QZ_PLATFORM_WINDOWS)
+	std::swap(m_file, other.m_file);
+	std::swap(m_mapping, other.m_mapping);
+#endif
+
+	return *this;
+}
+
+bool MemoryMappedFile::open(const std::string& filepath)
+{
+	close();
+
+#if defined(QZ_PLATFORM_WINDOWS)
+	HANDLE file = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ,
+	                          nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+	                          nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping =
+	    CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (data == nullptr)
+	{
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	m_file    = file;
+	m_mapping = mapping;
+	m_data    = static_cast<const unsigned char*>(data);
+	m_size    = static_cast<std::size_t>(size.QuadPart);
+#elif defined(QZ_PLATFORM_LINUX) || defined(QZ_PLATFORM_APPLE)
+	const int file = ::open(filepath.c_str(), O_RDONLY);
+	if (file < 0)
+		return false;
+
+	struct stat status;
+	if (fstat(file, &status) != 0 || status.st_size <= 0)
+	{
+		::close(file);
+		return false;
+	}
+
+	const std::size_t size = static_cast<std::size_t>(status.st_size);
+
+	// The mapping keeps the file alive, so the descriptor can go.
+	void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+	::close(file);
+
+	if (data == MAP_FAILED)
+		return false;
+
+	m_data = static_cast<const unsigned char*>(data);
+	m_size = size;
+#endif
+
+	return m_data != nullptr;
+}
+
+void MemoryMappedFile::close()
+{
+	if (m_data == nullptr)
+		return;
+
+#if defined(QZ_PLATFORM_WINDOWS)
+	UnmapViewOfFile(m_data);
+	CloseHandle(m_mapping);
+	CloseHandle(m_file);
+
+	m_mapping = nullptr;
+	m_file    = nullptr;
+#elif defined(QZ_PLATFORM_LINUX) || defined(QZ_PLATFORM_APPLE)
+	munmap(const_cast<unsigned char*>(m_data), m_size);
+#endif
+
+	m_data = nullptr;
+	m_size = 0;
+}
@@ -0,0 +1,213 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <Quartz/Core.hpp>
+#include <Quartz/Utilities/Threading/CpuTopology.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+
+using namespace qz::utils::threading;
+
+namespace
+{
+#if defined(QZ_PLATFORM_LINUX)
+	const std::string SYSFS_CPU  = "/sys/devices/system/cpu/";
+	const std::string SYSFS_NODE = "/sys/devices/system/node/";
+
+	/**
+	 * @brief Parses a sysfs CPU list such as "0-3,8,10-11".
+	 * @return The listed numbers, empty if the file can't be read.
+	 */
+	std::vector<unsigned int> readList(const std::string& path)
+	{
+		std::ifstream file(path);
+		std::string   text;
+
+		std::vector<unsigned int> values;
+		if (!std::getline(file, text))
+			return values;
+
+		std::size_t position = 0;
+		while (position < text.size())
+		{
+			std::size_t end = text.find(',', position);
+			if (end == std::string::npos)
+				end = text.size();
+
+			const std::string range = text.substr(position, end - position);
+			position                = end + 1;
+
+			if (range.empty())
+				continue;
+
+			try
+			{
+				const std::size_t dash = range.find('-');
+
+				const unsigned long first = std::stoul(range.substr(0, dash));
+				unsigned long       last  = first;
+
+				if (dash != std::string::npos)
+					last = std::stoul(range.substr(dash + 1));
+
+				for (unsigned long value = first; value <= last; ++value)
+					values.push_back(static_cast<unsigned int>(value));
+			}
+			catch (const std::exception&)
+			{
+				return {};
+			}
+		}
+
+		return values;
+	}
+
+	/// @brief Reads a number from a sysfs file, or the fallback.
+	unsigned int readNumber(const std::string& path, unsigned int fallback)
+	{
+		std::ifstream file(path);
+
+		long value = -1;
+		if (!(file >> value) || value < 0)
+			return fallback;
+
+		return static_cast<unsigned int>(value);
+	}
+#endif
+} // namespace
+
+CpuTopology CpuTopology::probe()
+{
+	CpuTopology topology;
+
+#if defined(QZ_PLATFORM_LINUX)
+	const std::vector<unsigned int> online = readList(SYSFS_CPU + "online");
+
+	for (unsigned int index : online)
+	{
+		const std::string topologyPath =
+		    SYSFS_CPU + "cpu" + std::to_string(index) + "/topology/";
+
+		LogicalCpu cpu;
+		cpu.index   = index;
+		cpu.package = readNumber(topologyPath + "physical_package_id", 0);
+		cpu.core    = readNumber(topologyPath + "core_id", index);
+		cpu.node    = 0;
+
+		topology.m_cpus.push_back(cpu);
+	}
+
+	// Machines without NUMA have no node directory, leaving everything on
+	// node 0.
+	for (unsigned int node : readList(SYSFS_NODE + "online"))
+	{
+		const std::string listPath =
+		    SYSFS_NODE + "node" + std::to_string(node) + "/cpulist";
+
+		for (unsigned int index : readList(listPath))
+		{
+			for (LogicalCpu& cpu : topology.m_cpus)
+			{
+				if (cpu.index == index)
+					cpu.node = node;
+			}
+		}
+	}
+#endif
+
+	if (topology.m_cpus.empty())
+	{
+		const unsigned int count =
+		    std::max(std::thread::hardware_concurrency(), 1u);
+
+		for (unsigned int index = 0; index < count; ++index)
+			topology.m_cpus.push_back({index, index, 0, 0});
+	}
+
+	topology.finish();
+
+	return topology;
+}
+
+void CpuTopology::finish()
+{
+	// Core ids repeat across packages, so cores are numbered by package and
+	// id together.
+	std::map<std::pair<unsigned int, unsigned int>, unsigned int> cores;
+	std::set<unsigned int>                                        packages;
+	std::set<unsigned int>                                        nodes;
+
+	std::sort(m_cpus.begin(), m_cpus.end(),
+	          [](const LogicalCpu& a, const LogicalCpu& b) {
+		          return a.index < b.index;
+	          });
+
+	for (LogicalCpu& cpu : m_cpus)
+	{
+		const auto key = std::make_pair(cpu.package, cpu.core);
+		const auto core =
+		    cores.emplace(key, static_cast<unsigned int>(cores.size()));
+
+		cpu.core = core.first->second;
+
+		packages.insert(cpu.package);
+		nodes.insert(cpu.node);
+	}
+
+	m_coreCount    = cores.size();
+	m_packageCount = packages.size();
+	m_nodeCount    = nodes.size();
+}
+
+std::vector<LogicalCpu> CpuTopology::getOnePerCore(bool leaveFirstCore) const
+{
+	std::vector<LogicalCpu> cpus;
+	std::vector<bool>       taken(m_coreCount, false);
+
+	if (leaveFirstCore && m_coreCount > 1)
+		taken[m_cpus.front().core] = true;
+
+	for (const LogicalCpu& cpu : m_cpus)
+	{
+		if (taken[cpu.core])
+			continue;
+
+		taken[cpu.core] = true;
+		cpus.push_back(cpu);
+	}
+
+	return cpus;
+}
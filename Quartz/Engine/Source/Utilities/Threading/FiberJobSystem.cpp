@@ -0,0 +1,456 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <Quartz/Utilities/Threading/FiberJobSystem.hpp>
+
+#include <new>
+
+#if defined(QZ_FIBERS_SUPPORTED)
+#	include <sys/mman.h>
+#	include <unistd.h>
+
+#	include <cstdint>
+#	include <cstdlib>
+
+#	if defined(__SANITIZE_THREAD__)
+#		define QZ_FIBERS_TSAN
+#	elif defined(__has_feature)
+#		if __has_feature(thread_sanitizer)
+#			define QZ_FIBERS_TSAN
+#		endif
+#	endif
+
+#	if defined(QZ_FIBERS_TSAN)
+#		include <sanitizer/tsan_interface.h>
+#	endif
+#endif
+
+using namespace qz::utils::threading;
+
+#if defined(QZ_FIBERS_SUPPORTED)
+extern "C"
+{
+	/**
+	 * @brief Saves the callee saved registers and the floating point
+	 * control words on the current stack, stores the stack pointer in from,
+	 * then restores the same from the stack at to.
+	 */
+	void qz_fiber_switch(void** from, void* to);
+
+	/// @brief Where a new fiber's first switch returns to, calls r13 with
+	/// r12 as its argument.
+	void qz_fiber_trampoline();
+}
+
+__asm__(R"(
+	.text
+	.p2align 4
+	.globl qz_fiber_switch
+	.hidden qz_fiber_switch
+	.type qz_fiber_switch, @function
+qz_fiber_switch:
+	pushq %rbp
+	pushq %rbx
+	pushq %r12
+	pushq %r13
+	pushq %r14
+	pushq %r15
+	subq $8, %rsp
+	stmxcsr (%rsp)
+	fnstcw 4(%rsp)
+	movq %rsp, (%rdi)
+	movq %rsi, %rsp
+	ldmxcsr (%rsp)
+	fldcw 4(%rsp)
+	addq $8, %rsp
+	popq %r15
+	popq %r14
+	popq %r13
+	popq %r12
+	popq %rbx
+	popq %rbp
+	ret
+	.size qz_fiber_switch, .-qz_fiber_switch
+
+	.p2align 4
+	.globl qz_fiber_trampoline
+	.hidden qz_fiber_trampoline
+	.type qz_fiber_trampoline, @function
+qz_fiber_trampoline:
+	movq %r12, %rdi
+	callq *%r13
+	ud2
+	.size qz_fiber_trampoline, .-qz_fiber_trampoline
+)");
+
+namespace qz
+{
+	namespace utils
+	{
+		namespace threading
+		{
+			namespace detail
+			{
+				struct Fiber
+				{
+					/// @brief The saved stack pointer while not running.
+					void* stack = nullptr;
+
+					void*       mapping = nullptr;
+					std::size_t mappingSize = 0;
+
+					FiberJobSystem* system = nullptr;
+
+					/// @brief The job to run when next resumed fresh.
+					void* job = nullptr;
+
+					/// @brief Set by a fiber about to wait, registered by
+					/// the thread it switches back to.
+					JobCounter* waitingOn = nullptr;
+
+					/// @brief Links free fibers, or waiters of a counter.
+					Fiber* next = nullptr;
+
+#	if defined(QZ_FIBERS_TSAN)
+					void* tsanFiber = nullptr;
+#	endif
+				};
+			} // namespace detail
+		}     // namespace threading
+	}         // namespace utils
+} // namespace qz
+
+using qz::utils::threading::detail::Fiber;
+
+namespace
+{
+	/// @brief The context a fiber running on this thread returns to.
+	struct ThreadContext
+	{
+		void*  stack = nullptr;
+		Fiber* fiber = nullptr;
+
+#	if defined(QZ_FIBERS_TSAN)
+		void* tsanFiber = nullptr;
+#	endif
+	};
+
+	thread_local ThreadContext t_context;
+
+	/**
+	 * @brief Fibers move between threads, so the thread's context is
+	 * looked up again after every switch rather than cached by the
+	 * compiler.
+	 */
+	__attribute__((noinline)) ThreadContext& getThreadContext()
+	{
+		ThreadContext* context = &t_context;
+		__asm__ volatile("" : "+r"(context));
+		return *context;
+	}
+
+	void switchToThread(Fiber* fiber)
+	{
+		ThreadContext& context = getThreadContext();
+
+#	if defined(QZ_FIBERS_TSAN)
+		__tsan_switch_to_fiber(context.tsanFiber, 0);
+#	endif
+
+		qz_fiber_switch(&fiber->stack, context.stack);
+	}
+
+	Fiber* createFiber(FiberJobSystem* system, std::size_t stackSize,
+	                   void (*entry)(void*))
+	{
+		const auto page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+		const std::size_t size = (stackSize + page - 1) / page * page + page;
+
+		void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+		                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+		if (mapping == MAP_FAILED)
+			std::abort();
+
+		// The lowest page catches overflows instead of corrupting memory.
+		mprotect(mapping, page, PROT_NONE);
+
+		Fiber* fiber       = new Fiber();
+		fiber->mapping     = mapping;
+		fiber->mappingSize = size;
+		fiber->system      = system;
+
+		// Laid out as qz_fiber_switch leaves a suspended stack, so the
+		// first switch "returns" into the trampoline with a 16 byte
+		// aligned stack pointer.
+		auto* top = reinterpret_cast<std::uint64_t*>(
+		    static_cast<unsigned char*>(mapping) + size);
+
+		top[-1] = reinterpret_cast<std::uint64_t>(&qz_fiber_trampoline);
+		top[-2] = 0; // rbp
+		top[-3] = 0; // rbx
+		top[-4] = reinterpret_cast<std::uint64_t>(fiber);  // r12
+		top[-5] = reinterpret_cast<std::uint64_t>(entry);  // r13
+		top[-6] = 0; // r14
+		top[-7] = 0; // r15
+
+		// Default MXCSR and x87 control word.
+		top[-8] = 0x1F80ull | (0x037Full << 32);
+
+		fiber->stack = &top[-8];
+
+#	if defined(QZ_FIBERS_TSAN)
+		fiber->tsanFiber = __tsan_create_fiber(0);
+#	endif
+
+		return fiber;
+	}
+
+	void destroyFiber(Fiber* fiber)
+	{
+#	if defined(QZ_FIBERS_TSAN)
+		__tsan_destroy_fiber(fiber->tsanFiber);
+#	endif
+
+		munmap(fiber->mapping, fiber->mappingSize);
+		delete fiber;
+	}
+} // namespace
+#endif
+
+FiberJobSystem::FiberJobSystem(ThreadPool& pool, std::size_t stackSize)
+    : m_pool(pool), m_stackSize(stackSize), m_active(0),
+      m_freeFibers(nullptr)
+{
+}
+
+FiberJobSystem::~FiberJobSystem()
+{
+	m_pool.runPendingTasksUntil([this]() { return m_active.load() == 0; });
+
+#if defined(QZ_FIBERS_SUPPORTED)
+	for (Fiber* fiber : m_fibers)
+		destroyFiber(fiber);
+#endif
+}
+
+void FiberJobSystem::run(Task job, JobCounter* counter)
+{
+	if (counter != nullptr)
+		counter->m_value.fetch_add(1);
+
+	m_active.fetch_add(1);
+
+	Job* queued = new (JobPool::allocate()) Job {std::move(job), counter};
+	m_pool.addWork([this, queued]() { start(queued); });
+}
+
+void FiberJobSystem::finish(Job* job)
+{
+	JobCounter* counter = job->counter;
+
+	job->~Job();
+	JobPool::deallocate(job);
+
+	if (counter == nullptr)
+		return;
+
+	detail::Fiber* waiters = nullptr;
+
+	// Decrements happen under the lock, so a waiter that takes it after
+	// seeing zero knows this is done with the counter.
+	{
+		std::lock_guard<std::mutex> lock(counter->m_mutex);
+
+		if (counter->m_value.fetch_sub(1) == 1)
+		{
+			waiters             = counter->m_waiters;
+			counter->m_waiters = nullptr;
+		}
+	}
+
+#if defined(QZ_FIBERS_SUPPORTED)
+	while (waiters != nullptr)
+	{
+		Fiber* next = waiters->next;
+		schedule(waiters);
+		waiters = next;
+	}
+#endif
+}
+
+std::size_t FiberJobSystem::getFiberCount() const
+{
+	std::lock_guard<std::mutex> lock(m_fiberMutex);
+	return m_fibers.size();
+}
+
+#if defined(QZ_FIBERS_SUPPORTED)
+void FiberJobSystem::start(Job* job)
+{
+	Fiber* fiber = acquireFiber();
+	fiber->job   = job;
+
+	resume(fiber);
+}
+
+void FiberJobSystem::wait(JobCounter& counter)
+{
+	Fiber* self = getThreadContext().fiber;
+
+	if (self == nullptr || self->system != this)
+	{
+		m_pool.runPendingTasksUntil([&counter]() { return counter.isDone(); });
+
+		// Pairs with the decrement in finish(), which may still hold it.
+		std::lock_guard<std::mutex> lock(counter.m_mutex);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(counter.m_mutex);
+		if (counter.m_value.load() == 0)
+			return;
+	}
+
+	// Registered by the thread once this fiber is off its stack, so that
+	// nobody can resume it halfway through switching away.
+	self->waitingOn = &counter;
+	switchToThread(self);
+}
+
+Fiber* FiberJobSystem::acquireFiber()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_fiberMutex);
+
+		if (m_freeFibers != nullptr)
+		{
+			Fiber* fiber = m_freeFibers;
+			m_freeFibers = fiber->next;
+
+			return fiber;
+		}
+	}
+
+	Fiber* fiber = createFiber(this, m_stackSize, &FiberJobSystem::runFiber);
+
+	std::lock_guard<std::mutex> lock(m_fiberMutex);
+	m_fibers.push_back(fiber);
+
+	return fiber;
+}
+
+void FiberJobSystem::resume(Fiber* fiber)
+{
+	// Resuming from within a fiber (a job helping the pool) nests, so the
+	// outer context is put back afterwards.
+	ThreadContext& context = getThreadContext();
+	ThreadContext  outer   = context;
+
+	context.fiber = fiber;
+
+#	if defined(QZ_FIBERS_TSAN)
+	context.tsanFiber = __tsan_get_current_fiber();
+	__tsan_switch_to_fiber(fiber->tsanFiber, 0);
+#	endif
+
+	qz_fiber_switch(&context.stack, fiber->stack);
+
+	getThreadContext() = outer;
+
+	JobCounter* counter = fiber->waitingOn;
+	if (counter == nullptr)
+	{
+		// Finished its job, parked at the end of runFiber's loop.
+		{
+			std::lock_guard<std::mutex> lock(m_fiberMutex);
+			fiber->next  = m_freeFibers;
+			m_freeFibers = fiber;
+		}
+
+		m_active.fetch_sub(1);
+		return;
+	}
+
+	fiber->waitingOn = nullptr;
+
+	bool done;
+	{
+		std::lock_guard<std::mutex> lock(counter->m_mutex);
+
+		done = counter->m_value.load() == 0;
+		if (!done)
+		{
+			fiber->next         = counter->m_waiters;
+			counter->m_waiters = fiber;
+		}
+	}
+
+	if (done)
+		schedule(fiber);
+}
+
+void FiberJobSystem::schedule(Fiber* fiber)
+{
+	m_pool.addWork([this, fiber]() { resume(fiber); });
+}
+
+void FiberJobSystem::runFiber(void* argument)
+{
+	Fiber* fiber = static_cast<Fiber*>(argument);
+
+	while (true)
+	{
+		Job* job   = static_cast<Job*>(fiber->job);
+		fiber->job = nullptr;
+
+		job->task();
+		fiber->system->finish(job);
+
+		// Resumed again with the next job.
+		switchToThread(fiber);
+	}
+}
+#else
+void FiberJobSystem::start(Job* job)
+{
+	job->task();
+	finish(job);
+
+	m_active.fetch_sub(1);
+}
+
+void FiberJobSystem::wait(JobCounter& counter)
+{
+	m_pool.runPendingTasksUntil([&counter]() { return counter.isDone(); });
+
+	// Pairs with the decrement in finish(), which may still hold it.
+	std::lock_guard<std::mutex> lock(counter.m_mutex);
+}
+#endif
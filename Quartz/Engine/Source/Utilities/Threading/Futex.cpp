@@ -0,0 +1,94 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <Quartz/Utilities/Threading/Futex.hpp>
+
+#if defined(QZ_PLATFORM_LINUX)
+#	include <linux/futex.h>
+#	include <sys/syscall.h>
+#	include <unistd.h>
+
+#	include <climits>
+#endif
+
+using namespace qz::utils::threading;
+
+#if defined(QZ_PLATFORM_LINUX)
+static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t) &&
+                  std::atomic<std::uint32_t>::is_always_lock_free,
+              "The futex syscall needs a plain 32 bit word");
+
+namespace
+{
+	long futex(std::atomic<std::uint32_t>& word, int operation,
+	           std::uint32_t value)
+	{
+		return syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word),
+		               operation, value, nullptr, nullptr, 0);
+	}
+} // namespace
+
+void Futex::wait(std::uint32_t expected)
+{
+	// Returns straight away if the word no longer holds the value.
+	futex(m_value, FUTEX_WAIT_PRIVATE, expected);
+}
+
+void Futex::wakeOne() { futex(m_value, FUTEX_WAKE_PRIVATE, 1); }
+
+void Futex::wakeAll() { futex(m_value, FUTEX_WAKE_PRIVATE, INT_MAX); }
+#else
+void Futex::wait(std::uint32_t expected)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_condition.wait(lock, [this, expected]() {
+		return m_value.load(std::memory_order_acquire) != expected;
+	});
+}
+
+void Futex::wakeOne()
+{
+	// Taking the lock orders this after a waiter's check of the value, so
+	// the notification can't slip in before it sleeps.
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+	}
+
+	m_condition.notify_one();
+}
+
+void Futex::wakeAll()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+	}
+
+	m_condition.notify_all();
+}
+#endif
@@ -0,0 +1,147 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <Quartz/Utilities/Threading/Future.hpp>
+
+#include <chrono>
+
+using namespace qz::utils::threading;
+using namespace qz::utils::threading::detail;
+
+namespace
+{
+	/// @brief How long a waiter with nothing to help with sleeps before
+	/// looking for work again.
+	constexpr std::chrono::microseconds HELP_INTERVAL(200);
+} // namespace
+
+void FutureStateBase::wait()
+{
+	while (!isReady())
+	{
+		if (m_pool != nullptr && m_pool->runPendingTask())
+			continue;
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_condition.wait_for(lock, HELP_INTERVAL,
+		                     [this]() { return isReady(); });
+	}
+}
+
+void FutureStateBase::onReady(Task continuation)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (!isReady())
+		{
+			m_continuations.push_back(std::move(continuation));
+			return;
+		}
+	}
+
+	schedule(std::move(continuation));
+}
+
+void FutureStateBase::finish(std::exception_ptr exception)
+{
+	std::vector<Task> continuations;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		m_exception = std::move(exception);
+		m_ready.store(true, std::memory_order_release);
+
+		continuations.swap(m_continuations);
+	}
+
+	m_condition.notify_all();
+
+	for (Task& continuation : continuations)
+		schedule(std::move(continuation));
+}
+
+void FutureStateBase::schedule(Task continuation)
+{
+	if (m_pool != nullptr)
+		m_pool->addWork(std::move(continuation));
+	else
+		continuation();
+}
+
+Future<void> qz::utils::threading::detail::whenAll(
+    std::vector<std::shared_ptr<FutureStateBase>> states)
+{
+	ThreadPool* pool = states.empty() ? nullptr : states.front()->getPool();
+
+	auto joined = std::make_shared<FutureState<void>>(pool);
+
+	if (states.empty())
+	{
+		joined->finish(nullptr);
+		return Future<void>(std::move(joined));
+	}
+
+	struct Join
+	{
+		std::atomic<std::size_t> remaining;
+		std::mutex               mutex;
+		std::exception_ptr       exception;
+	};
+
+	auto join = std::make_shared<Join>();
+	join->remaining.store(states.size());
+
+	for (const std::shared_ptr<FutureStateBase>& state : states)
+	{
+		state->onReady([join, joined, state]() {
+			if (state->getException())
+			{
+				std::lock_guard<std::mutex> lock(join->mutex);
+
+				if (!join->exception)
+					join->exception = state->getException();
+			}
+
+			if (join->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				std::exception_ptr exception;
+				{
+					std::lock_guard<std::mutex> lock(join->mutex);
+					exception = join->exception;
+				}
+
+				joined->finish(std::move(exception));
+			}
+		});
+	}
+
+	return Future<void>(std::move(joined));
+}
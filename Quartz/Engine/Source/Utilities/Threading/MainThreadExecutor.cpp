@@ -0,0 +1,216 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <Quartz/Utilities/Threading/MainThreadExecutor.hpp>
+
+#include <algorithm>
+#include <new>
+
+using namespace qz::utils::threading;
+
+namespace
+{
+	/// @brief How many tasks the average task cost roughly spans.
+	constexpr int COST_SMOOTHING = 8;
+} // namespace
+
+MainThreadExecutor::MainThreadExecutor(std::chrono::microseconds frameBudget)
+    : m_thread(std::this_thread::get_id()), m_frameBudget(frameBudget),
+      m_agingInterval(DEFAULT_AGING_INTERVAL), m_averageCost(0)
+{
+}
+
+MainThreadExecutor::~MainThreadExecutor()
+{
+	while (getQueuedCount() > 0)
+	{
+		if (runPending() == 0)
+			std::this_thread::yield();
+	}
+}
+
+void MainThreadExecutor::addWork(Task task, TaskPriority priority)
+{
+	Node* node   = new (NodePool::allocate()) Node();
+	node->task   = std::move(task);
+	node->queued = Clock::now();
+
+	Lane& lane = m_lanes[static_cast<std::size_t>(priority)];
+
+	lane.size.fetch_add(1);
+	lane.queue.push(node);
+}
+
+std::size_t MainThreadExecutor::runFrame()
+{
+	return run(m_frameBudget);
+}
+
+std::size_t MainThreadExecutor::runPending()
+{
+	return run(Clock::duration::max());
+}
+
+std::size_t MainThreadExecutor::getQueuedCount(TaskPriority priority) const
+{
+	return m_lanes[static_cast<std::size_t>(priority)].size.load(
+	    std::memory_order_relaxed);
+}
+
+std::size_t MainThreadExecutor::getQueuedCount() const
+{
+	std::size_t count = 0;
+
+	for (const Lane& lane : m_lanes)
+		count += lane.size.load(std::memory_order_relaxed);
+
+	return count;
+}
+
+std::size_t MainThreadExecutor::collect()
+{
+	std::size_t queued = 0;
+
+	for (Lane& lane : m_lanes)
+	{
+		while (MPSCNode* link = lane.queue.pop())
+		{
+			Node* node = static_cast<Node*>(link);
+
+			if (lane.last != nullptr)
+				lane.last->after = node;
+			else
+				lane.first = node;
+
+			lane.last = node;
+		}
+
+		queued += lane.size.load(std::memory_order_relaxed);
+	}
+
+	return queued;
+}
+
+MainThreadExecutor::Node* MainThreadExecutor::takeNext()
+{
+	Lane*             chosen = nullptr;
+	Clock::time_point deadline;
+	bool              aged = false;
+
+	for (std::size_t i = 0; i < LANE_COUNT; ++i)
+	{
+		Lane& lane = m_lanes[i];
+		if (lane.first == nullptr)
+			continue;
+
+		// Each lane counts as queued an aging interval later than the one
+		// before it. Fronts are the oldest of their lane, so only they are
+		// compared, and ties go to the more urgent lane.
+		const Clock::time_point candidate =
+		    lane.first->queued + m_agingInterval * static_cast<int>(i);
+
+		if (chosen == nullptr || candidate < deadline)
+		{
+			aged     = chosen != nullptr;
+			chosen   = &lane;
+			deadline = candidate;
+		}
+	}
+
+	if (chosen == nullptr)
+		return nullptr;
+
+	if (aged)
+		++m_metrics.agedCount;
+
+	Node* node    = chosen->first;
+	chosen->first = node->after;
+
+	if (chosen->first == nullptr)
+		chosen->last = nullptr;
+
+	chosen->size.fetch_sub(1);
+
+	return node;
+}
+
+std::size_t MainThreadExecutor::run(Clock::duration budget)
+{
+	const Clock::time_point start = Clock::now();
+
+	// Taken before running anything, so work queued by this frame's tasks
+	// waits for the next one.
+	m_metrics.peakQueued = std::max(m_metrics.peakQueued, collect());
+
+	std::size_t       count = 0;
+	Clock::time_point now   = start;
+
+	while (Node* node = takeNext())
+	{
+		const auto waited =
+		    std::chrono::duration_cast<std::chrono::microseconds>(
+		        now - node->queued);
+		m_metrics.worstWait = std::max(m_metrics.worstWait, waited);
+
+		node->task();
+
+		node->~Node();
+		NodePool::deallocate(node);
+
+		++count;
+
+		const Clock::time_point finished = Clock::now();
+		m_averageCost += (finished - now - m_averageCost) / COST_SMOOTHING;
+		now = finished;
+
+		// Stops before a task that would likely go over, rather than after
+		// the one that did.
+		if (now - start + m_averageCost > budget)
+			break;
+	}
+
+	const auto elapsed =
+	    std::chrono::duration_cast<std::chrono::microseconds>(now - start);
+
+	m_metrics.lastRunCount = count;
+	m_metrics.lastElapsed  = elapsed;
+
+	if (budget != Clock::duration::max() && elapsed > budget)
+	{
+		const auto overrun =
+		    std::chrono::duration_cast<std::chrono::microseconds>(elapsed -
+		                                                          budget);
+
+		++m_metrics.overrunCount;
+		m_metrics.lastOverrun  = overrun;
+		m_metrics.worstOverrun = std::max(m_metrics.worstOverrun, overrun);
+	}
+
+	return count;
+}
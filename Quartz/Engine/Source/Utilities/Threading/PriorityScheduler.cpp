@@ -0,0 +1,238 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <Quartz/Utilities/Threading/PriorityScheduler.hpp>
+
+#include <cassert>
+
+using namespace qz::utils::threading;
+
+namespace
+{
+	std::size_t laneOf(TaskPriority priority)
+	{
+		assert(priority < TaskPriority::COUNT);
+		return static_cast<std::size_t>(priority);
+	}
+} // namespace
+
+PriorityScheduler::PriorityScheduler(ThreadPool& pool)
+    : m_pool(pool), m_state(std::make_shared<State>())
+{
+}
+
+PriorityScheduler::~PriorityScheduler() { cancelAll(); }
+
+bool PriorityScheduler::schedule(Key key, TaskPriority priority, Job job)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_state->mutex);
+
+		if (m_state->records.count(key) != 0)
+			return false;
+
+		const std::uint64_t serial = m_state->nextSerial++;
+
+		std::list<Entry>& lane = m_state->lanes[laneOf(priority)];
+		lane.push_back({key, serial, std::move(job)});
+
+		Record& record  = m_state->records[key];
+		record.serial   = serial;
+		record.priority = priority;
+		record.running  = false;
+		record.entry    = std::prev(lane.end());
+	}
+
+	// The task doesn't belong to this job, it takes whatever is most
+	// urgent once it runs. There is always one task per queued job.
+	std::shared_ptr<State> state = m_state;
+	m_pool.addWork([state]() { runNext(*state); });
+
+	return true;
+}
+
+bool PriorityScheduler::reprioritize(Key key, TaskPriority priority)
+{
+	std::lock_guard<std::mutex> lock(m_state->mutex);
+
+	auto it = m_state->records.find(key);
+	if (it == m_state->records.end() || it->second.running)
+		return false;
+
+	Record& record = it->second;
+	if (record.priority != priority)
+	{
+		std::list<Entry>& from = m_state->lanes[laneOf(record.priority)];
+		std::list<Entry>& to   = m_state->lanes[laneOf(priority)];
+
+		to.splice(to.end(), from, record.entry);
+		record.priority = priority;
+	}
+
+	return true;
+}
+
+void PriorityScheduler::reprioritizeAll(const PriorityFunction& priorityOf)
+{
+	std::lock_guard<std::mutex> lock(m_state->mutex);
+
+	// Moved jobs are collected first so that no job is visited twice.
+	std::array<std::list<Entry>, LANE_COUNT> moved;
+
+	for (std::list<Entry>& lane : m_state->lanes)
+	{
+		for (auto entry = lane.begin(); entry != lane.end();)
+		{
+			auto current = entry++;
+
+			Record& record = m_state->records.at(current->key);
+
+			const std::optional<TaskPriority> priority =
+			    priorityOf(current->key);
+
+			if (!priority)
+			{
+				m_state->records.erase(current->key);
+				lane.erase(current);
+			}
+			else if (*priority != record.priority)
+			{
+				std::list<Entry>& to = moved[laneOf(*priority)];
+				to.splice(to.end(), lane, current);
+
+				record.priority = *priority;
+			}
+		}
+	}
+
+	for (std::size_t i = 0; i < LANE_COUNT; ++i)
+		m_state->lanes[i].splice(m_state->lanes[i].end(), moved[i]);
+}
+
+bool PriorityScheduler::cancel(Key key)
+{
+	std::lock_guard<std::mutex> lock(m_state->mutex);
+
+	auto it = m_state->records.find(key);
+	if (it == m_state->records.end())
+		return false;
+
+	Record& record = it->second;
+	if (record.running)
+		record.source.cancel();
+	else
+		m_state->lanes[laneOf(record.priority)].erase(record.entry);
+
+	m_state->records.erase(it);
+	return true;
+}
+
+void PriorityScheduler::cancelAll()
+{
+	std::lock_guard<std::mutex> lock(m_state->mutex);
+
+	for (auto& [key, record] : m_state->records)
+	{
+		if (record.running)
+			record.source.cancel();
+	}
+
+	for (std::list<Entry>& lane : m_state->lanes)
+		lane.clear();
+
+	m_state->records.clear();
+}
+
+bool PriorityScheduler::contains(Key key) const
+{
+	std::lock_guard<std::mutex> lock(m_state->mutex);
+	return m_state->records.count(key) != 0;
+}
+
+std::size_t PriorityScheduler::getQueuedCount(TaskPriority priority) const
+{
+	std::lock_guard<std::mutex> lock(m_state->mutex);
+	return m_state->lanes[laneOf(priority)].size();
+}
+
+std::size_t PriorityScheduler::getQueuedCount() const
+{
+	std::lock_guard<std::mutex> lock(m_state->mutex);
+
+	std::size_t count = 0;
+	for (const std::list<Entry>& lane : m_state->lanes)
+		count += lane.size();
+
+	return count;
+}
+
+void PriorityScheduler::runNext(State& state)
+{
+	Entry             entry;
+	CancellationToken token;
+
+	{
+		std::lock_guard<std::mutex> lock(state.mutex);
+
+		std::list<Entry>* lane = nullptr;
+		for (std::list<Entry>& candidate : state.lanes)
+		{
+			if (!candidate.empty())
+			{
+				lane = &candidate;
+				break;
+			}
+		}
+
+		// The job this task was added for has been cancelled, or taken by
+		// an earlier task.
+		if (lane == nullptr)
+			return;
+
+		entry = std::move(lane->front());
+		lane->pop_front();
+
+		Record& record = state.records.at(entry.key);
+		record.running = true;
+
+		token = record.source.getToken();
+	}
+
+	// Checked once more in case the job was cancelled in between, the job
+	// itself checks the token while it runs.
+	if (!token.isCancelled())
+		entry.job(token);
+
+	std::lock_guard<std::mutex> lock(state.mutex);
+
+	// Cancelling drops the record, the key may be in use by a newer job.
+	auto it = state.records.find(entry.key);
+	if (it != state.records.end() && it->second.serial == entry.serial)
+		state.records.erase(it);
+}
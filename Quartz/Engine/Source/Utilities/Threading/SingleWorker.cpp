@@ -26,54 +26,204 @@
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
 
+
 #include <Quartz/Utilities/Threading/SingleWorker.hpp>
+#include <Quartz/Utilities/Threading/ThisThread.hpp>
+
+#include <new>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	include <emmintrin.h>
+#	define QZ_CPU_RELAX() _mm_pause()
+#else
+#	define QZ_CPU_RELAX() std::this_thread::yield()
+#endif
 
 using namespace qz::utils::threading;
 
-SingleWorker::SingleWorker () : m_running (true)
+namespace
 {
-	std::thread t (&SingleWorker::threadHandle, this);
-	m_thread.swap (t);
+	/// @brief Tasks run between updates of the queue size.
+	constexpr std::size_t DRAIN_BATCH = 64;
+
+	/// @brief Rounds of polling before the idle worker parks.
+	constexpr int SPIN_ROUNDS = 64;
+
+	/// @brief The worker the current thread runs, if any.
+	thread_local const void* t_worker = nullptr;
+} // namespace
+
+SingleWorker::SingleWorker(std::size_t capacity, const std::string& name)
+    : m_capacity(capacity), m_size(0), m_running(true), m_sleeping(0),
+      m_space(0), m_spaceWaiters(0), m_name(name)
+{
+	m_thread = std::thread(&SingleWorker::threadHandle, this);
 }
 
-SingleWorker::~SingleWorker ()
+SingleWorker::~SingleWorker()
 {
-	m_running = false;
-	m_condition.notify_all ();
+	m_running.store(false);
 
-	if (m_thread.joinable ())
-		m_thread.join ();
+	if (m_sleeping.get().exchange(0) == 1)
+		m_sleeping.wakeOne();
+
+	if (m_thread.joinable())
+		m_thread.join();
 }
 
-void SingleWorker::addWork (std::function<void()>&& function)
+void SingleWorker::addWork(Task task)
 {
+	// The worker can't wait for itself to make room, so its own tasks go
+	// past the capacity.
+	if (isWorkerThread())
 	{
-		std::unique_lock<std::mutex> lock (m_mutex);
-		m_queue.emplace_back (std::move (function));
+		m_size.fetch_add(1);
+		push(task);
+
+		return;
 	}
 
-	m_condition.notify_one ();
+	while (!reserve())
+	{
+		const std::uint32_t space = m_space.get().load();
+
+		// Announced before checking again, pairing with the check in
+		// drain(), so either this sees the room or drain() sees a waiter.
+		m_spaceWaiters.fetch_add(1);
+
+		if (m_size.load() >= m_capacity)
+			m_space.wait(space);
+
+		m_spaceWaiters.fetch_sub(1);
+	}
+
+	push(task);
 }
 
-void SingleWorker::threadHandle ()
+bool SingleWorker::tryAddWork(Task& task)
 {
-	while (true)
+	if (!reserve())
+		return false;
+
+	push(task);
+	return true;
+}
+
+bool SingleWorker::isWorkerThread() const
+{
+	return t_worker == this;
+}
+
+bool SingleWorker::reserve()
+{
+	if (m_capacity == 0)
+	{
+		m_size.fetch_add(1);
+		return true;
+	}
+
+	std::size_t size = m_size.load(std::memory_order_relaxed);
+	while (size < m_capacity)
 	{
-		std::function<void()> task;
+		if (m_size.compare_exchange_weak(size, size + 1))
+			return true;
+	}
+
+	return false;
+}
 
+void SingleWorker::push(Task& task)
+{
+	Node* node = new (NodePool::allocate()) Node();
+	node->task = std::move(task);
+
+	m_queue.push(node);
+
+	// The size was raised before this, so a worker that found nothing
+	// queued is seen here as sleeping.
+	if (m_sleeping.get().load() == 1 && m_sleeping.get().exchange(0) == 1)
+		m_sleeping.wakeOne();
+}
+
+std::size_t SingleWorker::drain()
+{
+	std::size_t count = 0;
+
+	while (count < DRAIN_BATCH)
+	{
+		MPSCNode* link = m_queue.pop();
+		if (link == nullptr)
+			break;
+
+		Node* node = static_cast<Node*>(link);
+		node->task();
+
+		node->~Node();
+		NodePool::deallocate(node);
+
+		++count;
+	}
+
+	if (count > 0)
+	{
+		m_size.fetch_sub(count);
+
+		if (m_spaceWaiters.load() > 0)
 		{
-			std::unique_lock<std::mutex> lock (m_mutex);
+			m_space.get().fetch_add(1);
+			m_space.wakeAll();
+		}
+	}
+
+	return count;
+}
+
+void SingleWorker::park()
+{
+	m_sleeping.get().store(1);
+
+	// Checked after announcing, pairing with push() and the destructor.
+	if (m_size.load() == 0 && m_running.load())
+		m_sleeping.wait(1);
+
+	m_sleeping.get().store(0);
+}
 
-			m_condition.wait (
-			    lock, [this] { return !m_running || !m_queue.empty (); });
+void SingleWorker::threadHandle()
+{
+	t_worker = this;
+	ThisThread::setName(m_name);
 
-			if (!m_running && m_queue.empty ())
-				return;
+	int idle = 0;
 
-			task = std::move (m_queue.front ());
-			m_queue.pop_front ();
+	while (true)
+	{
+		if (drain() > 0)
+		{
+			idle = 0;
+			continue;
 		}
 
-		task ();
+		const std::size_t size = m_size.load();
+
+		if (size == 0 && !m_running.load())
+			break;
+
+		if (idle < SPIN_ROUNDS)
+		{
+			++idle;
+			QZ_CPU_RELAX();
+		}
+		else if (size > 0)
+		{
+			// A push is halfway through, its node shows up shortly.
+			std::this_thread::yield();
+		}
+		else
+		{
+			park();
+			idle = 0;
+		}
 	}
 }
@@ -0,0 +1,197 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <Quartz/Utilities/Threading/TaskGraph.hpp>
+
+#include <cassert>
+#include <stdexcept>
+
+using namespace qz::utils::threading;
+
+struct TaskGraph::Execution
+{
+	std::vector<Node>                           nodes;
+	std::unique_ptr<std::atomic<std::size_t>[]> waiting;
+	std::unique_ptr<std::atomic<bool>[]>        skipped;
+	std::atomic<std::size_t>                    remaining;
+
+	std::mutex         mutex;
+	std::exception_ptr exception;
+
+	ThreadPool*                                 pool;
+	std::shared_ptr<detail::FutureState<void>> state;
+};
+
+TaskGraph::TaskID TaskGraph::addTask(std::function<void()> task)
+{
+	m_nodes.push_back({std::move(task), {}, 0});
+	return m_nodes.size() - 1;
+}
+
+void TaskGraph::addDependency(TaskID before, TaskID after)
+{
+	assert(before < m_nodes.size() && after < m_nodes.size());
+
+	m_nodes[before].successors.push_back(after);
+	++m_nodes[after].predecessorCount;
+}
+
+bool TaskGraph::isAcyclic() const
+{
+	// Kahn's algorithm, every task is reached only if there is no cycle.
+	std::vector<std::size_t> waiting(m_nodes.size());
+	std::vector<TaskID>      ready;
+
+	for (TaskID id = 0; id < m_nodes.size(); ++id)
+	{
+		waiting[id] = m_nodes[id].predecessorCount;
+		if (waiting[id] == 0)
+			ready.push_back(id);
+	}
+
+	std::size_t reached = 0;
+	while (!ready.empty())
+	{
+		const TaskID id = ready.back();
+		ready.pop_back();
+		++reached;
+
+		for (TaskID successor : m_nodes[id].successors)
+		{
+			if (--waiting[successor] == 0)
+				ready.push_back(successor);
+		}
+	}
+
+	return reached == m_nodes.size();
+}
+
+Future<void> TaskGraph::run(ThreadPool& pool) const
+{
+	auto state = std::make_shared<detail::FutureState<void>>(&pool);
+
+	if (m_nodes.empty())
+	{
+		state->finish(nullptr);
+		return Future<void>(std::move(state));
+	}
+
+	if (!isAcyclic())
+	{
+		state->finish(std::make_exception_ptr(
+		    std::invalid_argument("TaskGraph has a dependency cycle")));
+		return Future<void>(std::move(state));
+	}
+
+	auto execution     = std::make_shared<Execution>();
+	execution->nodes   = m_nodes;
+	execution->waiting = std::make_unique<std::atomic<std::size_t>[]>(
+	    m_nodes.size());
+	execution->skipped =
+	    std::make_unique<std::atomic<bool>[]>(m_nodes.size());
+	execution->remaining.store(m_nodes.size());
+	execution->pool  = &pool;
+	execution->state = state;
+
+	for (TaskID id = 0; id < m_nodes.size(); ++id)
+	{
+		execution->waiting[id].store(m_nodes[id].predecessorCount);
+		execution->skipped[id].store(false);
+	}
+
+	// Every count is set before the first task starts.
+	for (TaskID id = 0; id < m_nodes.size(); ++id)
+	{
+		if (m_nodes[id].predecessorCount == 0)
+			schedule(execution, id);
+	}
+
+	return Future<void>(std::move(state));
+}
+
+void TaskGraph::schedule(const ExecutionPtr& execution, TaskID id)
+{
+	execution->pool->addWork([execution, id]() { execute(execution, id); });
+}
+
+void TaskGraph::execute(const ExecutionPtr& execution, TaskID id)
+{
+	Node& node = execution->nodes[id];
+
+	// A skipped task is still counted down, so its own successors are
+	// skipped in turn and the future becomes ready.
+	bool skip = execution->skipped[id].load(std::memory_order_relaxed);
+	if (!skip)
+	{
+		try
+		{
+			if (node.task)
+				node.task();
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(execution->mutex);
+
+			if (!execution->exception)
+				execution->exception = std::current_exception();
+
+			skip = true;
+		}
+	}
+
+	// Release the task's captures before its successors run.
+	node.task = nullptr;
+
+	for (TaskID successor : node.successors)
+	{
+		// Made visible to the successor by the count down below.
+		if (skip)
+		{
+			execution->skipped[successor].store(true,
+			                                    std::memory_order_relaxed);
+		}
+
+		if (execution->waiting[successor].fetch_sub(
+		        1, std::memory_order_acq_rel) == 1)
+		{
+			schedule(execution, successor);
+		}
+	}
+
+	if (execution->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+	{
+		std::exception_ptr exception;
+		{
+			std::lock_guard<std::mutex> lock(execution->mutex);
+			exception = execution->exception;
+		}
+
+		execution->state->finish(std::move(exception));
+	}
+}
@@ -0,0 +1,82 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <Quartz/Core.hpp>
+#include <Quartz/Utilities/Threading/ThisThread.hpp>
+
+#if defined(QZ_PLATFORM_WINDOWS)
+#	include <Windows.h>
+#elif defined(QZ_PLATFORM_LINUX) || defined(QZ_PLATFORM_APPLE)
+#	include <pthread.h>
+#endif
+
+#if defined(QZ_PLATFORM_LINUX)
+#	include <sched.h>
+#endif
+
+using namespace qz::utils::threading;
+
+bool ThisThread::setName(const std::string& name)
+{
+#if defined(QZ_PLATFORM_WINDOWS)
+	const std::wstring wide(name.begin(), name.end());
+	return SUCCEEDED(SetThreadDescription(GetCurrentThread(), wide.c_str()));
+#elif defined(QZ_PLATFORM_LINUX)
+	// Longer names are rejected rather than cut.
+	const std::string shortened = name.substr(0, 15);
+	return pthread_setname_np(pthread_self(), shortened.c_str()) == 0;
+#elif defined(QZ_PLATFORM_APPLE)
+	return pthread_setname_np(name.c_str()) == 0;
+#else
+	return false;
+#endif
+}
+
+bool ThisThread::pinTo(unsigned int cpu)
+{
+#if defined(QZ_PLATFORM_WINDOWS)
+	if (cpu >= sizeof(DWORD_PTR) * 8)
+		return false;
+
+	const DWORD_PTR mask = DWORD_PTR(1) << cpu;
+	return SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#elif defined(QZ_PLATFORM_LINUX)
+	if (cpu >= CPU_SETSIZE)
+		return false;
+
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+	// macOS only takes affinity tags as hints, which can't name a CPU.
+	return false;
+#endif
+}
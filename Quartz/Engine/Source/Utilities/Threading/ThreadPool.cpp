@@ -26,57 +26,350 @@
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
 
+
+#include <Quartz/Utilities/Threading/ThisThread.hpp>
 #include <Quartz/Utilities/Threading/ThreadPool.hpp>
 
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	include <emmintrin.h>
+#	define QZ_CPU_RELAX() _mm_pause()
+#else
+#	define QZ_CPU_RELAX() std::this_thread::yield()
+#endif
+
 using namespace qz::utils::threading;
 
-ThreadPool::ThreadPool (const std::size_t threadCount)
+namespace
 {
+	/// @brief Slots in the lock free injection queue.
+	constexpr std::size_t INJECTION_CAPACITY = 4096;
+
+	/// @brief Rounds of looking for work before an idle worker parks.
+	constexpr int SPIN_ROUNDS  = 64;
+	constexpr int YIELD_ROUNDS = 16;
+
+	/// @brief How often a busy worker checks the shared queues before its
+	/// own deque, so work from outside the pool can't starve.
+	constexpr std::uint32_t FAIRNESS_INTERVAL = 61;
+
+	/// @brief The pool and worker the current thread belongs to, if any.
+	thread_local const void* t_pool   = nullptr;
+	thread_local void*       t_worker = nullptr;
+
+	/**
+	 * @brief The CPUs ONE_PER_CORE pins workers to, in order: one per
+	 * physical core, then the SMT siblings of those same cores.
+	 */
+	std::vector<LogicalCpu> getPinningOrder(bool leaveFirstCore)
+	{
+		const CpuTopology topology = CpuTopology::probe();
+
+		std::vector<LogicalCpu> cpus = topology.getOnePerCore(leaveFirstCore);
+		const std::size_t       coreCount = cpus.size();
+
+		std::vector<bool> allowed(topology.getCoreCount(), false);
+		for (const LogicalCpu& cpu : cpus)
+			allowed[cpu.core] = true;
+
+		for (const LogicalCpu& cpu : topology.getCpus())
+		{
+			if (!allowed[cpu.core])
+				continue;
+
+			const auto first = cpus.begin() + coreCount;
+			const auto taken = std::find_if(
+			    cpus.begin(), first, [&cpu](const LogicalCpu& other) {
+				    return other.index == cpu.index;
+			    });
+
+			if (taken == first)
+				cpus.push_back(cpu);
+		}
+
+		return cpus;
+	}
+
+	/// @brief Picks victims for threads outside the pool that help it.
+	thread_local std::uint64_t t_random = 0x2545F4914F6CDD1Dull;
+
+	std::uint64_t nextRandom(std::uint64_t& state)
+	{
+		// xorshift64*
+		state ^= state >> 12;
+		state ^= state << 25;
+		state ^= state >> 27;
+
+		return state * 2685821657736338717ull;
+	}
+} // namespace
+
+ThreadPool::ThreadPool(const std::size_t        threadCount,
+                       const ThreadPoolOptions& options)
+    : m_running(true), m_localArenas(options.localArenas),
+      m_injection(INJECTION_CAPACITY), m_overflowHead(0), m_overflowSize(0),
+      m_pending(0), m_sleeping(0), m_wakeups(0)
+{
+	std::vector<LogicalCpu> cpus;
+	if (options.pinning == ThreadPinning::ONE_PER_CORE)
+		cpus = getPinningOrder(options.leaveFirstCore);
+
+	for (std::size_t i = 0; i < threadCount; ++i)
+	{
+		m_workers.push_back(std::make_unique<Worker>());
+
+		Worker& worker = *m_workers.back();
+		worker.random  = 0x9E3779B97F4A7C15ull * (i + 1);
+		worker.index   = i;
+		worker.name    = options.name + " " + std::to_string(i);
+
+		// Workers beyond every logical CPU are left to the OS rather than
+		// doubled up on one.
+		if (i < cpus.size())
+			worker.cpu = cpus[i];
+	}
+
+	// Started once every worker exists, since any may be stolen from.
 	for (std::size_t i = 0; i < threadCount; ++i)
+		m_workers[i]->thread = std::thread(&ThreadPool::threadHandle, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_running.store(false);
+		++m_wakeups;
+	}
+
+	m_condition.notify_all();
+
+	for (std::unique_ptr<Worker>& worker : m_workers)
+		worker->thread.join();
+}
+
+void ThreadPool::addWork(Task task)
+{
+	push(TaskAllocator::create(std::move(task)));
+}
+
+bool ThreadPool::isWorkerThread() const
+{
+	return t_pool == this;
+}
+
+std::optional<std::size_t> ThreadPool::getWorkerIndex() const
+{
+	if (t_pool != this)
+		return std::nullopt;
+
+	return static_cast<Worker*>(t_worker)->index;
+}
+
+std::optional<LogicalCpu> ThreadPool::getWorkerCpu(std::size_t index) const
+{
+	return m_workers[index]->cpu;
+}
+
+void ThreadPool::push(Task* task)
+{
+	// Counted before it is visible, so a worker that sees nothing pending
+	// has to be seen as sleeping by the check below.
+	m_pending.fetch_add(1);
+
+	if (t_pool == this)
+	{
+		static_cast<Worker*>(t_worker)->deque.push(task);
+	}
+	else if (!m_injection.tryPush(task))
+	{
+		std::lock_guard<std::mutex> lock(m_overflowMutex);
+
+		const std::size_t size     = m_overflowSize.load();
+		const std::size_t capacity = m_overflow.size();
+		if (size == capacity)
+		{
+			std::vector<Task*> grown(std::max<std::size_t>(64, capacity * 2));
+			for (std::size_t i = 0; i < size; ++i)
+				grown[i] = m_overflow[(m_overflowHead + i) % capacity];
+
+			m_overflow.swap(grown);
+			m_overflowHead = 0;
+		}
+
+		m_overflow[(m_overflowHead + size) % m_overflow.size()] = task;
+		m_overflowSize.fetch_add(1, std::memory_order_release);
+	}
+
+	if (m_sleeping.load() > 0)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			++m_wakeups;
+		}
+
+		m_condition.notify_one();
+	}
+}
+
+Task* ThreadPool::takeShared()
+{
+	Task* task = nullptr;
+
+	if (m_injection.tryPop(task))
+		return task;
+
+	if (m_overflowSize.load(std::memory_order_acquire) > 0)
+	{
+		std::lock_guard<std::mutex> lock(m_overflowMutex);
+		if (m_overflowSize.load(std::memory_order_relaxed) > 0)
+		{
+			task           = m_overflow[m_overflowHead];
+			m_overflowHead = (m_overflowHead + 1) % m_overflow.size();
+			m_overflowSize.fetch_sub(1, std::memory_order_relaxed);
+
+			return task;
+		}
+	}
+
+	return nullptr;
+}
+
+Task* ThreadPool::findWork(Worker* self)
+{
+	Task* task = nullptr;
+
+	if (self != nullptr && self->deque.pop(task))
+		return task;
+
+	task = takeShared();
+	if (task != nullptr)
+		return task;
+
+	const std::size_t count = m_workers.size();
+	if (count == 0)
+		return nullptr;
+
+	std::uint64_t& random = self != nullptr ? self->random : t_random;
+
+	const std::size_t first = nextRandom(random) % count;
+	for (std::size_t i = 0; i < count; ++i)
 	{
-		m_threads.emplace_back (&ThreadPool::threadHandle, this);
+		Worker* victim = m_workers[(first + i) % count].get();
+		if (victim != self && victim->deque.steal(task))
+			return task;
 	}
+
+	return nullptr;
+}
+
+void ThreadPool::runTask(Task* task)
+{
+	m_pending.fetch_sub(1);
+
+	(*task)();
+	TaskAllocator::destroy(task);
 }
 
-ThreadPool::~ThreadPool ()
+bool ThreadPool::runPendingTask()
 {
-	m_running = false;
-	m_condition.notify_all ();
+	Worker* self =
+	    t_pool == this ? static_cast<Worker*>(t_worker) : nullptr;
+
+	Task* task = findWork(self);
+	if (task == nullptr)
+		return false;
 
-	for (std::thread& taskWorker : m_threads)
-		taskWorker.join ();
+	runTask(task);
+	return true;
 }
 
-void ThreadPool::addWork (std::function<void()> fun)
+void ThreadPool::park()
 {
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	// Announced before checking, pairing with the check in push(), so
+	// either this sees the new work or push() sees this sleeping.
+	m_sleeping.fetch_add(1);
+
+	if (m_pending.load() == 0 && m_running.load())
 	{
-		std::lock_guard<std::mutex> lock (m_mutex);
-		m_scheduledTasks.emplace_back (fun);
+		const std::uint64_t wakeups = m_wakeups;
+		m_condition.wait(lock, [this, wakeups] {
+			return m_wakeups != wakeups;
+		});
 	}
 
-	m_condition.notify_one ();
+	m_sleeping.fetch_sub(1);
+}
+
+void ThreadPool::setUpWorker(Worker& self)
+{
+	ThisThread::setName(self.name);
+
+	if (!self.cpu || !ThisThread::pinTo(self.cpu->index))
+		return;
+
+	// Blocks are placed where they are first touched, so tasks this worker
+	// queues start out in memory local to the core it now stays on.
+	if (m_localArenas)
+		TaskAllocator::Pool::reserveLocal();
 }
 
-void ThreadPool::threadHandle ()
+void ThreadPool::threadHandle(std::size_t index)
 {
+	Worker* self = m_workers[index].get();
+
+	t_pool   = this;
+	t_worker = self;
+
+	setUpWorker(*self);
+
+	std::uint32_t taken = 0;
+	int           idle  = 0;
+
 	while (true)
 	{
-		std::function<void()> task;
+		Task* task = nullptr;
 
-		{
-			std::unique_lock<std::mutex> lock (m_mutex);
+		// Now and then the shared queues go first, so a worker feeding
+		// itself can't leave outside work waiting forever.
+		if (++taken % FAIRNESS_INTERVAL == 0)
+			task = takeShared();
 
-			m_condition.wait (lock, [this]() {
-				return !m_running || !m_scheduledTasks.empty ();
-			});
+		if (task == nullptr)
+			task = findWork(self);
 
-			if (!m_running && m_scheduledTasks.empty ())
-				return;
+		if (task != nullptr)
+		{
+			runTask(task);
+			idle = 0;
 
-			task = m_scheduledTasks.front ();
-			m_scheduledTasks.pop_front ();
+			continue;
 		}
 
-		task ();
+		if (!m_running.load() && m_pending.load() == 0)
+			break;
+
+		if (idle < SPIN_ROUNDS)
+		{
+			++idle;
+			QZ_CPU_RELAX();
+		}
+		else if (idle < SPIN_ROUNDS + YIELD_ROUNDS)
+		{
+			++idle;
+			std::this_thread::yield();
+		}
+		else
+		{
+			park();
+			idle = 0;
+		}
 	}
+
+	t_pool   = nullptr;
+	t_worker = nullptr;
 }
@@ -0,0 +1,158 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <Quartz/Voxels/BlockEntities.hpp>
+
+#include <algorithm>
+
+using namespace qz::voxels;
+
+BlockEntityStorage::BlockEntityStorage(BlockEntityStorage&& other) noexcept
+    : m_entries(std::move(other.m_entries)), m_pool(std::move(other.m_pool)),
+      m_tickableCount(other.m_tickableCount)
+{
+	other.m_entries.clear();
+	other.m_tickableCount = 0;
+}
+
+BlockEntityStorage& BlockEntityStorage::operator=(
+    BlockEntityStorage&& other) noexcept
+{
+	if (this == &other)
+		return *this;
+
+	clear();
+
+	m_entries       = std::move(other.m_entries);
+	m_pool          = std::move(other.m_pool);
+	m_tickableCount = other.m_tickableCount;
+
+	other.m_entries.clear();
+	other.m_tickableCount = 0;
+
+	return *this;
+}
+
+std::vector<BlockEntityStorage::Entry>::iterator BlockEntityStorage::find(
+    std::uint32_t index)
+{
+	return std::lower_bound(
+	    m_entries.begin(), m_entries.end(), index,
+	    [](const Entry& entry, std::uint32_t value) {
+		    return entry.index < value;
+	    });
+}
+
+BlockEntity* BlockEntityStorage::get(std::uint32_t index) const
+{
+	const auto it = std::lower_bound(
+	    m_entries.begin(), m_entries.end(), index,
+	    [](const Entry& entry, std::uint32_t value) {
+		    return entry.index < value;
+	    });
+
+	return it != m_entries.end() && it->index == index ? it->entity
+	                                                   : nullptr;
+}
+
+void BlockEntityStorage::insert(std::uint32_t index, BlockEntity* entity)
+{
+	const Entry entry = {index, entity->isTickable(), entity};
+
+	auto it = find(index);
+	if (it != m_entries.end() && it->index == index)
+	{
+		if (it->tickable)
+			--m_tickableCount;
+
+		destroy(it->entity);
+		*it = entry;
+	}
+	else
+	{
+		try
+		{
+			m_entries.insert(it, entry);
+		}
+		catch (...)
+		{
+			destroy(entity);
+			throw;
+		}
+	}
+
+	// Only counted once stored, so a failed insert leaves the count alone.
+	if (entry.tickable)
+		++m_tickableCount;
+}
+
+bool BlockEntityStorage::erase(std::uint32_t index)
+{
+	auto it = find(index);
+	if (it == m_entries.end() || it->index != index)
+		return false;
+
+	if (it->tickable)
+		--m_tickableCount;
+
+	destroy(it->entity);
+	m_entries.erase(it);
+
+	return true;
+}
+
+void BlockEntityStorage::clear()
+{
+	for (const Entry& entry : m_entries)
+		destroy(entry.entity);
+
+	m_entries.clear();
+	m_tickableCount = 0;
+}
+
+void BlockEntityStorage::tick(Chunk& chunk)
+{
+	if (m_tickableCount == 0)
+		return;
+
+	for (const Entry& entry : m_entries)
+	{
+		if (entry.tickable)
+			entry.entity->tick(chunk, entry.index);
+	}
+}
+
+void BlockEntityStorage::destroy(BlockEntity* entity)
+{
+	// The most derived object starts at the beginning of its cell.
+	Cell* cell = static_cast<Cell*>(dynamic_cast<void*>(entity));
+
+	entity->~BlockEntity();
+	m_pool.destroy(cell);
+}
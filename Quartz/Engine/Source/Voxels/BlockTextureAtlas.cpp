@@ -0,0 +1,984 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <Quartz/Graphics/Mipmaps.hpp>
+#include <Quartz/Graphics/SkylinePacker.hpp>
+#include <Quartz/Utilities/Logger.hpp>
+#include <Quartz/Utilities/Threading/ParallelFor.hpp>
+#include <Quartz/Utilities/Threading/ThreadPool.hpp>
+#include <Quartz/Voxels/BlockTextureAtlas.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <initializer_list>
+#include <memory>
+
+// Failure strings live in a global, which images decoding on several
+// threads would race on.
+#define STBI_NO_FAILURE_STRINGS
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.hpp>
+
+using namespace qz::voxels;
+using qz::utils::threading::ThreadPool;
+using qz::utils::threading::parallelFor;
+
+const BlockTextureAtlas::SpriteID BlockTextureAtlas::INVALID_SPRITE;
+
+namespace
+{
+	struct ImageDeleter
+	{
+		void operator()(unsigned char* image) const { stbi_image_free(image); }
+	};
+
+	typedef std::unique_ptr<unsigned char, ImageDeleter> ImagePtr;
+
+	/**
+	 * @brief A texture file, read into memory so that it can be decoded
+	 * on any thread.
+	 */
+	struct TextureFile
+	{
+		std::string                filepath;
+		std::vector<unsigned char> bytes;
+		std::uint64_t              hash   = 0;
+		int                        width  = 0;
+		int                        height = 0;
+		bool                       valid  = false;
+	};
+
+	/**
+	 * @brief Hashes a file with 64 bit FNV-1a, to find duplicates.
+	 */
+	std::uint64_t hashBytes(const std::vector<unsigned char>& bytes)
+	{
+		std::uint64_t hash = 14695981039346656037ull;
+		for (unsigned char byte : bytes)
+		{
+			hash ^= byte;
+			hash *= 1099511628211ull;
+		}
+
+		return hash;
+	}
+
+	bool readFile(const std::string& filepath,
+	              std::vector<unsigned char>& bytes)
+	{
+		std::ifstream file(filepath, std::ios::binary | std::ios::ate);
+		if (!file)
+			return false;
+
+		bytes.resize(static_cast<std::size_t>(file.tellg()));
+		file.seekg(0);
+		file.read(reinterpret_cast<char*>(bytes.data()),
+		          static_cast<std::streamsize>(bytes.size()));
+
+		return static_cast<bool>(file);
+	}
+
+	/// @brief "QZAT" in little endian.
+	constexpr std::uint32_t CACHE_MAGIC   = 0x54415A51;
+	constexpr std::uint32_t CACHE_VERSION = 3;
+
+	/// @brief Rows of blocks compressed by each job.
+	constexpr std::size_t COMPRESSION_ROWS_PER_JOB = 8;
+
+	/// @brief Texels start on a multiple of this, within the cache file.
+	constexpr std::size_t CACHE_ALIGNMENT = 64;
+
+	/**
+	 * @brief Hashes the texture files, in order, along with the settings
+	 * that affect the atlas built from them.
+	 */
+	std::uint64_t getCacheKey(const std::vector<TextureFile>& files,
+	                          std::initializer_list<std::uint64_t> settings)
+	{
+		std::uint64_t hash = 14695981039346656037ull;
+
+		const auto mix = [&hash](std::uint64_t value) {
+			for (int i = 0; i < 8; ++i)
+			{
+				hash ^= (value >> (i * 8)) & 0xFF;
+				hash *= 1099511628211ull;
+			}
+		};
+
+		for (std::uint64_t setting : settings)
+			mix(setting);
+
+		for (const TextureFile& file : files)
+		{
+			for (char c : file.filepath)
+				mix(static_cast<unsigned char>(c));
+
+			mix(file.filepath.size());
+			mix(file.valid ? file.hash : 0);
+			mix(file.bytes.size());
+		}
+
+		return hash;
+	}
+
+	void appendU32(std::string& out, std::uint32_t value)
+	{
+		for (int i = 0; i < 4; ++i)
+			out.push_back(static_cast<char>((value >> (i * 8)) & 0xFF));
+	}
+
+	void appendU64(std::string& out, std::uint64_t value)
+	{
+		appendU32(out, static_cast<std::uint32_t>(value));
+		appendU32(out, static_cast<std::uint32_t>(value >> 32));
+	}
+
+	/**
+	 * @brief Reads little endian values from a mapped file, failing once
+	 * the end is reached.
+	 */
+	class CacheReader
+	{
+	public:
+		CacheReader(const unsigned char* data, std::size_t size)
+		    : m_data(data), m_size(size), m_offset(0), m_good(true)
+		{
+		}
+
+		std::uint32_t readU32()
+		{
+			if (!ensure(4))
+				return 0;
+
+			std::uint32_t value = 0;
+			for (int i = 0; i < 4; ++i)
+				value |= static_cast<std::uint32_t>(m_data[m_offset++])
+				         << (i * 8);
+
+			return value;
+		}
+
+		std::uint64_t readU64()
+		{
+			const std::uint64_t low = readU32();
+			return low | (static_cast<std::uint64_t>(readU32()) << 32);
+		}
+
+		std::string readString(std::size_t length)
+		{
+			if (!ensure(length))
+				return std::string();
+
+			std::string value(reinterpret_cast<const char*>(m_data) + m_offset,
+			                  length);
+			m_offset += length;
+
+			return value;
+		}
+
+		bool        good() const { return m_good; }
+		std::size_t getRemaining() const { return m_size - m_offset; }
+
+	private:
+		bool ensure(std::size_t count)
+		{
+			m_good = m_good && count <= m_size - m_offset;
+			return m_good;
+		}
+
+	private:
+		const unsigned char* m_data;
+		std::size_t          m_size;
+		std::size_t          m_offset;
+		bool                 m_good;
+	};
+
+	std::size_t roundUp(std::size_t value, std::size_t multiple)
+	{
+		return (value + multiple - 1) / multiple * multiple;
+	}
+
+	/**
+	 * @brief Checks level offsets read from a cache, which must start at
+	 * zero and step by exactly the size of each level of a width by height
+	 * texture, as given by levelSize(levelWidth, levelHeight).
+	 */
+	template <typename LevelSize>
+	bool checkLevelOffsets(const std::vector<std::size_t>& offsets,
+	                       std::size_t width, std::size_t height,
+	                       const LevelSize& levelSize)
+	{
+		if (offsets.empty() || offsets.front() != 0)
+			return false;
+
+		for (std::size_t level = 0; level + 1 < offsets.size(); ++level)
+		{
+			const std::size_t expected =
+			    levelSize(std::max<std::size_t>(1, width >> level),
+			              std::max<std::size_t>(1, height >> level));
+
+			if (offsets[level + 1] < offsets[level] ||
+			    offsets[level + 1] - offsets[level] != expected)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+} // namespace
+
+BlockTextureAtlas::BlockTextureAtlas(std::size_t spriteWidth,
+                                     std::size_t spriteHeight)
+    : m_layout(Layout::ATLAS), m_layerCount(1), m_spriteWidth(spriteWidth),
+      m_spriteHeight(spriteHeight), m_padding(2),
+      m_maxMipLevelCount(4), m_separateMipLevelCount(0),
+      m_patchedTextureData(nullptr), m_textureData(nullptr),
+      m_compressedFormat(gfx::TextureFormat::RGBA8),
+      m_compressedData(nullptr), m_patchedTextureWidth(0),
+      m_patchedTextureHeight(0)
+{
+}
+
+BlockTextureAtlas::BlockTextureAtlas() : BlockTextureAtlas(0, 0) {}
+
+void BlockTextureAtlas::setSpriteWidth(std::size_t w) { m_spriteWidth = w; }
+
+void BlockTextureAtlas::setSpriteHeight(std::size_t h) { m_spriteHeight = h; }
+
+void BlockTextureAtlas::addTextureFile(const char* texturefilepath)
+{
+	m_textureIDMap.insert(std::make_pair(std::string(texturefilepath),
+	                                     BlockTextureAtlas::INVALID_SPRITE));
+}
+
+BlockTextureAtlas::SpriteID BlockTextureAtlas::getSpriteIDFromFilepath(
+    const char* filepath)
+{
+	const auto it = m_textureIDMap.find(filepath);
+	if (it == m_textureIDMap.end())
+		return BlockTextureAtlas::INVALID_SPRITE;
+
+	return it->second;
+}
+
+std::size_t BlockTextureAtlas::getMipLevelWidth(std::size_t level) const
+{
+	return std::max<std::size_t>(1, m_patchedTextureWidth >> level);
+}
+
+std::size_t BlockTextureAtlas::getMipLevelHeight(std::size_t level) const
+{
+	return std::max<std::size_t>(1, m_patchedTextureHeight >> level);
+}
+
+qz::RectAABB BlockTextureAtlas::getSpriteFromID(
+    BlockTextureAtlas::SpriteID spriteID) const
+{
+	qz::RectAABB uv;
+
+	if (spriteID < 0 || static_cast<std::size_t>(spriteID) >= m_sprites.size())
+		return uv;
+
+	const Sprite& sprite = m_sprites[spriteID];
+
+	const float xUv = static_cast<float>(sprite.x) / m_patchedTextureWidth;
+	const float yUv = static_cast<float>(sprite.y) / m_patchedTextureHeight;
+
+	const float widthUv =
+	    static_cast<float>(sprite.width) / m_patchedTextureWidth;
+	const float heightUv =
+	    static_cast<float>(sprite.height) / m_patchedTextureHeight;
+
+	uv.topLeft     = {xUv, yUv};
+	uv.topRight    = {xUv + widthUv, yUv};
+	uv.bottomLeft  = {xUv, yUv + heightUv};
+	uv.bottomRight = {xUv + widthUv, yUv + heightUv};
+
+	return uv;
+}
+
+void BlockTextureAtlas::blitSprite(const Sprite&        sprite,
+                                   const unsigned char* image,
+                                   std::size_t          padding)
+{
+	// The padded area, clipped to the atlas.
+	const std::size_t left = sprite.x - std::min(sprite.x, padding);
+	const std::size_t top  = sprite.y - std::min(sprite.y, padding);
+	const std::size_t right =
+	    std::min(sprite.x + sprite.width + padding, m_patchedTextureWidth);
+	const std::size_t bottom =
+	    std::min(sprite.y + sprite.height + padding, m_patchedTextureHeight);
+
+	for (std::size_t y = top; y < bottom; ++y)
+	{
+		const std::size_t sourceY =
+		    std::min(std::max(y, sprite.y), sprite.y + sprite.height - 1) -
+		    sprite.y;
+
+		const unsigned char* sourceRow = image + sourceY * sprite.width * 4;
+		unsigned char*       row =
+		    m_patchedTextureData + y * m_patchedTextureWidth * 4;
+
+		for (std::size_t x = left; x < right; ++x)
+		{
+			const std::size_t sourceX =
+			    std::min(std::max(x, sprite.x), sprite.x + sprite.width - 1) -
+			    sprite.x;
+
+			std::memcpy(row + x * 4, sourceRow + sourceX * 4, 4);
+		}
+	}
+}
+
+bool BlockTextureAtlas::packSprites(std::size_t& padding)
+{
+	// Sprites stay separate down to the level where the smallest would be a
+	// single texel, as long as they start on a multiple of its scale.
+	std::size_t smallest = std::min(m_spriteWidth, m_spriteHeight);
+	for (const Sprite& sprite : m_sprites)
+	{
+		const std::size_t side = std::min(sprite.width, sprite.height);
+		smallest = smallest == 0 ? side : std::min(smallest, side);
+	}
+
+	m_separateMipLevelCount =
+	    std::max<std::size_t>(1, std::min(m_maxMipLevelCount,
+	                                       gfx::getMipLevelCount(smallest, 1)));
+
+	const std::size_t alignment = std::size_t(1)
+	                              << (m_separateMipLevelCount - 1);
+	padding = std::max(m_padding, alignment / 2);
+
+	// Packed cells are multiples of the alignment, and start on one. The
+	// atlas starts `shift` texels into the packed area, which puts each
+	// sprite, `padding` texels into its cell, on a multiple as well.
+	const std::size_t shift = padding % alignment;
+
+	std::vector<gfx::PackedRect> cells(m_sprites.size());
+	for (std::size_t i = 0; i < m_sprites.size(); ++i)
+	{
+		cells[i].width  = roundUp(m_sprites[i].width + padding * 2, alignment);
+		cells[i].height = roundUp(m_sprites[i].height + padding * 2, alignment);
+	}
+
+	if (!gfx::packRects(cells, MAX_SIZE, m_patchedTextureWidth,
+	                    m_patchedTextureHeight))
+	{
+		LFATAL("Block textures do not fit in a ", MAX_SIZE, "x", MAX_SIZE,
+		       " atlas");
+
+		return false;
+	}
+
+	for (std::size_t i = 0; i < m_sprites.size(); ++i)
+	{
+		m_sprites[i].x = cells[i].x + padding - shift;
+		m_sprites[i].y = cells[i].y + padding - shift;
+	}
+
+	return true;
+}
+
+bool BlockTextureAtlas::layOutLayers()
+{
+	if (m_sprites.size() > MAX_LAYERS)
+	{
+		LFATAL("Block textures do not fit in ", MAX_LAYERS,
+		       " texture array layers");
+
+		return false;
+	}
+
+	std::size_t width  = m_spriteWidth;
+	std::size_t height = m_spriteHeight;
+	for (const Sprite& sprite : m_sprites)
+	{
+		if (m_spriteWidth == 0)
+			width = std::max(width, sprite.width);
+
+		if (m_spriteHeight == 0)
+			height = std::max(height, sprite.height);
+	}
+
+	if (width > MAX_SIZE || height > MAX_SIZE)
+	{
+		LFATAL("Block textures are larger than ", MAX_SIZE, "x", MAX_SIZE);
+		return false;
+	}
+
+	m_layerCount           = m_sprites.size();
+	m_patchedTextureWidth  = width;
+	m_patchedTextureHeight = height;
+
+	// Layers never blend into each other, at any level.
+	m_separateMipLevelCount = gfx::getMipLevelCount(width, height);
+
+	for (Sprite& sprite : m_sprites)
+		sprite = {0, 0, width, height};
+
+	return true;
+}
+
+void BlockTextureAtlas::blitLayer(std::size_t layer, const unsigned char* image,
+                                  std::size_t width, std::size_t height)
+{
+	unsigned char* texels = m_patchedTextureData + layer * getLayerSize();
+
+	for (std::size_t y = 0; y < m_patchedTextureHeight; ++y)
+	{
+		const unsigned char* sourceRow =
+		    image + (y * height / m_patchedTextureHeight) * width * 4;
+
+		for (std::size_t x = 0; x < m_patchedTextureWidth; ++x)
+		{
+			std::memcpy(texels + (y * m_patchedTextureWidth + x) * 4,
+			            sourceRow + (x * width / m_patchedTextureWidth) * 4, 4);
+		}
+	}
+}
+
+void BlockTextureAtlas::patch(ThreadPool* pool)
+{
+	delete[] m_patchedTextureData;
+	m_patchedTextureData = nullptr;
+	m_textureData        = nullptr;
+	m_cache.close();
+
+	m_compressedStorage.clear();
+	m_compressedData = nullptr;
+	m_compressedOffsets.clear();
+
+	m_sprites.clear();
+	m_mipOffsets.clear();
+	m_layerCount            = 1;
+	m_separateMipLevelCount = 0;
+	m_patchedTextureWidth   = 0;
+	m_patchedTextureHeight  = 0;
+
+	m_decodeTimings.clear();
+
+	// Sorted, so sprite IDs don't depend on the order of the hash map or on
+	// the order the files finish loading in.
+	std::vector<TextureFile> files(m_textureIDMap.size());
+	{
+		std::size_t i = 0;
+		for (const auto& texture : m_textureIDMap)
+			files[i++].filepath = texture.first;
+	}
+
+	std::sort(files.begin(), files.end(),
+	          [](const TextureFile& a, const TextureFile& b) {
+		          return a.filepath < b.filepath;
+	          });
+
+	// Reading and hashing files, and reading the size from their headers,
+	// is enough to lay the atlas out before anything is decoded.
+	parallelFor(pool, 0, files.size(), 1, [&files](std::size_t i) {
+		TextureFile& file = files[i];
+		if (!readFile(file.filepath, file.bytes) || file.bytes.empty())
+			return;
+
+		int       channels = 0;
+		const int known    = stbi_info_from_memory(
+		    file.bytes.data(), static_cast<int>(file.bytes.size()),
+		    &file.width, &file.height, &channels);
+
+		file.valid = known != 0 && file.width > 0 && file.height > 0;
+
+		file.hash = hashBytes(file.bytes);
+	});
+
+	// Everything the atlas is built from goes into the cache key.
+	std::uint64_t cacheKey = 0;
+	if (!m_cacheFilepath.empty())
+	{
+		cacheKey = getCacheKey(files, {CACHE_VERSION, m_spriteWidth,
+		                               m_spriteHeight, m_padding,
+		                               m_maxMipLevelCount,
+		                               static_cast<std::uint64_t>(
+		                                   m_compressedFormat),
+		                               static_cast<std::uint64_t>(m_layout)});
+
+		if (loadCache(cacheKey))
+		{
+			for (const TextureFile& file : files)
+			{
+				if (!file.valid)
+					LFATAL("Could not load block texture: ", file.filepath);
+			}
+
+			return;
+		}
+	}
+
+	// Identical files share a sprite, each sprite decodes its first file.
+	std::vector<std::size_t> spriteFiles;
+	std::unordered_map<std::uint64_t, std::vector<SpriteID>> spritesByHash;
+
+	for (std::size_t i = 0; i < files.size(); ++i)
+	{
+		const TextureFile& file = files[i];
+		if (!file.valid)
+		{
+			LFATAL("Could not load block texture: ", file.filepath);
+			m_textureIDMap[file.filepath] = INVALID_SPRITE;
+			continue;
+		}
+
+		std::vector<SpriteID>& candidates = spritesByHash[file.hash];
+
+		SpriteID sprite = INVALID_SPRITE;
+		for (SpriteID candidate : candidates)
+		{
+			if (files[spriteFiles[candidate]].bytes == file.bytes)
+			{
+				sprite = candidate;
+				break;
+			}
+		}
+
+		if (sprite == INVALID_SPRITE)
+		{
+			sprite = static_cast<SpriteID>(spriteFiles.size());
+			candidates.push_back(sprite);
+			spriteFiles.push_back(i);
+		}
+
+		m_textureIDMap[file.filepath] = sprite;
+	}
+
+	if (spriteFiles.empty())
+		return;
+
+	m_sprites.reserve(spriteFiles.size());
+	for (std::size_t i : spriteFiles)
+	{
+		m_sprites.push_back({0, 0, static_cast<std::size_t>(files[i].width),
+		                     static_cast<std::size_t>(files[i].height)});
+	}
+
+	std::size_t padding = 0;
+
+	const bool laidOut = m_layout == Layout::TEXTURE_ARRAY
+	                         ? layOutLayers()
+	                         : packSprites(padding);
+	if (!laidOut)
+	{
+		m_sprites.clear();
+		m_layerCount            = 1;
+		m_patchedTextureWidth   = 0;
+		m_patchedTextureHeight  = 0;
+		m_separateMipLevelCount = 0;
+		for (auto& texture : m_textureIDMap)
+			texture.second = INVALID_SPRITE;
+
+		return;
+	}
+
+	const std::size_t levelCount = gfx::getMipLevelCount(
+	    m_patchedTextureWidth, m_patchedTextureHeight);
+
+	m_mipOffsets.push_back(0);
+	for (std::size_t level = 0; level < levelCount; ++level)
+	{
+		const std::size_t size =
+		    getMipLevelWidth(level) * getMipLevelHeight(level) * 4;
+
+		m_mipOffsets.push_back(m_mipOffsets.back() + size);
+	}
+
+	// Value initialised, so the gaps between sprites are transparent black.
+	m_patchedTextureData = new unsigned char[getPatchedTextureSize()]();
+	m_textureData        = m_patchedTextureData;
+
+	// Padded sprites and layers never overlap, so every job decodes
+	// straight into its own part of the texture. The logger isn't thread
+	// safe, so results are reported once every job is done.
+	std::vector<char> decoded(spriteFiles.size(), 0);
+
+	m_decodeTimings.resize(spriteFiles.size());
+	parallelFor(pool, 0, spriteFiles.size(), 1, [&, this](std::size_t i) {
+		const TextureFile& file   = files[spriteFiles[i]];
+		const Sprite&      sprite = m_sprites[i];
+
+		const auto start = std::chrono::steady_clock::now();
+
+		// Images with fewer channels are expanded, with opaque alpha.
+		int      width = 0, height = 0, channels = 0;
+		ImagePtr pixels(stbi_load_from_memory(
+		    file.bytes.data(), static_cast<int>(file.bytes.size()), &width,
+		    &height, &channels, 4));
+
+		const bool matches = width == file.width && height == file.height;
+
+		if (pixels != nullptr && matches)
+		{
+			if (m_layout == Layout::TEXTURE_ARRAY)
+			{
+				blitLayer(i, pixels.get(), static_cast<std::size_t>(width),
+				          static_cast<std::size_t>(height));
+			}
+			else
+			{
+				blitSprite(sprite, pixels.get(), padding);
+			}
+
+			decoded[i] = 1;
+		}
+
+		const auto elapsed = std::chrono::steady_clock::now() - start;
+
+		DecodeTiming& timing = m_decodeTimings[i];
+		timing.filepath      = file.filepath;
+		timing.microseconds  = static_cast<std::uint64_t>(
+		    std::chrono::duration_cast<std::chrono::microseconds>(elapsed)
+		        .count());
+	});
+
+	for (std::size_t i = 0; i < m_decodeTimings.size(); ++i)
+	{
+		const DecodeTiming& timing = m_decodeTimings[i];
+
+		if (decoded[i] == 0)
+			LFATAL("Could not decode block texture: ", timing.filepath);
+
+		LDEBUG("Decoded ", timing.filepath, " in ", timing.microseconds,
+		       "us");
+	}
+
+	const auto downsampleLayer = [levelCount, this](std::size_t layer) {
+		unsigned char* texels = m_patchedTextureData + layer * getLayerSize();
+
+		for (std::size_t level = 1; level < levelCount; ++level)
+		{
+			gfx::downsampleSRGB(texels + m_mipOffsets[level - 1],
+			                    getMipLevelWidth(level - 1),
+			                    getMipLevelHeight(level - 1),
+			                    texels + m_mipOffsets[level]);
+		}
+	};
+
+	parallelFor(pool, 0, m_layerCount, 1, downsampleLayer);
+
+	compressMipLevels(pool);
+
+	if (!m_cacheFilepath.empty())
+		saveCache(cacheKey);
+}
+
+void BlockTextureAtlas::compressMipLevels(ThreadPool* pool)
+{
+	if (m_compressedFormat == gfx::TextureFormat::RGBA8)
+		return;
+
+	struct Job
+	{
+		std::size_t layer, level, firstBlockRow, blockRowCount;
+	};
+
+	// Small levels are a job each, larger ones are split so that every
+	// worker has a share of the largest.
+	std::vector<Job> jobs;
+
+	m_compressedOffsets.push_back(0);
+	for (std::size_t level = 0; level < getMipLevelCount(); ++level)
+	{
+		const std::size_t width  = getMipLevelWidth(level);
+		const std::size_t height = getMipLevelHeight(level);
+
+		const std::size_t rows = (height + 3) / 4;
+		for (std::size_t layer = 0; layer < m_layerCount; ++layer)
+		{
+			for (std::size_t row = 0; row < rows;
+			     row += COMPRESSION_ROWS_PER_JOB)
+			{
+				const std::size_t count =
+				    std::min(COMPRESSION_ROWS_PER_JOB, rows - row);
+
+				jobs.push_back({layer, level, row, count});
+			}
+		}
+
+		m_compressedOffsets.push_back(
+		    m_compressedOffsets.back() +
+		    gfx::getImageSize(m_compressedFormat, width, height));
+	}
+
+	m_compressedStorage.resize(getCompressedTextureSize());
+
+	parallelFor(pool, 0, jobs.size(), 1, [&jobs, this](std::size_t i) {
+		const Job& job = jobs[i];
+
+		unsigned char* blocks = m_compressedStorage.data() +
+		                        job.layer * getCompressedLayerSize() +
+		                        m_compressedOffsets[job.level];
+
+		gfx::compressBlockRows(
+		    getLayerMipLevelData(job.layer, job.level),
+		    getMipLevelWidth(job.level), getMipLevelHeight(job.level),
+		    m_compressedFormat, job.firstBlockRow, job.blockRowCount, blocks);
+	});
+
+	m_compressedData = m_compressedStorage.data();
+}
+
+bool BlockTextureAtlas::loadCache(std::uint64_t key)
+{
+	utils::MemoryMappedFile cache;
+	if (!cache.open(m_cacheFilepath))
+		return false;
+
+	CacheReader reader(cache.getData(), cache.getSize());
+
+	if (reader.readU32() != CACHE_MAGIC ||
+	    reader.readU32() != CACHE_VERSION || reader.readU64() != key)
+	{
+		return false;
+	}
+
+	const std::size_t width          = reader.readU32();
+	const std::size_t height         = reader.readU32();
+	const std::size_t separateLevels = reader.readU32();
+	const std::size_t levelCount     = reader.readU32();
+	const std::size_t layerCount     = reader.readU32();
+	const std::size_t spriteCount    = reader.readU32();
+	const std::size_t pathCount      = reader.readU32();
+	const std::size_t texelOffset    = reader.readU64();
+	const std::size_t blockOffset    = reader.readU64();
+
+	const std::size_t expectedLayers =
+	    m_layout == Layout::TEXTURE_ARRAY ? spriteCount : 1;
+
+	// Sprites take 16 bytes each, which bounds the count before anything
+	// is allocated for them.
+	if (!reader.good() || width == 0 || height == 0 || width > MAX_SIZE ||
+	    height > MAX_SIZE ||
+	    levelCount != gfx::getMipLevelCount(width, height) ||
+	    separateLevels == 0 || separateLevels > levelCount ||
+	    layerCount != expectedLayers || layerCount == 0 ||
+	    layerCount > MAX_LAYERS || spriteCount > reader.getRemaining() / 16)
+	{
+		return false;
+	}
+
+	std::vector<std::size_t> mipOffsets(levelCount + 1);
+	for (std::size_t& offset : mipOffsets)
+		offset = reader.readU64();
+
+	// The key covers the format, so the cache has compressed levels if and
+	// only if they are wanted.
+	std::vector<std::size_t> compressedOffsets;
+	if (m_compressedFormat != gfx::TextureFormat::RGBA8)
+	{
+		compressedOffsets.resize(levelCount + 1);
+		for (std::size_t& offset : compressedOffsets)
+			offset = reader.readU64();
+	}
+
+	std::vector<Sprite> sprites(spriteCount);
+	for (Sprite& sprite : sprites)
+	{
+		sprite.x      = reader.readU32();
+		sprite.y      = reader.readU32();
+		sprite.width  = reader.readU32();
+		sprite.height = reader.readU32();
+
+		if (sprite.width > width || sprite.x > width - sprite.width ||
+		    sprite.height > height || sprite.y > height - sprite.height)
+		{
+			return false;
+		}
+	}
+
+	const auto texelLevelSize = [](std::size_t levelWidth,
+	                               std::size_t levelHeight) {
+		return levelWidth * levelHeight * 4;
+	};
+
+	const auto blockLevelSize = [this](std::size_t levelWidth,
+	                                   std::size_t levelHeight) {
+		return gfx::getImageSize(m_compressedFormat, levelWidth, levelHeight);
+	};
+
+	if (!reader.good() ||
+	    !checkLevelOffsets(mipOffsets, width, height, texelLevelSize) ||
+	    (!compressedOffsets.empty() &&
+	     !checkLevelOffsets(compressedOffsets, width, height, blockLevelSize)))
+	{
+		return false;
+	}
+
+	std::unordered_map<std::string, SpriteID> textureIDMap;
+	for (std::size_t i = 0; i < pathCount && reader.good(); ++i)
+	{
+		const SpriteID    sprite = static_cast<SpriteID>(reader.readU32());
+		const std::string path   = reader.readString(reader.readU32());
+
+		if (sprite != INVALID_SPRITE &&
+		    (sprite < 0 || static_cast<std::size_t>(sprite) >= spriteCount))
+		{
+			return false;
+		}
+
+		textureIDMap[path] = sprite;
+	}
+
+	const std::size_t size = cache.getSize();
+
+	// The key covers every path, but a damaged file could still disagree.
+	if (!reader.good() || textureIDMap.size() != m_textureIDMap.size() ||
+	    texelOffset > size ||
+	    mipOffsets.back() > (size - texelOffset) / layerCount ||
+	    blockOffset > size ||
+	    (!compressedOffsets.empty() &&
+	     compressedOffsets.back() > (size - blockOffset) / layerCount))
+	{
+		return false;
+	}
+
+	for (const auto& texture : m_textureIDMap)
+	{
+		if (textureIDMap.find(texture.first) == textureIDMap.end())
+			return false;
+	}
+
+	m_textureIDMap          = std::move(textureIDMap);
+	m_sprites               = std::move(sprites);
+	m_mipOffsets            = std::move(mipOffsets);
+	m_layerCount            = layerCount;
+	m_patchedTextureWidth   = width;
+	m_patchedTextureHeight  = height;
+	m_separateMipLevelCount = separateLevels;
+
+	m_cache       = std::move(cache);
+	m_textureData = m_cache.getData() + texelOffset;
+
+	if (!compressedOffsets.empty())
+	{
+		m_compressedOffsets = std::move(compressedOffsets);
+		m_compressedData    = m_cache.getData() + blockOffset;
+	}
+
+	return true;
+}
+
+void BlockTextureAtlas::saveCache(std::uint64_t key) const
+{
+	std::string header;
+	appendU32(header, CACHE_MAGIC);
+	appendU32(header, CACHE_VERSION);
+	appendU64(header, key);
+
+	appendU32(header, static_cast<std::uint32_t>(m_patchedTextureWidth));
+	appendU32(header, static_cast<std::uint32_t>(m_patchedTextureHeight));
+	appendU32(header, static_cast<std::uint32_t>(m_separateMipLevelCount));
+	appendU32(header, static_cast<std::uint32_t>(getMipLevelCount()));
+	appendU32(header, static_cast<std::uint32_t>(m_layerCount));
+	appendU32(header, static_cast<std::uint32_t>(m_sprites.size()));
+	appendU32(header, static_cast<std::uint32_t>(m_textureIDMap.size()));
+
+	// Filled in once the size of everything before the texels is known.
+	const std::size_t offsetsPosition = header.size();
+	appendU64(header, 0);
+	appendU64(header, 0);
+
+	for (std::size_t offset : m_mipOffsets)
+		appendU64(header, offset);
+
+	for (std::size_t offset : m_compressedOffsets)
+		appendU64(header, offset);
+
+	for (const Sprite& sprite : m_sprites)
+	{
+		appendU32(header, static_cast<std::uint32_t>(sprite.x));
+		appendU32(header, static_cast<std::uint32_t>(sprite.y));
+		appendU32(header, static_cast<std::uint32_t>(sprite.width));
+		appendU32(header, static_cast<std::uint32_t>(sprite.height));
+	}
+
+	for (const auto& texture : m_textureIDMap)
+	{
+		appendU32(header, static_cast<std::uint32_t>(texture.second));
+		appendU32(header, static_cast<std::uint32_t>(texture.first.size()));
+		header += texture.first;
+	}
+
+	header.resize(roundUp(header.size(), CACHE_ALIGNMENT), '\0');
+
+	// Compressed blocks follow the texels, aligned the same way.
+	const std::size_t texelSize =
+	    roundUp(getPatchedTextureSize(), CACHE_ALIGNMENT);
+
+	std::string offsets;
+	appendU64(offsets, header.size());
+	appendU64(offsets, header.size() + texelSize);
+	header.replace(offsetsPosition, offsets.size(), offsets);
+
+	// Written under another name first, so a crash never leaves a cache
+	// that looks valid but is cut short.
+	const std::string temporary = m_cacheFilepath + ".tmp";
+	{
+		std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+		file.write(header.data(), static_cast<std::streamsize>(header.size()));
+		file.write(reinterpret_cast<const char*>(m_textureData),
+		           static_cast<std::streamsize>(getPatchedTextureSize()));
+
+		const std::string gap(texelSize - getPatchedTextureSize(), '\0');
+		file.write(gap.data(), static_cast<std::streamsize>(gap.size()));
+
+		if (m_compressedData != nullptr)
+		{
+			const std::size_t size = getCompressedTextureSize();
+			file.write(reinterpret_cast<const char*>(m_compressedData),
+			           static_cast<std::streamsize>(size));
+		}
+
+		if (!file)
+		{
+			LFATAL("Could not write the block texture atlas cache: ",
+			       temporary);
+			return;
+		}
+	}
+
+	std::remove(m_cacheFilepath.c_str());
+	if (std::rename(temporary.c_str(), m_cacheFilepath.c_str()) != 0)
+	{
+		LFATAL("Could not write the block texture atlas cache: ",
+		       m_cacheFilepath);
+	}
+}
+
+BlockTextureAtlas::~BlockTextureAtlas() { delete[] m_patchedTextureData; }
@@ -32,134 +32,314 @@
 #include <algorithm>
 #include <cassert>
 #include <cstring>
-
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb_image.hpp>
+#include <iterator>
 
 using namespace qz::voxels;
 
-const BlockTextureAtlas::SpriteID BlockTextureAtlas::INVALID_SPRITE;
+/**
+ * @brief Hashes a string ID with 64 bit FNV-1a.
+ */
+static std::uint64_t hashBlockID(const char* id)
+{
+	std::uint64_t hash = 14695981039346656037ull;
+	for (; *id != '\0'; ++id)
+	{
+		hash ^= static_cast<unsigned char>(*id);
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
 
-BlockTextureAtlas::BlockTextureAtlas(std::size_t spriteWidth,
-                                     std::size_t spriteHeight)
-    : m_spriteWidth(spriteWidth), m_spriteHeight(spriteHeight)
+/**
+ * @brief Picks the slot a hash lands in for a bucket's displacement.
+ */
+static std::size_t getHashSlot(std::uint64_t hash, std::uint32_t displacement,
+                               std::size_t slotMask)
 {
+	// The MurmurHash3 finaliser, so every displacement scatters the keys of
+	// a bucket independently of the bits used to pick the bucket.
+	std::uint64_t mixed = hash ^ (displacement * 0x9E3779B97F4A7C15ull);
+	mixed ^= mixed >> 33;
+	mixed *= 0xFF51AFD7ED558CCDull;
+	mixed ^= mixed >> 33;
+	mixed *= 0xC4CEB9FE1A85EC53ull;
+	mixed ^= mixed >> 33;
+
+	return static_cast<std::size_t>(mixed) & slotMask;
 }
 
-BlockTextureAtlas::BlockTextureAtlas() : m_spriteWidth(0), m_spriteHeight(0) {}
+static std::size_t nextPowerOfTwo(std::size_t value)
+{
+	std::size_t power = 1;
+	while (power < value)
+		power <<= 1;
 
-void BlockTextureAtlas::setSpriteWidth(std::size_t w) { m_spriteWidth = w; }
+	return power;
+}
 
-void BlockTextureAtlas::setSpriteHeight(std::size_t h) { m_spriteHeight = h; }
+BlockRegistry::BlockRegistry() : m_frozen(false) {}
 
-void BlockTextureAtlas::addTextureFile(const char* texturefilepath)
+BlockType* BlockRegistry::registerBlock(BlockType blockInfo)
 {
-	m_textureIDMap.insert(std::make_pair(std::string(texturefilepath),
-	                                     BlockTextureAtlas::INVALID_SPRITE));
-}
+	assert(!isFrozen());
+	if (isFrozen())
+		return nullptr;
 
-BlockTextureAtlas::SpriteID BlockTextureAtlas::getSpriteIDFromFilepath(
-    const char* filepath)
-{
-	const auto equalsTest =
-	    [filepath](
-	        const std::unordered_map<std::string, SpriteID>::value_type a)
-	    -> bool { return a.first == filepath; };
+	auto existing = m_registrationLookup.find(blockInfo.id);
+	if (existing != m_registrationLookup.end())
+		return m_blocksByNumericID[existing->second];
 
-	if (std::find_if(m_textureIDMap.begin(), m_textureIDMap.end(),
-	                 equalsTest) == m_textureIDMap.end())
-		return BlockTextureAtlas::INVALID_SPRITE;
+	assert(m_blocksByNumericID.size() < INVALID_BLOCK);
 
-	return m_textureIDMap.at(filepath);
-}
+	// State IDs enumerate every combination of property values, the first
+	// property changing fastest.
+	std::size_t stateCount = 1;
+	for (const BlockStateProperty& property : blockInfo.stateProperties)
+	{
+		assert(property.valueCount > 0);
+		stateCount *= property.valueCount;
+	}
 
-qz::RectAABB BlockTextureAtlas::getSpriteFromID(
-    BlockTextureAtlas::SpriteID spriteID) const
-{
-	qz::RectAABB uv;
+	if (m_stateBlocks.size() + stateCount > INVALID_STATE)
+	{
+		LFATAL("Ran out of block state IDs registering ", blockInfo.id);
+		return nullptr;
+	}
+
+	blockInfo.numericId = static_cast<BlockID>(m_blocksByNumericID.size());
+	blockInfo.defaultState = static_cast<BlockStateID>(m_stateBlocks.size());
+	blockInfo.stateCount   = static_cast<std::uint16_t>(stateCount);
 
-	const float yPx =
-	    static_cast<float>(spriteID) * static_cast<float>(m_spriteHeight);
-	const float xPx = 0.f;
+	const std::size_t propertyCount = blockInfo.stateProperties.size();
 
-	const float yUv = static_cast<float>(yPx) / m_patchedTextureHeight;
-	const float xUv = static_cast<float>(xPx) / m_patchedTextureWidth;
+	m_propertyOffsets.push_back(
+	    static_cast<std::uint32_t>(m_propertyStrides.size()));
+
+	std::uint16_t stride = 1;
+	for (const BlockStateProperty& property : blockInfo.stateProperties)
+	{
+		m_propertyStrides.push_back(stride);
+		stride = static_cast<std::uint16_t>(stride * property.valueCount);
+	}
 
-	const float widthUv =
-	    static_cast<float>(m_spriteWidth) / m_patchedTextureWidth;
-	const float heightUv =
-	    static_cast<float>(m_spriteHeight) / m_patchedTextureHeight;
+	for (std::size_t state = 0; state < stateCount; ++state)
+	{
+		m_stateBlocks.push_back(blockInfo.numericId);
+		m_stateValueOffsets.push_back(
+		    static_cast<std::uint32_t>(m_stateValues.size()));
+
+		std::size_t remainder = state;
+		for (std::size_t i = 0; i < propertyCount; ++i)
+		{
+			const std::uint8_t count = blockInfo.stateProperties[i].valueCount;
+
+			m_stateValues.push_back(
+			    static_cast<std::uint8_t>(remainder % count));
+			remainder /= count;
+		}
+	}
 
-	uv.topLeft     = {xUv, yUv};
-	uv.topRight    = {xUv + widthUv, yUv};
-	uv.bottomLeft  = {xUv, yUv + heightUv};
-	uv.bottomRight = {xUv + widthUv, yUv + heightUv};
+	m_blocks.push_back(blockInfo);
+	m_blocksByNumericID.push_back(&m_blocks.back());
+	m_registrationLookup.emplace(blockInfo.id, blockInfo.numericId);
 
-	return uv;
+	return &m_blocks.back();
 }
 
-void BlockTextureAtlas::patch()
+int BlockRegistry::findStateProperty(BlockID block, const char* name) const
 {
-	assert(m_spriteWidth != 0);
-	assert(m_spriteHeight != 0);
+	const BlockType* type = getBlockFromNumericID(block);
+	if (type == nullptr)
+		return -1;
 
-	const std::size_t numTextures = m_textureIDMap.size();
+	for (std::size_t i = 0; i < type->stateProperties.size(); ++i)
+	{
+		if (std::strcmp(type->stateProperties[i].name, name) == 0)
+			return static_cast<int>(i);
+	}
 
-	if (numTextures == 0)
-		return;
+	return -1;
+}
 
-	const std::size_t textureHeight = numTextures * m_spriteHeight;
-	const std::size_t textureWidth  = m_spriteWidth;
+BlockType* BlockRegistry::getBlockFromID(const char* id)
+{
+	return getBlockFromNumericID(getNumericID(id));
+}
 
-	m_patchedTextureData = new unsigned char[textureWidth * 4 * textureHeight];
-	assert(m_patchedTextureData);
+BlockID BlockRegistry::getNumericID(const char* id) const
+{
+	if (isFrozen())
+		return findFrozenID(id);
 
-	std::size_t spriteIndex = 0;
+	auto it = m_registrationLookup.find(id);
+	return it == m_registrationLookup.end() ? INVALID_BLOCK : it->second;
+}
 
-	for (const auto& sprite : m_textureIDMap)
-	{
-		const std::string& textureFilepath = sprite.first;
-		m_textureIDMap[textureFilepath]    = SpriteID(spriteIndex);
+void BlockRegistry::freeze()
+{
+	if (isFrozen())
+		return;
+
+	// Builds the table with "hash and displace": keys are spread over small
+	// buckets, then starting with the largest bucket, every bucket searches
+	// for a displacement that sends all of its keys to free slots.
+	const std::size_t blockCount = m_blocksByNumericID.size();
+
+	std::vector<std::uint64_t> hashes(blockCount);
+	for (std::size_t i = 0; i < blockCount; ++i)
+		hashes[i] = hashBlockID(m_blocksByNumericID[i]->id);
 
-		int            width = -1, height = -1, nbChannels = -1;
-		unsigned char* image =
-		    stbi_load(textureFilepath.c_str(), &width, &height, &nbChannels, 0);
+	const std::size_t bucketCount =
+	    nextPowerOfTwo(std::max<std::size_t>(1, blockCount / 4));
 
-		// Basic sanity checks on the loaded image
-		assert(image);
-		assert(width != 0 && height != 0);
+	std::vector<std::vector<BlockID>> buckets(bucketCount);
+	for (std::size_t i = 0; i < blockCount; ++i)
+		buckets[hashes[i] & (bucketCount - 1)].push_back(BlockID(i));
 
-		// #todo (bwilks): should have a way of supporting images that don't
-		// have 4 channels (maybe support 3 and just pad the alpha with 1?)
-		assert(nbChannels == 4);
+	std::vector<std::size_t> order(bucketCount);
+	for (std::size_t i = 0; i < bucketCount; ++i)
+		order[i] = i;
 
-		std::memcpy(m_patchedTextureData +
-		                ((width * height * nbChannels) * spriteIndex),
-		            image, width * height * nbChannels);
+	std::stable_sort(order.begin(), order.end(),
+	                 [&buckets](std::size_t a, std::size_t b) {
+		                 return buckets[a].size() > buckets[b].size();
+	                 });
 
-		stbi_image_free(image);
+	const std::uint32_t maxDisplacement = 1u << 16;
 
-		spriteIndex++;
+	std::size_t slotCount = nextPowerOfTwo(blockCount + blockCount / 4 + 1);
+	std::vector<std::size_t> bucketSlots;
+
+	bool built = false;
+	while (!built)
+	{
+		m_hashDisplacements.assign(bucketCount, 0);
+		m_hashSlots.assign(slotCount, INVALID_BLOCK);
+
+		const std::size_t slotMask = slotCount - 1;
+
+		built = true;
+		for (std::size_t bucketIndex : order)
+		{
+			const std::vector<BlockID>& bucket = buckets[bucketIndex];
+			if (bucket.empty())
+				break;
+
+			std::uint32_t displacement = 0;
+			for (; displacement < maxDisplacement; ++displacement)
+			{
+				bucketSlots.clear();
+
+				for (BlockID block : bucket)
+				{
+					const std::size_t slot =
+					    getHashSlot(hashes[block], displacement, slotMask);
+
+					if (m_hashSlots[slot] != INVALID_BLOCK ||
+					    std::find(bucketSlots.begin(), bucketSlots.end(),
+					              slot) != bucketSlots.end())
+					{
+						break;
+					}
+
+					bucketSlots.push_back(slot);
+				}
+
+				if (bucketSlots.size() == bucket.size())
+					break;
+			}
+
+			if (displacement == maxDisplacement)
+			{
+				// Too crowded, try again with more room.
+				built = false;
+				slotCount *= 2;
+				break;
+			}
+
+			m_hashDisplacements[bucketIndex] = displacement;
+			for (std::size_t i = 0; i < bucket.size(); ++i)
+				m_hashSlots[bucketSlots[i]] = bucket[i];
+		}
 	}
 
-	m_patchedTextureWidth  = textureWidth;
-	m_patchedTextureHeight = textureHeight;
+	m_registrationLookup.clear();
+	m_properties.compile(m_blocksByNumericID);
+	m_frozen.store(true, std::memory_order_release);
 }
 
-BlockTextureAtlas::~BlockTextureAtlas() { delete[] m_patchedTextureData; }
+void BlockRegistry::bakeTextureCoordinates(const BlockTextureAtlas& atlas)
+{
+	assert(isFrozen());
+	m_properties.bakeTextureCoordinates(atlas);
+}
 
-BlockType* BlockRegistry::registerBlock(BlockType blockInfo)
+BlockID BlockRegistry::findFrozenID(const char* id) const
 {
-	m_blocks.push_back(blockInfo);
-	return &m_blocks.back();
+	const std::uint64_t hash = hashBlockID(id);
+
+	const std::uint32_t displacement =
+	    m_hashDisplacements[hash & (m_hashDisplacements.size() - 1)];
+	const BlockID candidate =
+	    m_hashSlots[getHashSlot(hash, displacement, m_hashSlots.size() - 1)];
+
+	// Strings that were never registered still land in some slot.
+	if (candidate == INVALID_BLOCK ||
+	    std::strcmp(m_blocksByNumericID[candidate]->id, id) != 0)
+	{
+		return INVALID_BLOCK;
+	}
+
+	return candidate;
 }
 
-BlockType* BlockRegistry::getBlockFromID(const char* id)
+void BlockPropertyTable::compile(const std::vector<BlockType*>& blocks)
 {
-	auto it = std::find_if(m_blocks.begin(), m_blocks.end(),
-	                       [id](const BlockType& block) {
-		                       return std::strcmp(block.id, id) == 0;
-	                       });
+	m_blockCount = blocks.size();
+
+	const std::size_t bitBlockCount = (m_blockCount + 511) / 512;
+	m_opaque.assign(bitBlockCount, BitBlock {});
+	m_solid.assign(bitBlockCount, BitBlock {});
+	m_liquid.assign(bitBlockCount, BitBlock {});
+
+	m_sprites.resize(m_blockCount * FACE_COUNT);
+	m_textureCoordinates.assign(m_blockCount * FACE_COUNT, RectAABB());
 
-	return it == m_blocks.end() ? nullptr : &(*it);
+	for (std::size_t i = 0; i < m_blockCount; ++i)
+	{
+		const BlockType& block = *blocks[i];
+		const BlockID    id    = static_cast<BlockID>(i);
+
+		if (block.category == BlockTypeCategory::SOLID)
+		{
+			setBit(m_solid, id);
+
+			if (!block.transparent)
+				setBit(m_opaque, id);
+		}
+		else if (block.category == BlockTypeCategory::LIQUID)
+		{
+			setBit(m_liquid, id);
+		}
+
+		// In the same order as BlockFace.
+		const BlockTextureAtlas::SpriteID sprites[FACE_COUNT] = {
+		    block.textures.top,   block.textures.bottom,
+		    block.textures.left,  block.textures.right,
+		    block.textures.front, block.textures.back};
+
+		std::copy(std::begin(sprites), std::end(sprites),
+		          m_sprites.begin() + i * FACE_COUNT);
+	}
+}
+
+void BlockPropertyTable::bakeTextureCoordinates(
+    const BlockTextureAtlas& atlas)
+{
+	for (std::size_t i = 0; i < m_sprites.size(); ++i)
+	{
+		if (m_sprites[i] != BlockTextureAtlas::INVALID_SPRITE)
+			m_textureCoordinates[i] = atlas.getSpriteFromID(m_sprites[i]);
+	}
 }
@@ -0,0 +1,200 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <Quartz/Voxels/ChunkSerializer.hpp>
+
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+using namespace qz::voxels;
+
+constexpr std::uint32_t ChunkSerializer::MAGIC;
+constexpr std::uint16_t ChunkSerializer::VERSION;
+
+static void writeU16(std::ostream& stream, std::uint16_t value)
+{
+	const char bytes[2] = {static_cast<char>(value & 0xFF),
+	                       static_cast<char>((value >> 8) & 0xFF)};
+	stream.write(bytes, sizeof(bytes));
+}
+
+static void writeU32(std::ostream& stream, std::uint32_t value)
+{
+	writeU16(stream, static_cast<std::uint16_t>(value & 0xFFFF));
+	writeU16(stream, static_cast<std::uint16_t>(value >> 16));
+}
+
+static std::uint16_t readU16(std::istream& stream)
+{
+	unsigned char bytes[2] = {0, 0};
+	stream.read(reinterpret_cast<char*>(bytes), sizeof(bytes));
+	return static_cast<std::uint16_t>(bytes[0] | (bytes[1] << 8));
+}
+
+static std::uint32_t readU32(std::istream& stream)
+{
+	const std::uint32_t low = readU16(stream);
+	return low | (static_cast<std::uint32_t>(readU16(stream)) << 16);
+}
+
+bool ChunkSerializer::write(std::ostream& stream, const Chunk& chunk)
+{
+	const std::size_t voxelCount = chunk.m_voxelData.size();
+	if (voxelCount == 0)
+		return false;
+
+	std::unordered_map<BlockStateID, std::uint16_t> paletteLookup;
+	std::vector<BlockStateID>                       palette;
+
+	for (BlockStateID block : chunk.m_voxelData)
+	{
+		if (paletteLookup.find(block) != paletteLookup.end())
+			continue;
+
+		if (palette.size() == std::numeric_limits<std::uint16_t>::max())
+			return false;
+
+		paletteLookup[block] = static_cast<std::uint16_t>(palette.size());
+		palette.push_back(block);
+	}
+
+	writeU32(stream, MAGIC);
+	writeU16(stream, VERSION);
+	writeU16(stream, static_cast<std::uint16_t>(chunk.m_chunkSize));
+	writeU32(stream, static_cast<std::uint32_t>(chunk.m_position.x));
+	writeU32(stream, static_cast<std::uint32_t>(chunk.m_position.y));
+	writeU32(stream, static_cast<std::uint32_t>(chunk.m_position.z));
+
+	writeU16(stream, static_cast<std::uint16_t>(palette.size()));
+	for (BlockStateID state : palette)
+	{
+		// State IDs can change between runs, so the string IDs are saved.
+		// Empty voxels are saved with an empty ID.
+		const BlockType* block = BlockRegistry::get()->getBlockFromState(state);
+		const std::string id   = block == nullptr ? "" : block->id;
+
+		writeU16(stream, static_cast<std::uint16_t>(id.size()));
+		stream.write(id.data(), static_cast<std::streamsize>(id.size()));
+		writeU16(stream, block == nullptr ? 0
+		                                  : static_cast<std::uint16_t>(
+		                                        state - block->defaultState));
+	}
+
+	std::size_t i = 0;
+	while (i < voxelCount)
+	{
+		const BlockStateID block = chunk.m_voxelData[i];
+
+		std::size_t run = 1;
+		while (i + run < voxelCount && run < 0xFFFF &&
+		       chunk.m_voxelData[i + run] == block)
+		{
+			++run;
+		}
+
+		writeU16(stream, static_cast<std::uint16_t>(run));
+		writeU16(stream, paletteLookup[block]);
+
+		i += run;
+	}
+
+	return stream.good();
+}
+
+bool ChunkSerializer::read(std::istream& stream, Chunk& chunk)
+{
+	if (readU32(stream) != MAGIC)
+		return false;
+
+	const std::uint16_t version = readU16(stream);
+	if (version == 0 || version > VERSION)
+		return false;
+
+	const std::size_t chunkSize = readU16(stream);
+
+	Vector3i position;
+	position.x = static_cast<int>(readU32(stream));
+	position.y = static_cast<int>(readU32(stream));
+	position.z = static_cast<int>(readU32(stream));
+
+	std::vector<BlockStateID> palette(readU16(stream));
+	for (BlockStateID& state : palette)
+	{
+		std::string id(readU16(stream), '\0');
+		stream.read(&id[0], static_cast<std::streamsize>(id.size()));
+
+		const std::uint16_t offset = version >= 2 ? readU16(stream) : 0;
+		if (!stream)
+			return false;
+
+		state = INVALID_STATE;
+		if (id.empty())
+			continue;
+
+		const BlockType* block =
+		    BlockRegistry::get()->getBlockFromID(id.c_str());
+		if (block == nullptr || offset >= block->stateCount)
+			return false;
+
+		state = static_cast<BlockStateID>(block->defaultState + offset);
+	}
+
+	const std::size_t voxelCount = chunkSize * chunkSize * chunkSize;
+
+	std::vector<BlockStateID> voxels;
+	voxels.reserve(voxelCount);
+
+	while (voxels.size() < voxelCount)
+	{
+		const std::size_t   run   = readU16(stream);
+		const std::uint16_t index = readU16(stream);
+
+		if (!stream || run == 0 || index >= palette.size() ||
+		    voxels.size() + run > voxelCount)
+		{
+			return false;
+		}
+
+		voxels.insert(voxels.end(), run, palette[index]);
+	}
+
+	chunk.m_position  = position;
+	chunk.m_chunkSize = chunkSize;
+	chunk.m_stage     = GenerationStage::COMPLETE;
+	chunk.m_voxelData = std::move(voxels);
+
+	return true;
+}
+
+std::string ChunkSerializer::getFilename(const qz::Vector3i& position)
+{
+	return "chunk." + std::to_string(position.x) + "." +
+	       std::to_string(position.y) + "." + std::to_string(position.z) +
+	       ".qzc";
+}
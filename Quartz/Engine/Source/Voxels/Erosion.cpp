@@ -0,0 +1,609 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <Quartz/Math/MathUtils.hpp>
+#include <Quartz/Utilities/Threading/ParallelFor.hpp>
+#include <Quartz/Utilities/Threading/ThreadPool.hpp>
+#include <Quartz/Voxels/Erosion.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+using namespace qz::voxels;
+using qz::utils::threading::ThreadPool;
+using qz::utils::threading::parallelFor;
+
+constexpr std::size_t ErodedRegionCache::REGION_SIZE;
+constexpr std::size_t ErodedRegionCache::REGION_BORDER;
+
+/// @brief Bumped whenever the simulation changes, invalidating caches.
+static const std::uint32_t EROSION_ALGORITHM_VERSION = 1;
+
+/// @brief "QZHM" in little endian.
+static const std::uint32_t REGION_MAGIC = 0x4D485A51;
+
+static std::uint32_t mixBits(std::uint32_t h)
+{
+	h ^= h >> 16;
+	h *= 0x7FEB352Du;
+	h ^= h >> 15;
+	h *= 0x846CA68Bu;
+	h ^= h >> 16;
+	return h;
+}
+
+/**
+ * @brief A tiny xorshift generator, used instead of <random> as the standard
+ * distributions aren't guaranteed to match between standard libraries.
+ */
+class DropletRandom
+{
+public:
+	explicit DropletRandom(std::uint32_t seed) : m_state(mixBits(seed) | 1u) {}
+
+	float next()
+	{
+		m_state ^= m_state << 13;
+		m_state ^= m_state >> 17;
+		m_state ^= m_state << 5;
+		return static_cast<float>(m_state >> 8) / 16777216.f;
+	}
+
+private:
+	std::uint32_t m_state;
+};
+
+/**
+ * @brief Bilinearly samples the height and gradient of a heightmap.
+ */
+static float sampleHeight(const Heightmap& map, float x, float y,
+                          float& gradientX, float& gradientY)
+{
+	const std::size_t cellX = static_cast<std::size_t>(x);
+	const std::size_t cellY = static_cast<std::size_t>(y);
+
+	const float u = x - static_cast<float>(cellX);
+	const float v = y - static_cast<float>(cellY);
+
+	const float h00 = map.at(cellX, cellY);
+	const float h10 = map.at(cellX + 1, cellY);
+	const float h01 = map.at(cellX, cellY + 1);
+	const float h11 = map.at(cellX + 1, cellY + 1);
+
+	gradientX = (h10 - h00) * (1.f - v) + (h11 - h01) * v;
+	gradientY = (h01 - h00) * (1.f - u) + (h11 - h10) * u;
+
+	return h00 * (1.f - u) * (1.f - v) + h10 * u * (1.f - v) +
+	       h01 * (1.f - u) * v + h11 * u * v;
+}
+
+ErosionSimulator::ErosionSimulator(const ErosionSettings& settings)
+    : m_settings(settings)
+{
+	const int radius = std::max(1, m_settings.erosionRadius);
+
+	float totalWeight = 0.f;
+	for (int y = -radius; y <= radius; ++y)
+	{
+		for (int x = -radius; x <= radius; ++x)
+		{
+			const float distance =
+			    std::sqrt(static_cast<float>(x * x + y * y));
+
+			if (distance < static_cast<float>(radius))
+			{
+				const float weight = 1.f - distance / radius;
+				m_brush.push_back({x, y, weight});
+				totalWeight += weight;
+			}
+		}
+	}
+
+	for (BrushCell& cell : m_brush)
+		cell.weight /= totalWeight;
+}
+
+void ErosionSimulator::erode(Heightmap& map, std::uint32_t seed,
+                             ThreadPool* pool) const
+{
+	erodeHydraulic(map, seed, pool);
+	erodeThermal(map, pool);
+}
+
+void ErosionSimulator::erodeHydraulic(Heightmap& map, std::uint32_t seed,
+                                      ThreadPool* pool) const
+{
+	if (map.getWidth() < 2 || map.getHeight() < 2)
+		return;
+
+	const std::size_t tileSize = std::max<std::size_t>(m_settings.tileSize, 8);
+	const std::size_t tilesX   = (map.getWidth() + tileSize - 1) / tileSize;
+	const std::size_t tilesY   = (map.getHeight() + tileSize - 1) / tileSize;
+
+	// Tiles sharing a phase are a whole tile apart, so their halos of half a
+	// tile can never touch.
+	for (std::size_t phase = 0; phase < 4; ++phase)
+	{
+		std::vector<std::pair<std::size_t, std::size_t>> tiles;
+
+		for (std::size_t y = phase / 2; y < tilesY; y += 2)
+		{
+			for (std::size_t x = phase % 2; x < tilesX; x += 2)
+				tiles.emplace_back(x, y);
+		}
+
+		parallelFor(pool, 0, tiles.size(), 1, [&](std::size_t i) {
+			erodeTile(map, tiles[i].first, tiles[i].second, seed);
+		});
+	}
+}
+
+void ErosionSimulator::erodeTile(Heightmap& map, std::size_t tileX,
+                                 std::size_t tileY, std::uint32_t seed) const
+{
+	const int width    = static_cast<int>(map.getWidth());
+	const int height   = static_cast<int>(map.getHeight());
+	const int tileSize = static_cast<int>(std::max<std::size_t>(
+	    m_settings.tileSize, 8));
+
+	const int coreX0 = static_cast<int>(tileX) * tileSize;
+	const int coreY0 = static_cast<int>(tileY) * tileSize;
+	const int coreX1 = std::min(coreX0 + tileSize, width);
+	const int coreY1 = std::min(coreY0 + tileSize, height);
+
+	// Droplets have to stay far enough inside the halo for their brush and
+	// the bilinear samples to stay inside it too.
+	const int margin =
+	    std::max(0, tileSize / 2 - std::max(1, m_settings.erosionRadius) - 2);
+
+	const float minX = static_cast<float>(std::max(0, coreX0 - margin));
+	const float minY = static_cast<float>(std::max(0, coreY0 - margin));
+	const float maxX = static_cast<float>(std::min(width - 1, coreX1 + margin));
+	const float maxY =
+	    static_cast<float>(std::min(height - 1, coreY1 + margin));
+
+	const std::size_t droplets = static_cast<std::size_t>(
+	    m_settings.dropletsPerCell *
+	    static_cast<float>((coreX1 - coreX0) * (coreY1 - coreY0)));
+
+	DropletRandom random(seed ^ mixBits(static_cast<std::uint32_t>(
+	                                tileX * 73856093u ^ tileY * 19349663u)));
+
+	for (std::size_t droplet = 0; droplet < droplets; ++droplet)
+	{
+		float posX = static_cast<float>(coreX0) +
+		             random.next() * static_cast<float>(coreX1 - coreX0);
+		float posY = static_cast<float>(coreY0) +
+		             random.next() * static_cast<float>(coreY1 - coreY0);
+
+		if (posX >= maxX || posY >= maxY)
+			continue;
+
+		float dirX     = 0.f;
+		float dirY     = 0.f;
+		float speed    = 1.f;
+		float water    = 1.f;
+		float sediment = 0.f;
+
+		for (std::size_t step = 0; step < m_settings.dropletLifetime; ++step)
+		{
+			const int   cellX   = static_cast<int>(posX);
+			const int   cellY   = static_cast<int>(posY);
+			const float offsetX = posX - static_cast<float>(cellX);
+			const float offsetY = posY - static_cast<float>(cellY);
+
+			float       gradientX, gradientY;
+			const float currentHeight =
+			    sampleHeight(map, posX, posY, gradientX, gradientY);
+
+			dirX = dirX * m_settings.inertia -
+			       gradientX * (1.f - m_settings.inertia);
+			dirY = dirY * m_settings.inertia -
+			       gradientY * (1.f - m_settings.inertia);
+
+			const float length = std::sqrt(dirX * dirX + dirY * dirY);
+			if (length < 1e-6f)
+				break;
+
+			dirX /= length;
+			dirY /= length;
+			posX += dirX;
+			posY += dirY;
+
+			if (posX < minX || posY < minY || posX >= maxX || posY >= maxY)
+				break;
+
+			const float heightDelta =
+			    sampleHeight(map, posX, posY, gradientX, gradientY) -
+			    currentHeight;
+
+			const float capacity =
+			    std::max(-heightDelta * speed * water *
+			                 m_settings.sedimentCapacityFactor,
+			             m_settings.minSedimentCapacity);
+
+			if (sediment > capacity || heightDelta > 0.f)
+			{
+				// Going uphill fills the pit behind us, otherwise drop what
+				// we can't carry anymore.
+				const float amount =
+				    heightDelta > 0.f
+				        ? std::min(heightDelta, sediment)
+				        : (sediment - capacity) * m_settings.depositSpeed;
+
+				sediment -= amount;
+
+				map.at(cellX, cellY) += amount * (1 - offsetX) * (1 - offsetY);
+				map.at(cellX + 1, cellY) += amount * offsetX * (1 - offsetY);
+				map.at(cellX, cellY + 1) += amount * (1 - offsetX) * offsetY;
+				map.at(cellX + 1, cellY + 1) += amount * offsetX * offsetY;
+			}
+			else
+			{
+				const float amount =
+				    std::min((capacity - sediment) * m_settings.erodeSpeed,
+				             -heightDelta);
+
+				for (const BrushCell& cell : m_brush)
+				{
+					const int x = cellX + cell.x;
+					const int y = cellY + cell.y;
+
+					if (x < 0 || y < 0 || x >= width || y >= height)
+						continue;
+
+					const float eroded = amount * cell.weight;
+					map.at(x, y) -= eroded;
+					sediment += eroded;
+				}
+			}
+
+			speed = std::sqrt(std::max(
+			    0.f, speed * speed - heightDelta * m_settings.gravity));
+			water *= 1.f - m_settings.evaporateSpeed;
+		}
+	}
+}
+
+void ErosionSimulator::erodeThermal(Heightmap& map, ThreadPool* pool) const
+{
+	const std::size_t width  = map.getWidth();
+	const std::size_t height = map.getHeight();
+
+	if (width == 0 || height == 0)
+		return;
+
+	const std::size_t rowsPerJob = 32;
+	const std::size_t jobs       = (height + rowsPerJob - 1) / rowsPerJob;
+
+	const float talus = m_settings.talus;
+	const float rate  = std::min(m_settings.thermalRate, 0.25f) * 0.5f;
+
+	Heightmap next(width, height);
+
+	for (std::size_t i = 0; i < m_settings.thermalIterations; ++i)
+	{
+		const Heightmap& current = map;
+
+		parallelFor(pool, 0, jobs, 1, [&](std::size_t job) {
+			const std::size_t firstRow = job * rowsPerJob;
+			const std::size_t lastRow =
+			    std::min(firstRow + rowsPerJob, height);
+
+			for (std::size_t y = firstRow; y < lastRow; ++y)
+			{
+				for (std::size_t x = 0; x < width; ++x)
+				{
+					const float cell   = current.at(x, y);
+					float       result = cell;
+
+					const auto exchange = [&](float neighbour) {
+						const float difference = cell - neighbour;
+
+						// Both cells of a pair compute the same flow, so
+						// material is moved without ever being lost.
+						if (difference > talus)
+							result -= (difference - talus) * rate;
+						else if (-difference > talus)
+							result += (-difference - talus) * rate;
+					};
+
+					if (x > 0)
+						exchange(current.at(x - 1, y));
+					if (x + 1 < width)
+						exchange(current.at(x + 1, y));
+					if (y > 0)
+						exchange(current.at(x, y - 1));
+					if (y + 1 < height)
+						exchange(current.at(x, y + 1));
+
+					next.at(x, y) = result;
+				}
+			}
+		});
+
+		std::swap(map.getData(), next.getData());
+	}
+}
+
+std::uint64_t ErosionSimulator::getSettingsHash() const
+{
+	std::uint64_t hash = 14695981039346656037ull;
+
+	const auto add = [&hash](const void* data, std::size_t size) {
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (std::size_t i = 0; i < size; ++i)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+	};
+
+	const std::uint64_t lifetime   = m_settings.dropletLifetime;
+	const std::uint64_t iterations = m_settings.thermalIterations;
+	const std::uint64_t tileSize   = m_settings.tileSize;
+	const std::int32_t  radius     = m_settings.erosionRadius;
+
+	add(&EROSION_ALGORITHM_VERSION, sizeof(EROSION_ALGORITHM_VERSION));
+	add(&m_settings.dropletsPerCell, sizeof(float));
+	add(&lifetime, sizeof(lifetime));
+	add(&m_settings.inertia, sizeof(float));
+	add(&m_settings.sedimentCapacityFactor, sizeof(float));
+	add(&m_settings.minSedimentCapacity, sizeof(float));
+	add(&m_settings.erodeSpeed, sizeof(float));
+	add(&m_settings.depositSpeed, sizeof(float));
+	add(&m_settings.evaporateSpeed, sizeof(float));
+	add(&m_settings.gravity, sizeof(float));
+	add(&radius, sizeof(radius));
+	add(&iterations, sizeof(iterations));
+	add(&m_settings.talus, sizeof(float));
+	add(&m_settings.thermalRate, sizeof(float));
+	add(&tileSize, sizeof(tileSize));
+
+	return hash;
+}
+
+ErodedRegionCache::ErodedRegionCache(const HeightFunction&  heightFunction,
+                                     const ErosionSettings& settings,
+                                     std::uint32_t          seed,
+                                     const std::string&     cacheDirectory,
+                                     ThreadPool*            pool)
+    : m_heightFunction(heightFunction), m_simulator(settings), m_seed(seed),
+      m_cacheDirectory(cacheDirectory), m_pool(pool)
+{
+}
+
+float ErodedRegionCache::getHeight(int x, int z)
+{
+	const int size    = static_cast<int>(REGION_SIZE);
+	const int regionX = qz::math::floorDivide(x, size);
+	const int regionZ = qz::math::floorDivide(z, size);
+
+	const Region& region = acquireRegion(regionX, regionZ);
+
+	return region.heights.at(static_cast<std::size_t>(x - regionX * size),
+	                         static_cast<std::size_t>(z - regionZ * size));
+}
+
+void ErodedRegionCache::getHeights(int originX, int originZ,
+                                   std::size_t width, std::size_t depth,
+                                   float* heights)
+{
+	const int size = static_cast<int>(REGION_SIZE);
+	const int endX = originX + static_cast<int>(width);
+	const int endZ = originZ + static_cast<int>(depth);
+
+	for (int regionZ = qz::math::floorDivide(originZ, size);
+	     regionZ * size < endZ; ++regionZ)
+	{
+		for (int regionX = qz::math::floorDivide(originX, size);
+		     regionX * size < endX; ++regionX)
+		{
+			const Region& region = acquireRegion(regionX, regionZ);
+
+			const int firstX = std::max(originX, regionX * size);
+			const int firstZ = std::max(originZ, regionZ * size);
+			const int lastX  = std::min(endX, (regionX + 1) * size);
+			const int lastZ  = std::min(endZ, (regionZ + 1) * size);
+
+			for (int z = firstZ; z < lastZ; ++z)
+			{
+				float* row = heights + (z - originZ) * width;
+
+				for (int x = firstX; x < lastX; ++x)
+				{
+					row[x - originX] = region.heights.at(
+					    static_cast<std::size_t>(x - regionX * size),
+					    static_cast<std::size_t>(z - regionZ * size));
+				}
+			}
+		}
+	}
+}
+
+const ErodedRegionCache::Region& ErodedRegionCache::acquireRegion(
+    int regionX, int regionZ)
+{
+	const std::uint64_t key =
+	    (static_cast<std::uint64_t>(static_cast<std::uint32_t>(regionX))
+	     << 32) |
+	    static_cast<std::uint32_t>(regionZ);
+
+	Region* region;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		std::shared_ptr<Region>& entry = m_regions[key];
+		if (entry == nullptr)
+			entry = std::make_shared<Region>();
+
+		region = entry.get();
+	}
+
+	// Threads asking for a region that is still being eroded wait here,
+	// without holding up lookups into other regions.
+	std::call_once(region->loaded,
+	               [&]() { loadRegion(*region, regionX, regionZ); });
+
+	return *region;
+}
+
+void ErodedRegionCache::loadRegion(Region& region, int regionX, int regionZ)
+{
+	const std::string path = getRegionPath(regionX, regionZ);
+
+	if (!path.empty() && readRegion(path, region.heights))
+		return;
+
+	const int size   = static_cast<int>(REGION_SIZE);
+	const int border = static_cast<int>(REGION_BORDER);
+	const int padded = size + 2 * border;
+
+	const int originX = regionX * size - border;
+	const int originZ = regionZ * size - border;
+
+	Heightmap map(static_cast<std::size_t>(padded),
+	              static_cast<std::size_t>(padded));
+
+	for (int z = 0; z < padded; ++z)
+	{
+		for (int x = 0; x < padded; ++x)
+			map.at(x, z) = m_heightFunction(originX + x, originZ + z);
+	}
+
+	const std::uint32_t regionSeed =
+	    m_seed ^ mixBits(static_cast<std::uint32_t>(regionX) * 0x27D4EB2Du ^
+	                     static_cast<std::uint32_t>(regionZ) * 0x165667B1u);
+
+	m_simulator.erode(map, regionSeed, m_pool);
+
+	region.heights = Heightmap(REGION_SIZE, REGION_SIZE);
+	for (std::size_t z = 0; z < REGION_SIZE; ++z)
+	{
+		for (std::size_t x = 0; x < REGION_SIZE; ++x)
+			region.heights.at(x, z) = map.at(x + border, z + border);
+	}
+
+	if (!path.empty())
+		writeRegion(path, region.heights);
+}
+
+std::string ErodedRegionCache::getRegionPath(int regionX, int regionZ) const
+{
+	if (m_cacheDirectory.empty())
+		return "";
+
+	std::stringstream ss;
+	ss << m_cacheDirectory << "/erosion." << regionX << "." << regionZ << "."
+	   << std::hex << (m_simulator.getSettingsHash() ^ m_seed) << ".qzh";
+
+	return ss.str();
+}
+
+bool ErodedRegionCache::readRegion(const std::string& path, Heightmap& map)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	std::vector<unsigned char> bytes(
+	    (std::istreambuf_iterator<char>(file)),
+	    std::istreambuf_iterator<char>());
+
+	const std::size_t cells = REGION_SIZE * REGION_SIZE;
+	if (bytes.size() != 8 + cells * 4)
+		return false;
+
+	const auto readU32 = [&bytes](std::size_t offset) {
+		return static_cast<std::uint32_t>(bytes[offset]) |
+		       static_cast<std::uint32_t>(bytes[offset + 1]) << 8 |
+		       static_cast<std::uint32_t>(bytes[offset + 2]) << 16 |
+		       static_cast<std::uint32_t>(bytes[offset + 3]) << 24;
+	};
+
+	if (readU32(0) != REGION_MAGIC || readU32(4) != REGION_SIZE)
+		return false;
+
+	map = Heightmap(REGION_SIZE, REGION_SIZE);
+	for (std::size_t i = 0; i < cells; ++i)
+	{
+		const std::uint32_t bits = readU32(8 + i * 4);
+		std::memcpy(&map.getData()[i], &bits, sizeof(float));
+	}
+
+	return true;
+}
+
+void ErodedRegionCache::writeRegion(const std::string& path,
+                                    const Heightmap&   map)
+{
+	std::vector<unsigned char> bytes;
+	bytes.reserve(8 + map.getData().size() * 4);
+
+	const auto writeU32 = [&bytes](std::uint32_t value) {
+		bytes.push_back(static_cast<unsigned char>(value));
+		bytes.push_back(static_cast<unsigned char>(value >> 8));
+		bytes.push_back(static_cast<unsigned char>(value >> 16));
+		bytes.push_back(static_cast<unsigned char>(value >> 24));
+	};
+
+	writeU32(REGION_MAGIC);
+	writeU32(static_cast<std::uint32_t>(map.getWidth()));
+
+	for (float height : map.getData())
+	{
+		std::uint32_t bits;
+		std::memcpy(&bits, &height, sizeof(float));
+		writeU32(bits);
+	}
+
+	// Written to a temporary first, so a crash never leaves a truncated
+	// region behind.
+	const std::string temporary = path + ".tmp";
+
+	{
+		std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(bytes.data()),
+		           static_cast<std::streamsize>(bytes.size()));
+
+		if (!file)
+		{
+			file.close();
+			std::remove(temporary.c_str());
+			return;
+		}
+	}
+
+	if (std::rename(temporary.c_str(), path.c_str()) != 0)
+		std::remove(temporary.c_str());
+}
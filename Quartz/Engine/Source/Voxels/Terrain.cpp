@@ -28,25 +28,119 @@
 
 #include <Quartz/Voxels/Terrain.hpp>
 
+#include <Quartz/Utilities/Threading/ParallelFor.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
 using namespace qz::voxels;
+using qz::utils::threading::ThreadPool;
 
-void Chunk::fill(const std::size_t                             chunkSize,
-                 const std::function<BlockType*(std::size_t, std::size_t,
-                                                std::size_t)>& generator)
+void PendingBlockQueue::apply(Chunk& chunk, GenerationStage stage)
 {
-	m_voxelData.resize(chunkSize * chunkSize * chunkSize);
+	const auto end = std::remove_if(
+	    m_blocks.begin(), m_blocks.end(),
+	    [&chunk, stage](const PendingBlock& pending) {
+		    if (pending.stage > stage)
+			    return false;
+
+		    chunk.setStateAt(pending.index, pending.state);
+		    return true;
+	    });
+
+	m_blocks.erase(end, m_blocks.end());
+}
 
-	for (std::size_t x = 0; x < chunkSize; ++x)
+void PendingBlockQueue::merge(PendingBlockQueue&& other)
+{
+	if (m_blocks.empty())
 	{
-		for (std::size_t y = 0; y < chunkSize; ++y)
+		m_blocks = std::move(other.m_blocks);
+		return;
+	}
+
+	m_blocks.insert(m_blocks.end(), other.m_blocks.begin(),
+	                other.m_blocks.end());
+	other.m_blocks.clear();
+}
+
+Chunk::Chunk(const qz::Vector3i& position, std::size_t chunkSize)
+    : m_position(position), m_chunkSize(chunkSize),
+      m_stage(GenerationStage::EMPTY), m_unloadRequested(false)
+{
+}
+
+void Chunk::fill(const Chunk::GeneratorFunction& generator, ThreadPool* pool)
+{
+	m_voxelData.resize(m_chunkSize * m_chunkSize * m_chunkSize, INVALID_STATE);
+
+	const int size    = static_cast<int>(m_chunkSize);
+	const int originX = m_position.x * size;
+	const int originY = m_position.y * size;
+	const int originZ = m_position.z * size;
+
+	// Every slab of constant z is a contiguous run of voxels, so slabs are
+	// filled independently and each one in memory order.
+	const auto fillSlabs = [&](std::size_t firstZ, std::size_t lastZ) {
+		for (std::size_t z = firstZ; z < lastZ; ++z)
 		{
-			for (std::size_t z = 0; z < chunkSize; ++z)
+			for (std::size_t y = 0; y < m_chunkSize; ++y)
 			{
-				const std::size_t idx = x + chunkSize * (y + chunkSize * z);
-				m_voxelData[idx]      = generator(x, y, z);
+				for (std::size_t x = 0; x < m_chunkSize; ++x)
+				{
+					const std::size_t idx =
+					    x + m_chunkSize * (y + m_chunkSize * z);
+					setBlockAt(idx, generator(originX + static_cast<int>(x),
+					                          originY + static_cast<int>(y),
+					                          originZ + static_cast<int>(z)));
+				}
 			}
 		}
+	};
+
+	utils::threading::parallelForRange(pool, 0, m_chunkSize, 1, fillSlabs);
+}
+
+BlockType* Chunk::getBlockAt(std::size_t x, std::size_t y,
+                             std::size_t z) const
+{
+	return getBlockAt(x + m_chunkSize * (y + m_chunkSize * z));
+}
+
+void Chunk::setBlockAt(std::size_t x, std::size_t y, std::size_t z,
+                       BlockType* block)
+{
+	setBlockAt(x + m_chunkSize * (y + m_chunkSize * z), block);
+}
+
+StructurePlacer::StructurePlacer(Terrain& terrain, Chunk& chunk)
+    : m_terrain(terrain), m_chunk(chunk)
+{
+}
+
+void StructurePlacer::setBlock(int x, int y, int z, BlockType* block)
+{
+	setBlockState(x, y, z,
+	              block == nullptr ? INVALID_STATE : block->defaultState);
+}
+
+void StructurePlacer::setBlockState(int x, int y, int z, BlockStateID state)
+{
+	if (m_terrain.worldToChunk(x, y, z) != m_chunk.getPosition())
+	{
+		m_terrain.setBlockState(x, y, z, state, GenerationStage::STRUCTURES);
+		return;
 	}
+
+	const int       size   = static_cast<int>(m_chunk.getChunkSize());
+	const Vector3i& origin = m_chunk.getPosition();
+
+	m_chunk.setStateAt(static_cast<std::size_t>(
+	                       (x - origin.x * size) +
+	                       size * ((y - origin.y * size) +
+	                               size * (z - origin.z * size))),
+	                   state);
 }
 
 Terrain::Terrain(std::size_t                     chunkSize,
@@ -55,4 +149,231 @@ Terrain::Terrain(std::size_t                     chunkSize,
 {
 }
 
-void Terrain::tick(qz::Vector3 streamCenter) {}
+void Terrain::addStructureGenerator(const StructureGenerator& generator)
+{
+	m_structureGenerators.push_back(generator);
+}
+
+Chunk* Terrain::generateChunk(const qz::Vector3i&  position,
+                              GenerationTimings* timings)
+{
+	typedef std::chrono::steady_clock clock;
+
+	Chunk* chunk;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		auto existing = m_loadedChunks.find(position);
+		if (existing != m_loadedChunks.end())
+			return &existing->second;
+
+		chunk = &m_loadedChunks.emplace(position, Chunk(position, m_chunkSize))
+		             .first->second;
+
+		// Adopt anything our neighbours queued up before we were loaded.
+		auto pending = m_pendingBlocks.find(position);
+		if (pending != m_pendingBlocks.end())
+		{
+			chunk->m_pendingBlocks.merge(std::move(pending->second));
+			m_pendingBlocks.erase(pending);
+		}
+	}
+
+	// The chunk stays in the EMPTY stage until the fill is done, so nobody
+	// else writes into it while we work on it unlocked.
+	const auto terrainStart = clock::now();
+	chunk->fill(m_generatorFunction, m_fillPool);
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		chunk->m_stage = GenerationStage::TERRAIN;
+		chunk->m_pendingBlocks.apply(*chunk, GenerationStage::TERRAIN);
+	}
+
+	const auto structuresStart = clock::now();
+
+	StructurePlacer placer(*this, *chunk);
+	for (const StructureGenerator& generator : m_structureGenerators)
+		generator(*chunk, placer);
+
+	std::vector<CompletionCallback> callbacks;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		chunk->m_stage = GenerationStage::STRUCTURES;
+		chunk->m_pendingBlocks.apply(*chunk, GenerationStage::STRUCTURES);
+
+		chunk->m_stage = GenerationStage::COMPLETE;
+		chunk->m_pendingBlocks.apply(*chunk, GenerationStage::COMPLETE);
+
+		auto waiting = m_completionCallbacks.find(position);
+		if (waiting != m_completionCallbacks.end())
+		{
+			callbacks = std::move(waiting->second);
+			m_completionCallbacks.erase(waiting);
+		}
+
+		if (chunk->m_unloadRequested)
+		{
+			eraseChunk(m_loadedChunks.find(position));
+			chunk = nullptr;
+		}
+	}
+
+	// Callbacks may well request other chunks, so they run unlocked.
+	for (CompletionCallback& callback : callbacks)
+		callback(chunk);
+
+	if (timings != nullptr)
+	{
+		using std::chrono::duration_cast;
+		using std::chrono::microseconds;
+
+		const auto terrainTime =
+		    duration_cast<microseconds>(structuresStart - terrainStart);
+		const auto structuresTime =
+		    duration_cast<microseconds>(clock::now() - structuresStart);
+
+		timings->terrain = static_cast<std::uint64_t>(terrainTime.count());
+		timings->structures =
+		    static_cast<std::uint64_t>(structuresTime.count());
+	}
+
+	return chunk;
+}
+
+Chunk* Terrain::getChunk(const qz::Vector3i& position)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	auto it = m_loadedChunks.find(position);
+	return it == m_loadedChunks.end() ? nullptr : &it->second;
+}
+
+void Terrain::whenComplete(const qz::Vector3i& position,
+                           CompletionCallback  callback)
+{
+	Chunk* chunk;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		// Only chunks that are generating wait, their generating thread
+		// always drains the callbacks, even if the chunk is unloaded.
+		auto it = m_loadedChunks.find(position);
+		if (it != m_loadedChunks.end() &&
+		    it->second.m_stage != GenerationStage::COMPLETE)
+		{
+			m_completionCallbacks[position].push_back(std::move(callback));
+			return;
+		}
+
+		chunk = it == m_loadedChunks.end() ? nullptr : &it->second;
+	}
+
+	callback(chunk);
+}
+
+void Terrain::unloadChunk(const qz::Vector3i& position)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	auto it = m_loadedChunks.find(position);
+	if (it == m_loadedChunks.end())
+		return;
+
+	// Its generating thread still works on it unlocked, and erases it once
+	// it is done.
+	if (it->second.m_stage != GenerationStage::COMPLETE)
+	{
+		it->second.m_unloadRequested = true;
+		return;
+	}
+
+	eraseChunk(it);
+}
+
+void Terrain::eraseChunk(ChunkMap::iterator chunk)
+{
+	if (!chunk->second.m_pendingBlocks.empty())
+	{
+		m_pendingBlocks[chunk->first].merge(
+		    std::move(chunk->second.m_pendingBlocks));
+	}
+
+	m_loadedChunks.erase(chunk);
+}
+
+void Terrain::setBlock(int x, int y, int z, BlockType* block,
+                       GenerationStage stage)
+{
+	setBlockState(x, y, z,
+	              block == nullptr ? INVALID_STATE : block->defaultState,
+	              stage);
+}
+
+void Terrain::setBlockState(int x, int y, int z, BlockStateID state,
+                            GenerationStage stage)
+{
+	const Vector3i chunkPos = worldToChunk(x, y, z);
+	const int      size     = static_cast<int>(m_chunkSize);
+
+	const std::uint32_t index = static_cast<std::uint32_t>(
+	    (x - chunkPos.x * size) +
+	    size * ((y - chunkPos.y * size) + size * (z - chunkPos.z * size)));
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	auto it = m_loadedChunks.find(chunkPos);
+	if (it == m_loadedChunks.end())
+	{
+		m_pendingBlocks[chunkPos].push({index, stage, state});
+		return;
+	}
+
+	// A chunk that is still generating may be written by its own thread, so
+	// everything goes through its queue until it has completed.
+	Chunk& chunk = it->second;
+	if (chunk.m_stage == GenerationStage::COMPLETE)
+		chunk.setStateAt(index, state);
+	else
+		chunk.m_pendingBlocks.push({index, stage, state});
+}
+
+std::size_t Terrain::getPendingChunkCount() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_pendingBlocks.size();
+}
+
+qz::Vector3i Terrain::worldToChunk(int x, int y, int z) const
+{
+	const int size = static_cast<int>(m_chunkSize);
+	return {math::floorDivide(x, size), math::floorDivide(y, size),
+	        math::floorDivide(z, size)};
+}
+
+void Terrain::tick(qz::Vector3 streamCenter)
+{
+	// Block entities may write blocks through the terrain, so they are
+	// ticked without holding the lock. Map nodes stay put when other threads
+	// add chunks, so the pointers remain valid.
+	std::vector<Chunk*> chunks;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (auto& loaded : m_loadedChunks)
+		{
+			Chunk& chunk = loaded.second;
+			if (chunk.m_stage == GenerationStage::COMPLETE &&
+			    chunk.m_blockEntities.getTickableCount() != 0)
+			{
+				chunks.push_back(&chunk);
+			}
+		}
+	}
+
+	for (Chunk* chunk : chunks)
+		chunk->m_blockEntities.tick(*chunk);
+}
@@ -0,0 +1,330 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+// Measures BC1 and BC3 compression speed and quality on a generated image.
+//
+// Usage: BlockCompressionBenchmark [--size 1024] [--runs 5] [--output file]
+//
+// The image mixes smooth gradients, hard edges, noise and both cut out and
+// blended alpha, like block textures do. With --output, the compressed BC1
+// and BC3 images are written one after the other, so the output of builds
+// with and without SSE2 can be compared.
+
+#include <Tests/Benchmark.hpp>
+
+#include <Quartz/Graphics/BlockCompression.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <initializer_list>
+#include <limits>
+#include <vector>
+
+using namespace qz::gfx;
+
+namespace
+{
+	/// @brief Alpha below this decodes as transparent in BC1.
+	constexpr int ALPHA_THRESHOLD = 128;
+
+	/// @brief Makes an RGBA8 image out of 64x64 tiles of varied content.
+	std::vector<std::uint8_t> makeImage(std::size_t size)
+	{
+		std::vector<std::uint8_t> image(size * size * 4);
+		std::uint32_t             noise = 1;
+
+		for (std::size_t y = 0; y < size; ++y)
+		{
+			for (std::size_t x = 0; x < size; ++x)
+			{
+				std::uint8_t* texel = &image[(y * size + x) * 4];
+
+				const std::size_t u    = x % 64;
+				const std::size_t v    = y % 64;
+				const std::size_t tile = (x / 64 + y / 64 * 3) % 4;
+
+				noise = noise * 1664525u + 1013904223u;
+				const int grain = static_cast<int>(noise >> 27);
+
+				int r = 0, g = 0, b = 0, a = 255;
+				switch (tile)
+				{
+				case 0: // A smooth gradient.
+					r = static_cast<int>(u * 4);
+					g = static_cast<int>(v * 4);
+					b = static_cast<int>((u + v) * 2);
+					break;
+				case 1: // Noisy stone, in a narrow range of colours.
+					r = 100 + grain;
+					g = 96 + grain;
+					b = 90 + grain / 2;
+					break;
+				case 2: // Leaves, with holes cut out of them.
+					r = 40 + grain;
+					g = 120 + grain * 2;
+					b = 30;
+					a = (u * 7 + v * 3) % 11 < 3 ? 0 : 255;
+					break;
+				default: // Glass, with hard edges and blended alpha.
+					r = u < 4 || v < 4 ? 220 : 140;
+					g = u < 4 || v < 4 ? 230 : 190;
+					b = 255;
+					a = static_cast<int>(64 + (u + v) * 2);
+					break;
+				}
+
+				texel[0] = static_cast<std::uint8_t>(r);
+				texel[1] = static_cast<std::uint8_t>(g);
+				texel[2] = static_cast<std::uint8_t>(b);
+				texel[3] = static_cast<std::uint8_t>(a);
+			}
+		}
+
+		return image;
+	}
+
+	void decodeColor(const std::uint8_t* block, bool opaque,
+	                 std::uint8_t* texels)
+	{
+		const int endpoints[2] = {block[0] | block[1] << 8,
+		                          block[2] | block[3] << 8};
+
+		int palette[4][4];
+		for (int i = 0; i < 2; ++i)
+		{
+			const int r = endpoints[i] >> 11;
+			const int g = (endpoints[i] >> 5) & 0x3F;
+			const int b = endpoints[i] & 0x1F;
+
+			palette[i][0] = (r << 3) | (r >> 2);
+			palette[i][1] = (g << 2) | (g >> 4);
+			palette[i][2] = (b << 3) | (b >> 2);
+			palette[i][3] = 255;
+		}
+
+		const bool fourColors = opaque || endpoints[0] > endpoints[1];
+		for (int c = 0; c < 3; ++c)
+		{
+			const int first  = palette[0][c];
+			const int second = palette[1][c];
+
+			palette[2][c] = fourColors ? (2 * first + second) / 3
+			                           : (first + second) / 2;
+			palette[3][c] = fourColors ? (first + 2 * second) / 3 : 0;
+		}
+
+		palette[2][3] = 255;
+		palette[3][3] = fourColors ? 255 : 0;
+
+		const std::uint32_t indices =
+		    block[4] | block[5] << 8 | block[6] << 16 |
+		    static_cast<std::uint32_t>(block[7]) << 24;
+
+		for (int i = 0; i < 16; ++i)
+		{
+			const int index = (indices >> (i * 2)) & 3;
+			for (int c = 0; c < 4; ++c)
+				texels[i * 4 + c] =
+				    static_cast<std::uint8_t>(palette[index][c]);
+		}
+	}
+
+	void decodeAlpha(const std::uint8_t* block, std::uint8_t* texels)
+	{
+		const int first  = block[0];
+		const int second = block[1];
+
+		int palette[8] = {first, second};
+		if (first > second)
+		{
+			for (int i = 1; i < 7; ++i)
+				palette[i + 1] = ((7 - i) * first + i * second) / 7;
+		}
+		else
+		{
+			for (int i = 1; i < 5; ++i)
+				palette[i + 1] = ((5 - i) * first + i * second) / 5;
+
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+
+		std::uint64_t indices = 0;
+		for (int i = 0; i < 6; ++i)
+			indices |= static_cast<std::uint64_t>(block[2 + i]) << (i * 8);
+
+		for (int i = 0; i < 16; ++i)
+			texels[i * 4 + 3] =
+			    static_cast<std::uint8_t>(palette[(indices >> (i * 3)) & 7]);
+	}
+
+	struct Quality
+	{
+		double colorPsnr;
+		double alphaPsnr;
+	};
+
+	double toPsnr(double squaredError, double count)
+	{
+		if (squaredError == 0)
+			return std::numeric_limits<double>::infinity();
+
+		return 10 * std::log10(255.0 * 255.0 * count / squaredError);
+	}
+
+	/**
+	 * @brief Decodes a compressed image and compares it with the source.
+	 * Colour only counts where BC1 keeps it, alpha is compared after BC1's
+	 * cut off is applied to the source.
+	 */
+	Quality measureQuality(const std::vector<std::uint8_t>& image,
+	                       std::size_t size, TextureFormat format,
+	                       const std::vector<std::uint8_t>& blocks)
+	{
+		const std::size_t blockSize    = format == TextureFormat::BC1 ? 8 : 16;
+		const std::size_t blocksAcross = (size + 3) / 4;
+
+		double colorError = 0, alphaError = 0;
+		double colorCount = 0, alphaCount = 0;
+
+		std::uint8_t decoded[64];
+		for (std::size_t row = 0; row < (size + 3) / 4; ++row)
+		{
+			for (std::size_t column = 0; column < blocksAcross; ++column)
+			{
+				const std::uint8_t* block =
+				    &blocks[(row * blocksAcross + column) * blockSize];
+
+				if (format == TextureFormat::BC3)
+				{
+					decodeColor(block + 8, true, decoded);
+					decodeAlpha(block, decoded);
+				}
+				else
+				{
+					decodeColor(block, false, decoded);
+				}
+
+				for (std::size_t i = 0; i < 16; ++i)
+				{
+					const std::size_t x = column * 4 + i % 4;
+					const std::size_t y = row * 4 + i / 4;
+					if (x >= size || y >= size)
+						continue;
+
+					const std::uint8_t* source = &image[(y * size + x) * 4];
+					const std::uint8_t* result = &decoded[i * 4];
+
+					int alpha = source[3];
+					if (format == TextureFormat::BC1)
+						alpha = alpha < ALPHA_THRESHOLD ? 0 : 255;
+
+					const double difference = alpha - result[3];
+					alphaError += difference * difference;
+					++alphaCount;
+
+					if (format == TextureFormat::BC1 && alpha == 0)
+						continue;
+
+					for (int c = 0; c < 3; ++c)
+					{
+						const double channel = source[c] - result[c];
+						colorError += channel * channel;
+					}
+
+					colorCount += 3;
+				}
+			}
+		}
+
+		return {toPsnr(colorError, colorCount),
+		        toPsnr(alphaError, alphaCount)};
+	}
+} // namespace
+
+int main(int argc, char** argv)
+{
+	const std::size_t size = qz::tests::getOption(argc, argv, "--size", 1024);
+	const std::size_t runs = qz::tests::getOption(argc, argv, "--runs", 5);
+	const char* outputPath = qz::tests::findOption(argc, argv, "--output");
+
+	const std::vector<std::uint8_t> image = makeImage(size);
+
+	// Mirrors the check in BlockCompression.cpp.
+#if !defined(QZ_BLOCK_COMPRESSION_NO_SIMD) && \
+    (defined(__SSE2__) || defined(_M_X64) || \
+     (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+	const char* const path = "SSE2";
+#else
+	const char* const path = "scalar";
+#endif
+
+	std::printf("%s compressor, %zux%zu image\n", path, size, size);
+
+	std::FILE* output = nullptr;
+	if (outputPath != nullptr)
+	{
+		output = std::fopen(outputPath, "wb");
+		if (output == nullptr)
+		{
+			std::fprintf(stderr, "Could not open %s\n", outputPath);
+			return 1;
+		}
+	}
+
+	for (const TextureFormat format : {TextureFormat::BC1, TextureFormat::BC3})
+	{
+		std::vector<std::uint8_t> blocks(getImageSize(format, size, size));
+
+		const double seconds = qz::tests::measure(runs, [&]() {
+			compressBlockRows(image.data(), size, size, format, 0,
+			                  (size + 3) / 4, blocks.data());
+		});
+
+		const Quality quality = measureQuality(image, size, format, blocks);
+
+		std::printf("%s: %8.2f Mpix/s, colour PSNR %6.2f dB, alpha PSNR "
+		            "%6.2f dB\n",
+		            format == TextureFormat::BC1 ? "BC1" : "BC3",
+		            static_cast<double>(size * size) / seconds / 1e6,
+		            quality.colorPsnr, quality.alphaPsnr);
+
+		if (output != nullptr)
+			std::fwrite(blocks.data(), 1, blocks.size(), output);
+	}
+
+	if (output != nullptr && std::fclose(output) != 0)
+	{
+		std::fprintf(stderr, "Could not write %s\n", outputPath);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,182 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+// Compares waiting on fibers with FiberJobSystem against waiting on a
+// Future, which runs other queued tasks on the waiting thread instead.
+//
+// Usage: FiberJobSystemBenchmark [--threads 1,2,4] [--fibonacci 24]
+//                                [--frames 200] [--depth 8] [--runs 3]
+//
+// "fibonacci" computes a Fibonacci number with a job per call, each waiting
+// for its two children. "frames" runs frames one after the other, each a
+// binary tree of jobs --depth levels deep that wait for their children.
+// The speedup is the time with futures over the time with fibers.
+
+#include <Tests/Benchmark.hpp>
+
+#include <Quartz/Utilities/Threading/FiberJobSystem.hpp>
+#include <Quartz/Utilities/Threading/Future.hpp>
+#include <Quartz/Utilities/Threading/ThreadPool.hpp>
+
+#include <cstdio>
+#include <vector>
+
+using qz::utils::threading::FiberJobSystem;
+using qz::utils::threading::Future;
+using qz::utils::threading::JobCounter;
+using qz::utils::threading::ThreadPool;
+
+namespace
+{
+	long fiberFibonacci(FiberJobSystem& jobs, int n)
+	{
+		if (n < 2)
+			return n;
+
+		long       first = 0, second = 0;
+		JobCounter counter;
+
+		jobs.run([&jobs, &first, n]() { first = fiberFibonacci(jobs, n - 1); },
+		         &counter);
+		jobs.run(
+		    [&jobs, &second, n]() { second = fiberFibonacci(jobs, n - 2); },
+		    &counter);
+
+		jobs.wait(counter);
+		return first + second;
+	}
+
+	long futureFibonacci(ThreadPool& pool, int n)
+	{
+		if (n < 2)
+			return n;
+
+		Future<long> first =
+		    pool.submit([&pool, n]() { return futureFibonacci(pool, n - 1); });
+		Future<long> second =
+		    pool.submit([&pool, n]() { return futureFibonacci(pool, n - 2); });
+
+		return first.get() + second.get();
+	}
+
+	void fiberTree(FiberJobSystem& jobs, int depth)
+	{
+		if (depth == 0)
+			return;
+
+		JobCounter counter;
+		jobs.run([&jobs, depth]() { fiberTree(jobs, depth - 1); }, &counter);
+		jobs.run([&jobs, depth]() { fiberTree(jobs, depth - 1); }, &counter);
+		jobs.wait(counter);
+	}
+
+	void futureTree(ThreadPool& pool, int depth)
+	{
+		if (depth == 0)
+			return;
+
+		Future<void> first =
+		    pool.submit([&pool, depth]() { futureTree(pool, depth - 1); });
+		Future<void> second =
+		    pool.submit([&pool, depth]() { futureTree(pool, depth - 1); });
+
+		first.wait();
+		second.wait();
+	}
+
+	void report(const char* name, std::size_t threads, double fibers,
+	            double futures)
+	{
+		std::printf("%-9s %7zu %10.2f %10.2f %8.2fx\n", name, threads,
+		            fibers * 1e3, futures * 1e3, futures / fibers);
+	}
+} // namespace
+
+int main(int argc, char** argv)
+{
+	using qz::tests::getOption;
+	using qz::tests::measure;
+
+	const int fibonacci =
+	    static_cast<int>(getOption(argc, argv, "--fibonacci", 24));
+	const int depth = static_cast<int>(getOption(argc, argv, "--depth", 8));
+
+	const std::size_t frames = getOption(argc, argv, "--frames", 200);
+	const std::size_t runs   = getOption(argc, argv, "--runs", 3);
+
+	const std::vector<std::size_t> threadCounts =
+	    qz::tests::getThreadCounts(argc, argv);
+
+#if defined(QZ_FIBERS_SUPPORTED)
+	std::printf("Fibers supported\n");
+#else
+	std::printf("Fibers not supported, FiberJobSystem waits by helping\n");
+#endif
+
+	std::printf("%-9s %7s %10s %10s %9s\n", "benchmark", "threads",
+	            "fibers ms", "futures ms", "speedup");
+
+	for (std::size_t threads : threadCounts)
+	{
+		ThreadPool     pool(threads);
+		FiberJobSystem jobs(pool);
+
+		const auto fiberFibonacciRun = [&]() {
+			JobCounter counter;
+			jobs.run([&]() { fiberFibonacci(jobs, fibonacci); }, &counter);
+			jobs.wait(counter);
+		};
+
+		const auto futureFibonacciRun = [&]() {
+			pool.submit([&]() { futureFibonacci(pool, fibonacci); }).wait();
+		};
+
+		report("fibonacci", threads, measure(runs, fiberFibonacciRun),
+		       measure(runs, futureFibonacciRun));
+
+		const auto fiberFrames = [&]() {
+			for (std::size_t frame = 0; frame < frames; ++frame)
+			{
+				JobCounter counter;
+				jobs.run([&]() { fiberTree(jobs, depth); }, &counter);
+				jobs.wait(counter);
+			}
+		};
+
+		const auto futureFrames = [&]() {
+			for (std::size_t frame = 0; frame < frames; ++frame)
+				pool.submit([&]() { futureTree(pool, depth); }).wait();
+		};
+
+		report("frames", threads, measure(runs, fiberFrames),
+		       measure(runs, futureFrames));
+	}
+
+	return 0;
+}
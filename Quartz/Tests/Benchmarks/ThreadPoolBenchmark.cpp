@@ -0,0 +1,223 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+// Compares ThreadPool with the pool it replaced, a single deque behind one
+// mutex, which is kept here as the baseline.
+//
+// Usage: ThreadPoolBenchmark [--threads 1,2,4] [--tasks 1000000]
+//                            [--depth 16] [--runs 3]
+//
+// "external" adds every task from the main thread, the way the engine hands
+// work to the pool. "nested" grows a binary tree of tasks that each add two
+// more from inside the pool, down to 2^depth leaves. The thread counts
+// default to 1, 2, 4 and the number of hardware threads.
+
+#include <Tests/Benchmark.hpp>
+
+#include <Quartz/Utilities/Threading/Latch.hpp>
+#include <Quartz/Utilities/Threading/ThreadPool.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using qz::utils::threading::Latch;
+using qz::utils::threading::ThreadPool;
+
+namespace
+{
+	/**
+	 * @brief The pool ThreadPool replaced: workers wait on one condition
+	 * variable and take tasks from one locked deque.
+	 */
+	class LockedThreadPool
+	{
+	public:
+		explicit LockedThreadPool(std::size_t threadCount) : m_running(true)
+		{
+			for (std::size_t i = 0; i < threadCount; ++i)
+				m_threads.emplace_back(&LockedThreadPool::threadHandle, this);
+		}
+
+		~LockedThreadPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_running = false;
+			}
+
+			m_condition.notify_all();
+
+			for (std::thread& thread : m_threads)
+				thread.join();
+		}
+
+		void addWork(std::function<void()> task)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_scheduledTasks.emplace_back(std::move(task));
+			}
+
+			m_condition.notify_one();
+		}
+
+	private:
+		void threadHandle()
+		{
+			while (true)
+			{
+				std::function<void()> task;
+
+				{
+					std::unique_lock<std::mutex> lock(m_mutex);
+
+					m_condition.wait(lock, [this]() {
+						return !m_running || !m_scheduledTasks.empty();
+					});
+
+					if (!m_running && m_scheduledTasks.empty())
+						return;
+
+					task = std::move(m_scheduledTasks.front());
+					m_scheduledTasks.pop_front();
+				}
+
+				task();
+			}
+		}
+
+	private:
+		bool m_running;
+
+		std::mutex              m_mutex;
+		std::condition_variable m_condition;
+
+		std::vector<std::thread>          m_threads;
+		std::deque<std::function<void()>> m_scheduledTasks;
+	};
+
+	template <typename Pool>
+	void runExternal(Pool& pool, std::size_t tasks)
+	{
+		std::atomic<std::size_t> done {0};
+		Latch                    latch(tasks);
+
+		for (std::size_t i = 0; i < tasks; ++i)
+		{
+			pool.addWork([&done, &latch]() {
+				done.fetch_add(1, std::memory_order_relaxed);
+				latch.countDown();
+			});
+		}
+
+		latch.wait();
+
+		if (done.load() != tasks)
+			std::abort();
+	}
+
+	template <typename Pool>
+	void spawnTree(Pool& pool, Latch& latch, std::size_t depth)
+	{
+		if (depth == 0)
+		{
+			latch.countDown();
+			return;
+		}
+
+		pool.addWork([&pool, &latch, depth]() {
+			spawnTree(pool, latch, depth - 1);
+			spawnTree(pool, latch, depth - 1);
+		});
+	}
+
+	template <typename Pool>
+	void runNested(Pool& pool, std::size_t depth)
+	{
+		Latch latch(std::size_t(1) << depth);
+		spawnTree(pool, latch, depth);
+		latch.wait();
+	}
+
+	/// @brief Times a benchmark on a fresh pool, without its start up.
+	template <typename Pool, typename Function>
+	double measurePool(std::size_t threads, std::size_t runs,
+	                   const Function& function)
+	{
+		Pool pool(threads);
+		return qz::tests::measure(runs, [&]() { function(pool); });
+	}
+
+	void report(const char* name, std::size_t threads, double locked,
+	            double stealing)
+	{
+		std::printf("%-9s %7zu %12.2f %12.2f %8.2fx\n", name, threads,
+		            locked * 1e3, stealing * 1e3, locked / stealing);
+	}
+} // namespace
+
+int main(int argc, char** argv)
+{
+	using qz::tests::getOption;
+
+	const std::size_t tasks = getOption(argc, argv, "--tasks", 1000000);
+	const std::size_t depth = getOption(argc, argv, "--depth", 16);
+	const std::size_t runs  = getOption(argc, argv, "--runs", 3);
+
+	const std::vector<std::size_t> threadCounts =
+	    qz::tests::getThreadCounts(argc, argv);
+
+	std::printf("%zu external tasks, nested tree of depth %zu, best of %zu\n",
+	            tasks, depth, runs);
+	std::printf("%-9s %7s %12s %12s %9s\n", "benchmark", "threads",
+	            "locked ms", "stealing ms", "speedup");
+
+	const auto external = [tasks](auto& pool) { runExternal(pool, tasks); };
+	const auto nested   = [depth](auto& pool) { runNested(pool, depth); };
+
+	for (std::size_t threads : threadCounts)
+	{
+		report("external", threads,
+		       measurePool<LockedThreadPool>(threads, runs, external),
+		       measurePool<ThreadPool>(threads, runs, external));
+
+		report("nested", threads,
+		       measurePool<LockedThreadPool>(threads, runs, nested),
+		       measurePool<ThreadPool>(threads, runs, nested));
+	}
+
+	return 0;
+}
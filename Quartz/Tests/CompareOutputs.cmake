@@ -0,0 +1,24 @@
+# Runs two programs with the same arguments, each writing to its own file
+# through --output, and fails unless both files are identical.
+#
+# cmake -DFIRST=<program> -DSECOND=<program> "-DARGS=<a;b>" -P CompareOutputs.cmake
+
+foreach(program FIRST SECOND)
+	execute_process(
+		COMMAND ${${program}} ${ARGS} --output ${program}.out
+		RESULT_VARIABLE result
+	)
+
+	if(NOT result EQUAL 0)
+		message(FATAL_ERROR "${${program}} failed: ${result}")
+	endif()
+endforeach()
+
+execute_process(
+	COMMAND ${CMAKE_COMMAND} -E compare_files FIRST.out SECOND.out
+	RESULT_VARIABLE different
+)
+
+if(different)
+	message(FATAL_ERROR "${FIRST} and ${SECOND} wrote different output")
+endif()
@@ -0,0 +1,138 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <limits>
+#include <thread>
+#include <vector>
+
+namespace qz
+{
+	namespace tests
+	{
+		/**
+		 * @brief Finds the value following an option such as "--threads" on
+		 * the command line.
+		 * @return The value, or nullptr if the option is not given.
+		 */
+		inline const char* findOption(int argc, char** argv, const char* name)
+		{
+			for (int i = 1; i + 1 < argc; ++i)
+			{
+				if (std::strcmp(argv[i], name) == 0)
+					return argv[i + 1];
+			}
+
+			return nullptr;
+		}
+
+		/// @brief Reads a numeric option, or returns the fallback.
+		inline std::size_t getOption(int argc, char** argv, const char* name,
+		                             std::size_t fallback)
+		{
+			const char* value = findOption(argc, argv, name);
+			return value != nullptr ? std::strtoull(value, nullptr, 10)
+			                        : fallback;
+		}
+
+		/**
+		 * @brief Reads a comma separated list of thread counts given with
+		 * --threads, which defaults to 1, 2, 4 and the number of hardware
+		 * threads.
+		 */
+		inline std::vector<std::size_t> getThreadCounts(int argc, char** argv)
+		{
+			std::vector<std::size_t> counts;
+
+			const char* list = findOption(argc, argv, "--threads");
+			if (list == nullptr)
+			{
+				const std::size_t hardware =
+				    std::thread::hardware_concurrency();
+
+				for (std::size_t count : {std::size_t(1), std::size_t(2),
+				                          std::size_t(4), hardware})
+				{
+					if (count != 0 && std::find(counts.begin(), counts.end(),
+					                            count) == counts.end())
+						counts.push_back(count);
+				}
+
+				return counts;
+			}
+
+			char* next = nullptr;
+			for (const char* value = list; *value != '\0'; value = next)
+			{
+				const std::size_t count = std::strtoull(value, &next, 10);
+				if (next == value)
+					break;
+
+				if (count != 0)
+					counts.push_back(count);
+
+				if (*next == ',')
+					++next;
+			}
+
+			return counts;
+		}
+
+		/**
+		 * @brief Runs a function a number of times and returns the fastest
+		 * run in seconds, which is the least disturbed by the rest of the
+		 * machine.
+		 */
+		template <typename Function>
+		double measure(std::size_t runs, const Function& function)
+		{
+			double fastest = std::numeric_limits<double>::max();
+
+			for (std::size_t run = 0; run < runs; ++run)
+			{
+				const auto start = std::chrono::steady_clock::now();
+				function();
+				const auto end = std::chrono::steady_clock::now();
+
+				const double seconds =
+				    std::chrono::duration<double>(end - start).count();
+				fastest = seconds < fastest ? seconds : fastest;
+			}
+
+			return fastest;
+		}
+	} // namespace tests
+} // namespace qz
@@ -0,0 +1,77 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <cstdio>
+
+namespace qz
+{
+	namespace tests
+	{
+		namespace detail
+		{
+			inline int& getFailureCount()
+			{
+				static int count = 0;
+				return count;
+			}
+		} // namespace detail
+
+		/// @brief Records a check, printing where it failed if it did.
+		inline void check(bool passed, const char* expression,
+		                  const char* file, int line)
+		{
+			if (passed)
+				return;
+
+			++detail::getFailureCount();
+			std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line,
+			             expression);
+		}
+
+		/**
+		 * @brief Reports the result of a test, to be returned from its
+		 * main so CTest sees failures.
+		 */
+		inline int finish()
+		{
+			const int failures = detail::getFailureCount();
+			if (failures != 0)
+				std::fprintf(stderr, "%d checks failed\n", failures);
+
+			return failures == 0 ? 0 : 1;
+		}
+	} // namespace tests
+} // namespace qz
+
+/// @brief Checks an expression, carrying on with the test if it is false.
+#define QZ_CHECK(expression)                                       \
+	::qz::tests::check(static_cast<bool>(expression), #expression, \
+	                   __FILE__, __LINE__)
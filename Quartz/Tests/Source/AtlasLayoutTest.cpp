@@ -0,0 +1,229 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+// Checks the texture array layout of BlockTextureAtlas without a GPU: where
+// each layer and level lives, that layers hold the decoded files, that mip
+// levels match Mipmaps, and that a cache loads back byte for byte.
+
+#include <Tests/Test.hpp>
+
+#include <Quartz/Graphics/BlockCompression.hpp>
+#include <Quartz/Graphics/Mipmaps.hpp>
+#include <Quartz/Utilities/Threading/ThreadPool.hpp>
+#include <Quartz/Voxels/BlockTextureAtlas.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using qz::voxels::BlockTextureAtlas;
+
+namespace
+{
+	constexpr std::size_t SPRITE_SIZE  = 16;
+	constexpr std::size_t SPRITE_COUNT = 5;
+
+	const char* const CACHE_PATH = "AtlasLayoutTest.cache";
+
+	std::string getSpritePath(std::size_t sprite)
+	{
+		return "AtlasLayoutTest." + std::to_string(sprite) + ".ppm";
+	}
+
+	/// @brief Gets the texels of a sprite, as RGBA8 with opaque alpha.
+	std::vector<std::uint8_t> makeSprite(std::size_t sprite)
+	{
+		std::vector<std::uint8_t> texels(SPRITE_SIZE * SPRITE_SIZE * 4);
+
+		for (std::size_t y = 0; y < SPRITE_SIZE; ++y)
+		{
+			for (std::size_t x = 0; x < SPRITE_SIZE; ++x)
+			{
+				std::uint8_t* texel = &texels[(y * SPRITE_SIZE + x) * 4];
+
+				texel[0] = static_cast<std::uint8_t>(x * 16 + sprite);
+				texel[1] = static_cast<std::uint8_t>(y * 16 + sprite * 7);
+				texel[2] = static_cast<std::uint8_t>((x ^ y) * 16);
+				texel[3] = 255;
+			}
+		}
+
+		return texels;
+	}
+
+	void writeSprite(std::size_t sprite)
+	{
+		const std::vector<std::uint8_t> texels = makeSprite(sprite);
+
+		std::ofstream file(getSpritePath(sprite), std::ios::binary);
+		file << "P6\n" << SPRITE_SIZE << ' ' << SPRITE_SIZE << "\n255\n";
+
+		for (std::size_t i = 0; i < texels.size(); i += 4)
+			file.write(reinterpret_cast<const char*>(&texels[i]), 3);
+	}
+
+	std::vector<char> readFile(const char* path)
+	{
+		std::ifstream file(path, std::ios::binary);
+		return {std::istreambuf_iterator<char>(file),
+		        std::istreambuf_iterator<char>()};
+	}
+
+	void addSprites(BlockTextureAtlas& atlas)
+	{
+		atlas.setLayout(BlockTextureAtlas::Layout::TEXTURE_ARRAY);
+		atlas.setCompressedFormat(qz::gfx::TextureFormat::BC1);
+
+		// Added out of order, IDs follow the sorted paths.
+		for (std::size_t sprite = SPRITE_COUNT; sprite-- > 0;)
+			atlas.addTextureFile(getSpritePath(sprite).c_str());
+	}
+
+	bool haveSameData(const BlockTextureAtlas& a, const BlockTextureAtlas& b)
+	{
+		return a.getPatchedTextureSize() == b.getPatchedTextureSize() &&
+		       a.getCompressedTextureSize() == b.getCompressedTextureSize() &&
+		       std::memcmp(a.getPatchedTextureData(), b.getPatchedTextureData(),
+		                   a.getPatchedTextureSize()) == 0 &&
+		       std::memcmp(a.getCompressedTextureData(),
+		                   b.getCompressedTextureData(),
+		                   a.getCompressedTextureSize()) == 0;
+	}
+
+	void checkLayout(BlockTextureAtlas& atlas)
+	{
+		const std::size_t levelCount = qz::gfx::getMipLevelCount(
+		    SPRITE_SIZE, SPRITE_SIZE);
+
+		QZ_CHECK(atlas.getLayerCount() == SPRITE_COUNT);
+		QZ_CHECK(atlas.getPatchedTextureWidth() == SPRITE_SIZE);
+		QZ_CHECK(atlas.getPatchedTextureHeight() == SPRITE_SIZE);
+		QZ_CHECK(atlas.getMipLevelCount() == levelCount);
+		QZ_CHECK(atlas.getSeparateMipLevelCount() == levelCount);
+
+		std::size_t layerSize = 0;
+		for (std::size_t level = 0; level < levelCount; ++level)
+		{
+			QZ_CHECK(atlas.getMipLevelWidth(level) == SPRITE_SIZE >> level);
+			layerSize += (SPRITE_SIZE >> level) * (SPRITE_SIZE >> level) * 4;
+		}
+
+		QZ_CHECK(atlas.getLayerSize() == layerSize);
+		QZ_CHECK(atlas.getPatchedTextureSize() == layerSize * SPRITE_COUNT);
+
+		const unsigned char* base = atlas.getPatchedTextureData();
+
+		for (std::size_t sprite = 0; sprite < SPRITE_COUNT; ++sprite)
+		{
+			const std::string path  = getSpritePath(sprite);
+			const std::size_t layer = static_cast<std::size_t>(
+			    atlas.getSpriteIDFromFilepath(path.c_str()));
+
+			QZ_CHECK(layer == sprite);
+
+			// Every level of a layer comes before the next layer.
+			std::size_t offset = layer * layerSize;
+
+			std::vector<std::uint8_t> expected = makeSprite(sprite);
+			for (std::size_t level = 0; level < levelCount; ++level)
+			{
+				const std::size_t    size = SPRITE_SIZE >> level;
+				const unsigned char* texels =
+				    atlas.getLayerMipLevelData(layer, level);
+
+				QZ_CHECK(texels == base + offset);
+				QZ_CHECK(std::memcmp(texels, expected.data(),
+				                     expected.size()) == 0);
+
+				offset += size * size * 4;
+
+				std::vector<std::uint8_t> next(
+				    std::max<std::size_t>(1, size / 2) *
+				    std::max<std::size_t>(1, size / 2) * 4);
+				qz::gfx::downsampleSRGB(expected.data(), size, size,
+				                        next.data());
+				expected = std::move(next);
+			}
+		}
+	}
+} // namespace
+
+int main()
+{
+	for (std::size_t sprite = 0; sprite < SPRITE_COUNT; ++sprite)
+		writeSprite(sprite);
+
+	std::remove(CACHE_PATH);
+
+	BlockTextureAtlas built(SPRITE_SIZE, SPRITE_SIZE);
+	addSprites(built);
+	built.setCacheFilepath(CACHE_PATH);
+	{
+		qz::utils::threading::ThreadPool pool(2);
+		built.patch(&pool);
+	}
+
+	QZ_CHECK(!built.isLoadedFromCache());
+	checkLayout(built);
+
+	const std::vector<char> cache = readFile(CACHE_PATH);
+	QZ_CHECK(!cache.empty());
+
+	BlockTextureAtlas loaded(SPRITE_SIZE, SPRITE_SIZE);
+	addSprites(loaded);
+	loaded.setCacheFilepath(CACHE_PATH);
+	loaded.patch();
+
+	QZ_CHECK(loaded.isLoadedFromCache());
+	QZ_CHECK(haveSameData(built, loaded));
+	checkLayout(loaded);
+
+	// Building again, serially this time, writes the very same cache.
+	std::remove(CACHE_PATH);
+
+	BlockTextureAtlas rebuilt(SPRITE_SIZE, SPRITE_SIZE);
+	addSprites(rebuilt);
+	rebuilt.setCacheFilepath(CACHE_PATH);
+	rebuilt.patch();
+
+	QZ_CHECK(!rebuilt.isLoadedFromCache());
+	QZ_CHECK(haveSameData(built, rebuilt));
+	QZ_CHECK(readFile(CACHE_PATH) == cache);
+
+	std::remove(CACHE_PATH);
+	for (std::size_t sprite = 0; sprite < SPRITE_COUNT; ++sprite)
+		std::remove(getSpritePath(sprite).c_str());
+
+	return qz::tests::finish();
+}
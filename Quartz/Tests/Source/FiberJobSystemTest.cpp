@@ -0,0 +1,197 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+// Stresses FiberJobSystem with jobs that wait on other jobs: a recursive
+// Fibonacci, waits nested inside waits from several outside threads, and
+// frames made of deep chains of waiting jobs.
+
+#include <Tests/Test.hpp>
+
+#include <Quartz/Utilities/Threading/FiberJobSystem.hpp>
+#include <Quartz/Utilities/Threading/ThreadPool.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+using qz::utils::threading::FiberJobSystem;
+using qz::utils::threading::JobCounter;
+using qz::utils::threading::ThreadPool;
+
+namespace
+{
+	long fibonacci(FiberJobSystem& jobs, int n)
+	{
+		if (n < 2)
+			return n;
+
+		long       first = 0, second = 0;
+		JobCounter counter;
+
+		jobs.run([&jobs, &first, n]() { first = fibonacci(jobs, n - 1); },
+		         &counter);
+		jobs.run([&jobs, &second, n]() { second = fibonacci(jobs, n - 2); },
+		         &counter);
+
+		jobs.wait(counter);
+		return first + second;
+	}
+
+	void testFibonacci(FiberJobSystem& jobs)
+	{
+		long       result = 0;
+		JobCounter counter;
+
+		jobs.run([&jobs, &result]() { result = fibonacci(jobs, 20); },
+		         &counter);
+		jobs.wait(counter);
+
+		QZ_CHECK(result == 6765);
+	}
+
+	/**
+	 * @brief Several outside threads each wait on jobs that wait on their
+	 * own children, and on children that wait in turn.
+	 */
+	void testNestedWaits(FiberJobSystem& jobs)
+	{
+		constexpr std::size_t THREADS  = 3;
+		constexpr std::size_t ROUNDS   = 20;
+		constexpr std::size_t PARENTS  = 8;
+		constexpr std::size_t CHILDREN = 16;
+
+		std::atomic<std::size_t> leaves {0};
+
+		const auto parent = [&jobs, &leaves]() {
+			JobCounter children;
+			for (std::size_t i = 0; i < CHILDREN; ++i)
+				jobs.run([&leaves]() { ++leaves; }, &children);
+
+			jobs.wait(children);
+
+			JobCounter child;
+			jobs.run(
+			    [&jobs, &leaves]() {
+				    JobCounter grandchild;
+				    jobs.run([&leaves]() { ++leaves; }, &grandchild);
+				    jobs.wait(grandchild);
+			    },
+			    &child);
+
+			jobs.wait(child);
+		};
+
+		std::vector<std::thread> threads;
+		for (std::size_t i = 0; i < THREADS; ++i)
+		{
+			threads.emplace_back([&jobs, &parent]() {
+				for (std::size_t round = 0; round < ROUNDS; ++round)
+				{
+					JobCounter parents;
+					for (std::size_t j = 0; j < PARENTS; ++j)
+						jobs.run(parent, &parents);
+
+					jobs.wait(parents);
+				}
+			});
+		}
+
+		for (std::thread& thread : threads)
+			thread.join();
+
+		QZ_CHECK(leaves == THREADS * ROUNDS * PARENTS * (CHILDREN + 1));
+	}
+
+	void runChain(FiberJobSystem& jobs, std::atomic<std::size_t>& leaves,
+	              int depth)
+	{
+		if (depth == 0)
+		{
+			++leaves;
+			return;
+		}
+
+		JobCounter counter;
+		for (int i = 0; i < 2; ++i)
+		{
+			jobs.run(
+			    [&jobs, &leaves, depth]() {
+				    runChain(jobs, leaves, depth - 1);
+			    },
+			    &counter);
+		}
+
+		jobs.wait(counter);
+	}
+
+	/// @brief Frames one after the other, each a tree of waiting jobs.
+	void testFrames(FiberJobSystem& jobs)
+	{
+		constexpr std::size_t FRAMES = 100;
+		constexpr int         DEPTH  = 8;
+
+		std::atomic<std::size_t> leaves {0};
+
+		for (std::size_t frame = 0; frame < FRAMES; ++frame)
+		{
+			JobCounter counter;
+			jobs.run([&jobs, &leaves]() { runChain(jobs, leaves, DEPTH); },
+			         &counter);
+			jobs.wait(counter);
+		}
+
+		QZ_CHECK(leaves == FRAMES << DEPTH);
+	}
+} // namespace
+
+int main()
+{
+	ThreadPool pool(4);
+
+	{
+		FiberJobSystem jobs(pool);
+
+		testFibonacci(jobs);
+		testNestedWaits(jobs);
+		testFrames(jobs);
+
+		// Left running, the destructor must wait for them.
+		std::atomic<std::size_t> ran {0};
+		{
+			FiberJobSystem detached(pool);
+			for (std::size_t i = 0; i < 1000; ++i)
+				detached.run([&ran]() { ++ran; });
+		}
+
+		QZ_CHECK(ran == 1000);
+	}
+
+	return qz::tests::finish();
+}
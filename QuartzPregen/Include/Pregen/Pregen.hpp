@@ -0,0 +1,140 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <Quartz.hpp>
+#include <Quartz/Utilities/Threading/ThreadPool.hpp>
+#include <Quartz/Voxels/Erosion.hpp>
+#include <Quartz/Voxels/Terrain.hpp>
+
+#include <Pregen/Statistics.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace pregen
+{
+	struct PregenSettings
+	{
+		/// @brief How many chunks to generate in each direction on X and Z.
+		int radius = 16;
+
+		/// @brief The lowest and highest chunk layers to generate.
+		int minY = 0;
+		int maxY = 3;
+
+		std::uint32_t seed      = 0;
+		std::size_t   chunkSize = 16;
+
+		/// @brief The number of worker threads, 0 uses every core.
+		std::size_t threadCount = 0;
+
+		/// @brief Runs hydraulic and thermal erosion over the heightmap.
+		bool erode = false;
+
+		std::string outputDirectory = "world";
+	};
+
+	/**
+	 * @brief Pregenerates a square region of terrain and saves it to disk.
+	 *
+	 * The region is generated one slab (a single X coordinate) at a time, and
+	 * a slab is only saved and unloaded once both of its neighbouring slabs
+	 * have been generated, so structures reaching up to a chunk into their
+	 * neighbours are always part of the saved chunks.
+	 *
+	 * Generation is deterministic for a seed, so an interrupted run resumes
+	 * by regenerating the last complete slab and only saving chunks that are
+	 * missing from the output directory.
+	 */
+	class Pregen
+	{
+	public:
+		explicit Pregen(const PregenSettings& settings);
+
+		/**
+		 * @brief Runs the pregeneration to completion.
+		 * @return The exit code for the process.
+		 */
+		int run();
+
+	private:
+		PregenSettings      m_settings;
+		qz::voxels::Terrain m_terrain;
+
+		/// @brief Tells instances apart in the per thread column caches.
+		const std::uint64_t m_instance;
+
+		qz::voxels::BlockType* m_air;
+		qz::voxels::BlockType* m_stone;
+		qz::voxels::BlockType* m_dirt;
+		qz::voxels::BlockType* m_grass;
+		qz::voxels::BlockType* m_log;
+		qz::voxels::BlockType* m_leaves;
+
+		/// @brief Erosion gets its own pool, as chunk generation blocks on
+		/// regions while they are being eroded.
+		std::unique_ptr<qz::utils::threading::ThreadPool> m_erosionPool;
+		std::unique_ptr<qz::voxels::ErodedRegionCache>    m_erosion;
+
+		LatencyRecorder m_terrainLatency;
+		LatencyRecorder m_structureLatency;
+		LatencyRecorder m_saveLatency;
+
+		std::atomic<std::size_t> m_generatedChunks;
+		std::atomic<std::size_t> m_savedChunks;
+		std::atomic<std::size_t> m_failedChunks;
+
+	private:
+		void registerBlocks();
+		bool prepareOutput();
+
+		float getBaseHeight(int x, int z) const;
+		int   getSurfaceHeight(int x, int z) const;
+
+		/**
+		 * @brief The surface heights of a column of chunks, row by row.
+		 *
+		 * Every thread keeps the column it used last, so filling a chunk
+		 * computes each surface height once instead of once per voxel.
+		 */
+		const int* getColumnHeights(int columnX, int columnZ) const;
+
+		qz::voxels::BlockType* generateBlock(int x, int y, int z) const;
+		void placeTrees(const qz::voxels::Chunk&      chunk,
+		                qz::voxels::StructurePlacer& placer) const;
+
+		std::string getChunkPath(const qz::Vector3i& position) const;
+		bool        isChunkSaved(const qz::Vector3i& position) const;
+		void        saveChunk(const qz::Vector3i& position);
+	};
+} // namespace pregen
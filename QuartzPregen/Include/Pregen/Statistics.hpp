@@ -0,0 +1,81 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace pregen
+{
+	/**
+	 * @brief Collects latency samples from many threads and summarises them
+	 * as percentiles.
+	 */
+	class LatencyRecorder
+	{
+	public:
+		explicit LatencyRecorder(const std::string& name) : m_name(name) {}
+
+		/**
+		 * @brief Records a single sample.
+		 * @param microseconds The measured latency.
+		 */
+		void record(std::uint64_t microseconds);
+
+		/**
+		 * @brief Calculates a percentile of everything recorded so far.
+		 * @param percentile The percentile to calculate, between 0 and 100.
+		 * @return The latency at the percentile in microseconds, or 0 if
+		 * nothing has been recorded.
+		 */
+		std::uint64_t getPercentile(double percentile) const;
+
+		std::size_t        getSampleCount() const;
+		const std::string& getName() const { return m_name; }
+
+		/**
+		 * @brief Formats the common percentiles as a single line.
+		 */
+		std::string summarise() const;
+
+	private:
+		std::string                m_name;
+		mutable std::mutex         m_mutex;
+		std::vector<std::uint64_t> m_samples;
+	};
+
+	/**
+	 * @brief The peak resident memory of this process.
+	 * @return The peak in bytes, or 0 if the platform doesn't report it.
+	 */
+	std::size_t getPeakMemoryUsage();
+} // namespace pregen
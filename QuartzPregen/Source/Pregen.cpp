@@ -0,0 +1,612 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <Pregen/Pregen.hpp>
+
+#include <Quartz/Utilities/Threading/Latch.hpp>
+#include <Quartz/Utilities/Threading/ThreadPool.hpp>
+#include <Quartz/Voxels/ChunkSerializer.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#if defined(QZ_PLATFORM_WINDOWS)
+#	include <direct.h>
+#else
+#	include <sys/stat.h>
+#endif
+
+using namespace pregen;
+using namespace qz;
+
+typedef std::chrono::steady_clock Clock;
+
+namespace
+{
+	/// @brief The surface heights of the chunk column a thread last used.
+	struct ColumnCache
+	{
+		std::uint64_t    instance = 0;
+		int              columnX  = 0;
+		int              columnZ  = 0;
+		std::vector<int> heights;
+
+		/// @brief Eroded heights, before rounding down.
+		std::vector<float> eroded;
+	};
+
+	thread_local ColumnCache t_column;
+
+	std::atomic<std::uint64_t> g_nextInstance {1};
+} // namespace
+
+static std::uint64_t microsecondsSince(Clock::time_point start)
+{
+	return static_cast<std::uint64_t>(
+	    std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() -
+	                                                          start)
+	        .count());
+}
+
+static void makeDirectory(const std::string& path)
+{
+#if defined(QZ_PLATFORM_WINDOWS)
+	_mkdir(path.c_str());
+#else
+	mkdir(path.c_str(), 0755);
+#endif
+}
+
+/**
+ * @brief Hashes a seeded 2D position into [0, 1].
+ */
+static float hashToUnit(std::uint32_t seed, int x, int z)
+{
+	std::uint32_t h = seed ^ (static_cast<std::uint32_t>(x) * 0x27D4EB2Du) ^
+	                  (static_cast<std::uint32_t>(z) * 0x165667B1u);
+
+	h ^= h >> 15;
+	h *= 0x85EBCA6Bu;
+	h ^= h >> 13;
+	h *= 0xC2B2AE35u;
+	h ^= h >> 16;
+
+	return static_cast<float>(h) / static_cast<float>(0xFFFFFFFFu);
+}
+
+static float valueNoise(std::uint32_t seed, float x, float z)
+{
+	const float cellX = std::floor(x);
+	const float cellZ = std::floor(z);
+
+	const int ix = static_cast<int>(cellX);
+	const int iz = static_cast<int>(cellZ);
+
+	// Smoothstep the fractional part to hide the grid.
+	float fx = x - cellX;
+	float fz = z - cellZ;
+	fx       = fx * fx * (3.f - 2.f * fx);
+	fz       = fz * fz * (3.f - 2.f * fz);
+
+	const float topLeft     = hashToUnit(seed, ix, iz);
+	const float topRight    = hashToUnit(seed, ix + 1, iz);
+	const float bottomLeft  = hashToUnit(seed, ix, iz + 1);
+	const float bottomRight = hashToUnit(seed, ix + 1, iz + 1);
+
+	const float top    = topLeft + (topRight - topLeft) * fx;
+	const float bottom = bottomLeft + (bottomRight - bottomLeft) * fx;
+
+	return top + (bottom - top) * fz;
+}
+
+Pregen::Pregen(const PregenSettings& settings)
+    : m_settings(settings),
+      m_terrain(settings.chunkSize,
+                [this](int x, int y, int z) { return generateBlock(x, y, z); }),
+      m_instance(g_nextInstance++),
+      m_terrainLatency("terrain"), m_structureLatency("structures"),
+      m_saveLatency("save"), m_generatedChunks(0), m_savedChunks(0),
+      m_failedChunks(0)
+{
+	registerBlocks();
+
+	m_terrain.addStructureGenerator(
+	    [this](const voxels::Chunk& chunk, voxels::StructurePlacer& placer) {
+		    placeTrees(chunk, placer);
+	    });
+}
+
+void Pregen::registerBlocks()
+{
+	voxels::BlockRegistry* registry = voxels::BlockRegistry::get();
+
+	const auto makeBlock = [registry](const char* displayName, const char* id,
+	                                  voxels::BlockTypeCategory category) {
+		voxels::BlockType block;
+		block.displayName = displayName;
+		block.id          = id;
+		block.category    = category;
+		block.textures.setAll(voxels::BlockTextureAtlas::INVALID_SPRITE);
+
+		return registry->registerBlock(block);
+	};
+
+	const voxels::BlockTypeCategory solid = voxels::BlockTypeCategory::SOLID;
+
+	m_air    = makeBlock("Air", "core:air", voxels::BlockTypeCategory::AIR);
+	m_stone  = makeBlock("Stone", "core:stone", solid);
+	m_dirt   = makeBlock("Dirt", "core:dirt", solid);
+	m_grass  = makeBlock("Grass", "core:grass", solid);
+	m_log    = makeBlock("Log", "core:log", solid);
+	m_leaves = makeBlock("Leaves", "core:leaves", solid);
+
+	// Generation workers only look blocks up from here on.
+	registry->freeze();
+}
+
+float Pregen::getBaseHeight(int x, int z) const
+{
+	const float fx = static_cast<float>(x);
+	const float fz = static_cast<float>(z);
+
+	const std::uint32_t seed = m_settings.seed;
+
+	// Three octaves, from rolling hills down to small bumps.
+	const float noise = valueNoise(seed, fx / 64.f, fz / 64.f) * 0.6f +
+	                    valueNoise(seed + 1, fx / 32.f, fz / 32.f) * 0.3f +
+	                    valueNoise(seed + 2, fx / 16.f, fz / 16.f) * 0.1f;
+
+	return 32.f + (noise - 0.5f) * 40.f;
+}
+
+int Pregen::getSurfaceHeight(int x, int z) const
+{
+	const float height =
+	    m_erosion != nullptr ? m_erosion->getHeight(x, z) : getBaseHeight(x, z);
+
+	return static_cast<int>(std::floor(height));
+}
+
+const int* Pregen::getColumnHeights(int columnX, int columnZ) const
+{
+	ColumnCache& cache = t_column;
+
+	if (cache.instance == m_instance && cache.columnX == columnX &&
+	    cache.columnZ == columnZ)
+	{
+		return cache.heights.data();
+	}
+
+	const int size    = static_cast<int>(m_settings.chunkSize);
+	const int originX = columnX * size;
+	const int originZ = columnZ * size;
+
+	const std::size_t cells = m_settings.chunkSize * m_settings.chunkSize;
+	cache.heights.resize(cells);
+
+	if (m_erosion != nullptr)
+	{
+		// One region lookup for the whole column, rather than a trip
+		// through the cache's lock for every position.
+		cache.eroded.resize(cells);
+		m_erosion->getHeights(originX, originZ, m_settings.chunkSize,
+		                      m_settings.chunkSize, cache.eroded.data());
+
+		for (std::size_t i = 0; i < cells; ++i)
+			cache.heights[i] = static_cast<int>(std::floor(cache.eroded[i]));
+	}
+	else
+	{
+		for (int z = 0; z < size; ++z)
+		{
+			for (int x = 0; x < size; ++x)
+				cache.heights[x + z * size] =
+				    getSurfaceHeight(originX + x, originZ + z);
+		}
+	}
+
+	cache.instance = m_instance;
+	cache.columnX  = columnX;
+	cache.columnZ  = columnZ;
+
+	return cache.heights.data();
+}
+
+voxels::BlockType* Pregen::generateBlock(int x, int y, int z) const
+{
+	const int size    = static_cast<int>(m_settings.chunkSize);
+	const int columnX = math::floorDivide(x, size);
+	const int columnZ = math::floorDivide(z, size);
+
+	const int localX = x - columnX * size;
+	const int localZ = z - columnZ * size;
+
+	const int* heights = getColumnHeights(columnX, columnZ);
+	const int  surface = heights[localX + localZ * size];
+
+	if (y > surface)
+		return m_air;
+
+	if (y == surface)
+		return m_grass;
+
+	return y > surface - 4 ? m_dirt : m_stone;
+}
+
+void Pregen::placeTrees(const voxels::Chunk&      chunk,
+                        voxels::StructurePlacer& placer) const
+{
+	const int size    = static_cast<int>(chunk.getChunkSize());
+	const int originX = chunk.getPosition().x * size;
+	const int originY = chunk.getPosition().y * size;
+	const int originZ = chunk.getPosition().z * size;
+
+	const int* heights =
+	    getColumnHeights(chunk.getPosition().x, chunk.getPosition().z);
+
+	for (int x = originX; x < originX + size; ++x)
+	{
+		for (int z = originZ; z < originZ + size; ++z)
+		{
+			if (hashToUnit(m_settings.seed + 3, x, z) > 0.01f)
+				continue;
+
+			// Trees belong to the chunk containing the block they grow on.
+			const int surface = heights[(x - originX) + (z - originZ) * size];
+			if (surface < originY || surface >= originY + size)
+				continue;
+
+			const int trunkHeight = 5;
+
+			for (int ly = surface + 3; ly <= surface + trunkHeight + 1; ++ly)
+			{
+				for (int lx = x - 2; lx <= x + 2; ++lx)
+				{
+					for (int lz = z - 2; lz <= z + 2; ++lz)
+						placer.setBlock(lx, ly, lz, m_leaves);
+				}
+			}
+
+			for (int ty = surface + 1; ty <= surface + trunkHeight; ++ty)
+				placer.setBlock(x, ty, z, m_log);
+		}
+	}
+}
+
+bool Pregen::prepareOutput()
+{
+	makeDirectory(m_settings.outputDirectory);
+
+	// The settings that change what gets generated are remembered, so a
+	// resumed run can't mix two different worlds.
+	const std::string configPath = m_settings.outputDirectory + "/pregen.cfg";
+
+	std::uint32_t seed      = 0;
+	std::size_t   chunkSize = 0;
+	bool          erode     = false;
+
+	std::ifstream existing(configPath);
+	if (existing >> seed >> chunkSize >> erode)
+	{
+		if (seed != m_settings.seed || chunkSize != m_settings.chunkSize ||
+		    erode != m_settings.erode)
+		{
+			LFATAL("The output directory was pregenerated with seed ", seed,
+			       ", chunk size ", chunkSize, " and erosion ",
+			       erode ? "on" : "off", ", refusing to resume.");
+			return false;
+		}
+
+		LINFO("Resuming the pregeneration in ", m_settings.outputDirectory);
+		return true;
+	}
+
+	std::ofstream config(configPath);
+	config << m_settings.seed << ' ' << m_settings.chunkSize << ' '
+	       << m_settings.erode << '\n';
+
+	return config.good();
+}
+
+std::string Pregen::getChunkPath(const Vector3i& position) const
+{
+	return m_settings.outputDirectory + "/" +
+	       voxels::ChunkSerializer::getFilename(position);
+}
+
+bool Pregen::isChunkSaved(const Vector3i& position) const
+{
+	return std::ifstream(getChunkPath(position)).good();
+}
+
+void Pregen::saveChunk(const Vector3i& position)
+{
+	const auto start = Clock::now();
+
+	const voxels::Chunk* chunk = m_terrain.getChunk(position);
+	if (chunk != nullptr && !isChunkSaved(position))
+	{
+		// Write to a temporary file first, so an interrupted save never
+		// leaves a truncated chunk behind that would be skipped on resume.
+		const std::string path      = getChunkPath(position);
+		const std::string temporary = path + ".tmp";
+
+		bool written;
+		{
+			std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+			written = voxels::ChunkSerializer::write(file, *chunk);
+			file.close();
+			written = written && file.good();
+		}
+
+		if (written && std::rename(temporary.c_str(), path.c_str()) == 0)
+		{
+			m_savedChunks++;
+			m_saveLatency.record(microsecondsSince(start));
+		}
+		else
+		{
+			std::remove(temporary.c_str());
+			m_failedChunks++;
+		}
+	}
+
+	m_terrain.unloadChunk(position);
+}
+
+int Pregen::run()
+{
+	if (!prepareOutput())
+		return 1;
+
+	std::size_t threadCount = m_settings.threadCount;
+	if (threadCount == 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	const int radius = m_settings.radius;
+
+	const auto slabPositions = [this, radius](int x) {
+		std::vector<Vector3i> positions;
+		for (int y = m_settings.minY; y <= m_settings.maxY; ++y)
+		{
+			for (int z = -radius; z <= radius; ++z)
+				positions.emplace_back(x, y, z);
+		}
+
+		return positions;
+	};
+
+	// Find the first slab with anything missing, the slab before it is
+	// regenerated (but not saved) so structures spilling over from it are
+	// restored.
+	int firstMissing = radius + 1;
+	for (int x = -radius; x <= radius && firstMissing > radius; ++x)
+	{
+		for (const Vector3i& position : slabPositions(x))
+		{
+			if (!isChunkSaved(position))
+			{
+				firstMissing = x;
+				break;
+			}
+		}
+	}
+
+	if (firstMissing > radius)
+	{
+		LINFO("Every chunk within the radius is already pregenerated.");
+		return 0;
+	}
+
+	const int firstSlab = std::max(-radius, firstMissing - 1);
+
+	if (m_settings.erode)
+	{
+		// Eroded regions are cached next to the chunks, so resuming doesn't
+		// pay for the erosion again.
+		const std::string cacheDirectory =
+		    m_settings.outputDirectory + "/erosion";
+		makeDirectory(cacheDirectory);
+
+		utils::threading::ThreadPoolOptions erosionOptions;
+		erosionOptions.name = "Erosion";
+
+		m_erosionPool.reset(
+		    new utils::threading::ThreadPool(threadCount, erosionOptions));
+		m_erosion.reset(new voxels::ErodedRegionCache(
+		    [this](int x, int z) { return getBaseHeight(x, z); },
+		    voxels::ErosionSettings(), m_settings.seed, cacheDirectory,
+		    m_erosionPool.get()));
+	}
+
+	LINFO("Pregenerating slabs ", firstSlab, " to ", radius, " on ",
+	      threadCount, " threads.");
+
+	utils::threading::ThreadPoolOptions options;
+	options.name = "Pregen";
+
+	utils::threading::ThreadPool pool(threadCount, options);
+
+	const auto runStart = Clock::now();
+
+	// Slab x is generated while slab x - 2 is saved, which is safe since
+	// nothing generated from slab x onwards can reach it anymore.
+	for (int x = firstSlab; x <= radius + 2; ++x)
+	{
+		std::vector<Vector3i> generate;
+		std::vector<Vector3i> save;
+
+		if (x <= radius)
+			generate = slabPositions(x);
+
+		if (x - 2 >= firstSlab)
+			save = slabPositions(x - 2);
+
+		utils::threading::Latch latch(generate.size() + save.size());
+
+		for (const Vector3i& position : generate)
+		{
+			pool.addWork([this, position, &latch]() {
+				voxels::GenerationTimings timings;
+				m_terrain.generateChunk(position, &timings);
+
+				m_terrainLatency.record(timings.terrain);
+				m_structureLatency.record(timings.structures);
+				m_generatedChunks++;
+
+				latch.countDown();
+			});
+		}
+
+		for (const Vector3i& position : save)
+		{
+			pool.addWork([this, position, &latch]() {
+				saveChunk(position);
+				latch.countDown();
+			});
+		}
+
+		latch.wait();
+
+		const double seconds =
+		    static_cast<double>(microsecondsSince(runStart)) / 1e6;
+
+		LINFO("Slab ", x, ": ", m_generatedChunks.load(), " generated, ",
+		      m_savedChunks.load(), " saved, ",
+		      static_cast<std::size_t>(m_generatedChunks.load() / seconds),
+		      " chunks/s");
+	}
+
+	const double seconds =
+	    static_cast<double>(microsecondsSince(runStart)) / 1e6;
+
+	LINFO("Finished in ", seconds, "s at ",
+	      static_cast<std::size_t>(m_generatedChunks.load() / seconds),
+	      " chunks/s");
+	LINFO(m_terrainLatency.summarise());
+	LINFO(m_structureLatency.summarise());
+	LINFO(m_saveLatency.summarise());
+	LINFO("Peak memory: ", getPeakMemoryUsage() / (1024 * 1024), "MiB");
+
+	if (m_terrain.getPendingChunkCount() > 0)
+	{
+		LINFO("Structure blocks are waiting for ",
+		      m_terrain.getPendingChunkCount(),
+		      " chunks outside of the radius.");
+	}
+
+	if (m_failedChunks > 0)
+	{
+		LFATAL("Failed to save ", m_failedChunks.load(), " chunks.");
+		return 1;
+	}
+
+	return 0;
+}
+
+static void printUsage()
+{
+	std::cout
+	    << "Usage: QuartzPregen [options]\n"
+	       "  --radius <chunks>     Chunks to generate around the origin\n"
+	       "  --min-y <chunks>      The lowest chunk layer to generate\n"
+	       "  --max-y <chunks>      The highest chunk layer to generate\n"
+	       "  --seed <number>       The world seed\n"
+	       "  --chunk-size <blocks> The size of a chunk along each axis\n"
+	       "  --threads <count>     Worker threads, defaults to every core\n"
+	       "  --erode               Erode the terrain before voxelizing it\n"
+	       "  --output <directory>  Where to save the chunks\n";
+}
+
+int main(int argc, char** argv)
+{
+	PregenSettings settings;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string option = argv[i];
+
+		if (option == "--erode")
+		{
+			settings.erode = true;
+			continue;
+		}
+
+		if (option == "--help" || i + 1 >= argc)
+		{
+			printUsage();
+			return option == "--help" ? 0 : 1;
+		}
+
+		const char* value = argv[++i];
+
+		if (option == "--radius")
+			settings.radius = std::atoi(value);
+		else if (option == "--min-y")
+			settings.minY = std::atoi(value);
+		else if (option == "--max-y")
+			settings.maxY = std::atoi(value);
+		else if (option == "--seed")
+			settings.seed =
+			    static_cast<std::uint32_t>(std::strtoul(value, nullptr, 10));
+		else if (option == "--chunk-size")
+			settings.chunkSize = std::strtoul(value, nullptr, 10);
+		else if (option == "--threads")
+			settings.threadCount = std::strtoul(value, nullptr, 10);
+		else if (option == "--output")
+			settings.outputDirectory = value;
+		else
+		{
+			printUsage();
+			return 1;
+		}
+	}
+
+	if (settings.radius < 0 || settings.minY > settings.maxY ||
+	    settings.chunkSize == 0)
+	{
+		printUsage();
+		return 1;
+	}
+
+	LOGGER_INIT("QuartzPregen.log", qz::utils::LogVerbosity::INFO);
+
+	const int result = Pregen(settings).run();
+
+	LOGGER_DESTROY();
+
+	return result;
+}
@@ -0,0 +1,115 @@
+// Copyright 2019 Genten Studios
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors
+// may be used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <Pregen/Statistics.hpp>
+
+#include <Quartz/Core.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+#if defined(QZ_PLATFORM_WINDOWS)
+#	include <Windows.h>
+#	include <psapi.h>
+#elif defined(QZ_PLATFORM_LINUX) || defined(QZ_PLATFORM_APPLE)
+#	include <sys/resource.h>
+#endif
+
+using namespace pregen;
+
+void LatencyRecorder::record(std::uint64_t microseconds)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_samples.push_back(microseconds);
+}
+
+std::uint64_t LatencyRecorder::getPercentile(double percentile) const
+{
+	std::vector<std::uint64_t> samples;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		samples = m_samples;
+	}
+
+	if (samples.empty())
+		return 0;
+
+	// Nearest rank, so the result is always a value that was recorded.
+	const double rank  = std::ceil(percentile / 100.0 * samples.size());
+	std::size_t  index = rank < 1.0 ? 0 : static_cast<std::size_t>(rank) - 1;
+	index              = std::min(index, samples.size() - 1);
+
+	std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+	return samples[index];
+}
+
+std::size_t LatencyRecorder::getSampleCount() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_samples.size();
+}
+
+std::string LatencyRecorder::summarise() const
+{
+	std::stringstream ss;
+	ss << m_name << ": p50 " << getPercentile(50.0) << "us, p90 "
+	   << getPercentile(90.0) << "us, p99 " << getPercentile(99.0)
+	   << "us, max " << getPercentile(100.0) << "us (" << getSampleCount()
+	   << " samples)";
+
+	return ss.str();
+}
+
+std::size_t pregen::getPeakMemoryUsage()
+{
+#if defined(QZ_PLATFORM_WINDOWS)
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters,
+	                         sizeof(counters)))
+	{
+		return counters.PeakWorkingSetSize;
+	}
+
+	return 0;
+#elif defined(QZ_PLATFORM_LINUX) || defined(QZ_PLATFORM_APPLE)
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+
+#	if defined(QZ_PLATFORM_APPLE)
+	// macOS reports bytes, everyone else reports kilobytes.
+	return static_cast<std::size_t>(usage.ru_maxrss);
+#	else
+	return static_cast<std::size_t>(usage.ru_maxrss) * 1024;
+#	endif
+#else
+	return 0;
+#endif
+}